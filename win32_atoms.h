@@ -0,0 +1,242 @@
+// win32_atoms.h - Atom tables used by the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+#pragma once
+
+#include "win32_compat.h"
+#include "win32_handles.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Case-insensitive string interning with reference counts, as behind
+// GlobalAddAtom and the window class and message names. String atoms are
+// numbered from kFirstStringAtom upwards; values below that are integer
+// atoms, written MAKEINTATOM(n) or "#n", which are never stored.
+//
+// Names are found through a chained hash over ASCII-folded bytes, so a
+// lookup hashes and compares the caller's string in place and never
+// allocates. All operations serialize on a lock; the returned name
+// pointers stay valid until the atom is deleted.
+class AtomTable {
+public:
+    static const ATOM kFirstStringAtom = 0xC000;
+    static const size_t kMaxAtoms = 0x10000 - kFirstStringAtom;
+    static const size_t kMaxNameLength = 255;
+
+    AtomTable() : freeHead_(kNoEntry), count_(0) {}
+
+    AtomTable(const AtomTable&) = delete;
+    AtomTable& operator=(const AtomTable&) = delete;
+
+    // Take a reference to the atom for name, adding it if needed. Returns 0
+    // for empty, overlong or invalid names, or when the table is full.
+    ATOM Add(LPCSTR name) {
+        ATOM integer;
+        if (ParseIntegerAtom(name, &integer)) {
+            return integer;
+        }
+        size_t length = strlen(name);
+        if (length == 0 || length > kMaxNameLength) {
+            return 0;
+        }
+        uint32_t hash = Hash(name, length);
+        std::lock_guard<SpinLock> lock(lock_);
+        uint32_t index = FindLocked(name, length, hash);
+        if (index != kNoEntry) {
+            ++entries_[index].refs;
+            return (ATOM)(kFirstStringAtom + index);
+        }
+        if (freeHead_ != kNoEntry) {
+            index = freeHead_;
+            freeHead_ = entries_[index].next;
+        } else if (entries_.size() < kMaxAtoms) {
+            index = (uint32_t)entries_.size();
+            entries_.push_back(Entry());
+        } else {
+            return 0;
+        }
+        if (count_ + 1 > buckets_.size()) {
+            Rehash(buckets_.empty() ? 64 : buckets_.size() * 2);
+        }
+        Entry& entry = entries_[index];
+        entry.name.reset(new char[length + 1]);
+        memcpy(entry.name.get(), name, length + 1);
+        entry.length = (uint32_t)length;
+        entry.hash = hash;
+        entry.refs = 1;
+        uint32_t& bucket = buckets_[hash & (buckets_.size() - 1)];
+        entry.next = bucket;
+        bucket = index;
+        ++count_;
+        return (ATOM)(kFirstStringAtom + index);
+    }
+
+    // The atom for name without adding a reference, or 0
+    ATOM Find(LPCSTR name) const {
+        ATOM integer;
+        if (ParseIntegerAtom(name, &integer)) {
+            return integer;
+        }
+        size_t length = strlen(name);
+        if (length == 0 || length > kMaxNameLength) {
+            return 0;
+        }
+        uint32_t hash = Hash(name, length);
+        std::lock_guard<SpinLock> lock(lock_);
+        uint32_t index = FindLocked(name, length, hash);
+        return index != kNoEntry ? (ATOM)(kFirstStringAtom + index) : 0;
+    }
+
+    // Drop a reference; the atom is removed with its last one. Integer
+    // atoms always succeed. Returns false for unknown atoms.
+    bool Delete(ATOM atom) {
+        if (atom < kFirstStringAtom) {
+            return atom != 0;
+        }
+        std::lock_guard<SpinLock> lock(lock_);
+        uint32_t index = atom - kFirstStringAtom;
+        if (index >= entries_.size() || !entries_[index].name) {
+            return false;
+        }
+        Entry& entry = entries_[index];
+        if (--entry.refs > 0) {
+            return true;
+        }
+        uint32_t* link = &buckets_[entry.hash & (buckets_.size() - 1)];
+        while (*link != index) {
+            link = &entries_[*link].next;
+        }
+        *link = entry.next;
+        entry.name.reset();
+        entry.next = freeHead_;
+        freeHead_ = index;
+        --count_;
+        return true;
+    }
+
+    // Copy the atom's name ("#n" for integer atoms) into buffer; returns the
+    // number of characters copied, or 0 for unknown atoms
+    UINT GetName(ATOM atom, LPSTR buffer, int size) const {
+        if (!buffer || size <= 0 || atom == 0) {
+            return 0;
+        }
+        char integer[8];
+        const char* name = integer;
+        size_t length;
+        std::lock_guard<SpinLock> lock(lock_);
+        if (atom < kFirstStringAtom) {
+            length = (size_t)snprintf(integer, sizeof(integer), "#%u", (unsigned)atom);
+        } else {
+            uint32_t index = atom - kFirstStringAtom;
+            if (index >= entries_.size() || !entries_[index].name) {
+                return 0;
+            }
+            name = entries_[index].name.get();
+            length = entries_[index].length;
+        }
+        if (length > (size_t)size - 1) {
+            length = (size_t)size - 1;
+        }
+        memcpy(buffer, name, length);
+        buffer[length] = '\0';
+        return (UINT)length;
+    }
+
+private:
+    static const uint32_t kNoEntry = 0xFFFFFFFFu;
+
+    struct Entry {
+        std::unique_ptr<char[]> name; // NULL for free entries
+        uint32_t length;
+        uint32_t hash;
+        uint32_t refs;
+        uint32_t next;                // Hash chain, or free list for free entries
+
+        Entry() : length(0), hash(0), refs(0), next(kNoEntry) {}
+    };
+
+    static unsigned char Fold(unsigned char c) { return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + 32) : c; }
+
+    // FNV-1a over the case-folded name
+    static uint32_t Hash(const char* name, size_t length) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; ++i) {
+            hash = (hash ^ Fold((unsigned char)name[i])) * 16777619u;
+        }
+        return hash;
+    }
+
+    static bool EqualFolded(const char* a, const char* b, size_t length) {
+        for (size_t i = 0; i < length; ++i) {
+            if (Fold((unsigned char)a[i]) != Fold((unsigned char)b[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // MAKEINTATOM values and "#n" strings name integer atoms 1..0xBFFF
+    static bool ParseIntegerAtom(LPCSTR name, ATOM* atom) {
+        if (IS_INTRESOURCE(name)) {
+            uintptr_t value = (uintptr_t)name;
+            *atom = (value < kFirstStringAtom) ? (ATOM)value : 0;
+            return true;
+        }
+        if (name[0] != '#') {
+            return false;
+        }
+        uint32_t value = 0;
+        const char* p = name + 1;
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        for (; *p >= '0' && *p <= '9'; ++p) {
+            value = value * 10 + (uint32_t)(*p - '0');
+            if (value >= kFirstStringAtom) {
+                break;
+            }
+        }
+        if (*p != '\0') {
+            return false;
+        }
+        *atom = (ATOM)value;
+        return true;
+    }
+
+    uint32_t FindLocked(const char* name, size_t length, uint32_t hash) const {
+        if (buckets_.empty()) {
+            return kNoEntry;
+        }
+        for (uint32_t index = buckets_[hash & (buckets_.size() - 1)]; index != kNoEntry;
+             index = entries_[index].next) {
+            const Entry& entry = entries_[index];
+            if (entry.hash == hash && entry.length == length && EqualFolded(entry.name.get(), name, length)) {
+                return index;
+            }
+        }
+        return kNoEntry;
+    }
+
+    void Rehash(size_t bucketCount) {
+        buckets_.assign(bucketCount, (uint32_t)kNoEntry);
+        for (uint32_t index = 0; index < entries_.size(); ++index) {
+            Entry& entry = entries_[index];
+            if (entry.name) {
+                uint32_t& bucket = buckets_[entry.hash & (bucketCount - 1)];
+                entry.next = bucket;
+                bucket = index;
+            }
+        }
+    }
+
+    std::vector<Entry> entries_;   // Indexed by atom - kFirstStringAtom
+    std::vector<uint32_t> buckets_;
+    uint32_t freeHead_;
+    size_t count_;
+    mutable SpinLock lock_;
+};
@@ -0,0 +1,1072 @@
+// win32_bench.cpp - Microbenchmarks for the Win32 API compatibility layer
+//
+// Usage: multiverse32_bench [--json <file>|-] [--repeat <n>] [--filter <text>] [--quick]
+//
+// Every benchmark prints a human-readable line as it runs. With --json the
+// results are also written as JSON, for tracking regressions between
+// versions; each value is the median over --repeat runs of the suite.
+// --filter runs only the benchmarks whose name contains the text, and
+// --quick divides all iteration counts by 10 for smoke testing.
+#include "win32_compat.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+// Count heap allocations so paths that must not allocate can be checked
+static std::atomic<long> g_allocationCount(0);
+
+void* operator new(size_t size) {
+    g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static const UINT WM_BENCH = WM_APP + 1;
+
+static long g_paintCount = 0;
+static long g_dispatchCount = 0;
+
+static LRESULT CALLBACK BenchWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+    if (uMsg == WM_BENCH) {
+        ++g_dispatchCount;
+        return 0;
+    }
+    if (uMsg == WM_PAINT) {
+        ++g_paintCount;
+        PAINTSTRUCT ps;
+        BeginPaint(hwnd, &ps);
+        EndPaint(hwnd, &ps);
+        return 0;
+    }
+    return 0;
+}
+
+static double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Samples of one result across repetitions of the suite
+struct BenchResult {
+    std::string name;
+    std::string unit;
+    std::vector<double> samples;
+};
+
+static std::vector<BenchResult> g_results;
+static FILE* g_log = stdout;          // Human-readable output; stderr with --json -
+static const char* g_filter = nullptr;
+static int g_divisor = 1;
+
+static void Record(const char* name, double value, const std::string& unit) {
+    for (BenchResult& result : g_results) {
+        if (result.name == name) {
+            result.samples.push_back(value);
+            return;
+        }
+    }
+    BenchResult result;
+    result.name = name;
+    result.unit = unit;
+    result.samples.push_back(value);
+    g_results.push_back(result);
+}
+
+// Throughput: count units processed in the given time
+static void Report(const char* name, double count, double seconds, const char* unit) {
+    fprintf(g_log, "%-32s %12.0f %s/s  (%.3f s)\n", name, count / seconds, unit, seconds);
+    Record(name, count / seconds, std::string(unit) + "/s");
+}
+
+// Secondary figure of the preceding benchmark, such as allocations per frame
+static void ReportValue(const char* name, double value, const char* unit) {
+    fprintf(g_log, "%-32s %12.3f %s\n", "", value, unit);
+    Record(name, value, unit);
+}
+
+static bool Selected(const char* name) {
+    return !g_filter || strstr(name, g_filter) != nullptr;
+}
+
+// Iteration count, reduced by --quick
+static int Iterations(int count) {
+    return count / g_divisor > 0 ? count / g_divisor : 1;
+}
+
+// Post a burst of messages, then drain them all
+static void BenchPostDrain(HWND hwnd, int count) {
+    MSG msg;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        PostMessage(hwnd, WM_BENCH, (WPARAM)i, 0);
+    }
+    int drained = 0;
+    while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+        ++drained;
+    }
+    Report("queue.post_drain", drained, SecondsSince(start), "msg");
+}
+
+// Keep a steady backlog and alternate post/remove, as a busy pump does
+static void BenchSteadyState(HWND hwnd, int count, int backlog) {
+    MSG msg;
+    for (int i = 0; i < backlog; ++i) {
+        PostMessage(hwnd, WM_BENCH, 0, 0);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        PostMessage(hwnd, WM_BENCH, (WPARAM)i, 0);
+        PeekMessage(&msg, NULL, 0, 0, PM_REMOVE);
+    }
+    Report("queue.steady_state", count, SecondsSince(start), "msg");
+    while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+    }
+}
+
+// Drain keyboard messages out of a queue interleaved with other traffic
+static void BenchRangeFilter(HWND hwnd, int count) {
+    MSG msg;
+    for (int i = 0; i < count; ++i) {
+        PostMessage(hwnd, WM_BENCH, 0, 0);
+        PostMessage(hwnd, WM_KEYDOWN, (WPARAM)i, 0);
+    }
+    auto start = std::chrono::steady_clock::now();
+    int drained = 0;
+    while (PeekMessage(&msg, NULL, WM_KEYFIRST, WM_KEYLAST, PM_REMOVE)) {
+        ++drained;
+    }
+    Report("queue.range_filter", drained, SecondsSince(start), "msg");
+    while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+    }
+}
+
+// Drain one window's messages, and then one message number, out of a
+// queue interleaved with traffic for another window that stays queued
+static void BenchFilteredDrain(HWND hwnd, int count) {
+    HWND other = CreateWindowEx(0, "BenchWindowClass", "Other", WS_OVERLAPPEDWINDOW, 0, 0, 100, 100,
+                                NULL, NULL, NULL, NULL);
+    if (!other) {
+        return;
+    }
+    MSG msg;
+    for (int i = 0; i < count; ++i) {
+        PostMessage(other, WM_BENCH, 0, 0);
+        PostMessage(hwnd, WM_BENCH, (WPARAM)i, 0);
+    }
+    auto start = std::chrono::steady_clock::now();
+    int drained = 0;
+    while (PeekMessage(&msg, hwnd, 0, 0, PM_REMOVE)) {
+        ++drained;
+    }
+    Report("queue.window_filter", drained, SecondsSince(start), "msg");
+
+    for (int i = 0; i < count; ++i) {
+        PostMessage(hwnd, WM_BENCH + 1, (WPARAM)i, 0);
+    }
+    start = std::chrono::steady_clock::now();
+    drained = 0;
+    while (PeekMessage(&msg, NULL, WM_BENCH + 1, WM_BENCH + 1, PM_REMOVE)) {
+        ++drained;
+    }
+    Report("queue.message_filter", drained, SecondsSince(start), "msg");
+    while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+    }
+    DestroyWindow(other);
+}
+
+// Invalidate between every posted message, then pump: repaints must not
+// scale with the number of invalidations
+static void BenchInvalidateCoalescing(HWND hwnd, int count) {
+    MSG msg;
+    g_paintCount = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        InvalidateRect(hwnd, NULL, FALSE);
+        PostMessage(hwnd, WM_BENCH, 0, 0);
+    }
+    while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+        DispatchMessage(&msg);
+    }
+    Report("queue.invalidate_coalesce", count, SecondsSince(start), "inval");
+    ReportValue("queue.invalidate_coalesce.paints", (double)g_paintCount, "paints");
+}
+
+// Post messages in batches and dispatch each to the window procedure, as a
+// GetMessage/DispatchMessage loop does
+static void BenchDispatch(HWND hwnd, int count) {
+    const int batch = 1000;
+    MSG msg;
+    g_dispatchCount = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int posted = 0; posted < count; posted += batch) {
+        for (int i = 0; i < batch; ++i) {
+            PostMessage(hwnd, WM_BENCH, (WPARAM)i, 0);
+        }
+        for (int i = 0; i < batch && GetMessage(&msg, NULL, 0, 0) > 0; ++i) {
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+    }
+    Report("queue.post_dispatch", (double)g_dispatchCount, SecondsSince(start), "msg");
+}
+
+// Worker threads post to the window while this thread dispatches, as when
+// background jobs report progress to the UI
+static void BenchCrossThread(HWND hwnd, int count, int producers) {
+    const int perProducer = count / producers;
+    MSG msg;
+    g_dispatchCount = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([hwnd, perProducer] {
+            for (int i = 0; i < perProducer; ++i) {
+                PostMessage(hwnd, WM_BENCH, (WPARAM)i, 0);
+            }
+        });
+    }
+    while (g_dispatchCount < (long)perProducer * producers && GetMessage(&msg, NULL, 0, 0) > 0) {
+        DispatchMessage(&msg);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    Report("queue.cross_thread_post", (double)g_dispatchCount, SecondsSince(start), "msg");
+}
+
+// SetTimer/KillTimer cost with many live timers, then how late a 10 ms
+// timer fires while they are pending
+static void BenchTimers(HWND hwnd, int count, int ticks) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        SetTimer(hwnd, (UINT_PTR)(i + 1), 60000 + (UINT)(i * 7919 % 60000), NULL);
+    }
+    for (int i = 0; i < count; ++i) {
+        // Resetting an existing timer moves it in the heap
+        SetTimer(hwnd, (UINT_PTR)(i + 1), 60000 + (UINT)(i * 104729 % 60000), NULL);
+    }
+    Report("timer.set", 2.0 * count, SecondsSince(start), "op");
+
+    const UINT_PTR tickId = (UINT_PTR)count + 1;
+    MSG msg;
+    SetTimer(hwnd, tickId, 10, NULL);
+    auto last = std::chrono::steady_clock::now();
+    double lateness = 0;
+    for (int received = 0; received < ticks && GetMessage(&msg, NULL, 0, 0) > 0;) {
+        if (msg.message == WM_TIMER && msg.wParam == tickId) {
+            auto now = std::chrono::steady_clock::now();
+            lateness += std::chrono::duration<double, std::micro>(now - last).count() - 10000.0;
+            last = now;
+            ++received;
+        }
+        DispatchMessage(&msg);
+    }
+    ReportValue("timer.lateness", lateness / ticks, "us");
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i <= count; ++i) {
+        KillTimer(hwnd, (UINT_PTR)(i + 1));
+    }
+    Report("timer.kill", count + 1, SecondsSince(start), "op");
+}
+
+// Create and immediately destroy top-level windows
+static void BenchWindowChurn(const char* name, LPCSTR className, int count) {
+    long allocationsBefore = g_allocationCount.load();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        HWND hwnd = CreateWindowEx(0, className, "Churn", WS_OVERLAPPEDWINDOW,
+                                   0, 0, 320, 240, NULL, NULL, NULL, NULL);
+        DestroyWindow(hwnd);
+    }
+    double seconds = SecondsSince(start);
+    long allocations = g_allocationCount.load() - allocationsBefore;
+    Report(name, count, seconds, "window");
+    std::string allocationsName = std::string(name) + ".allocations";
+    ReportValue(allocationsName.c_str(), (double)allocations / count, "allocations/window");
+}
+
+// BeginPaint/EndPaint round trips, reporting heap allocations per frame
+static void BenchPaintCycle(const char* name, const char* className, int frames) {
+    HWND hwnd = CreateWindowEx(0, className, "Paint", WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+                               0, 0, 640, 480, NULL, NULL, NULL, NULL);
+    if (!hwnd) {
+        return;
+    }
+    PAINTSTRUCT ps;
+    // Warm up the handle table before counting
+    BeginPaint(hwnd, &ps);
+    EndPaint(hwnd, &ps);
+
+    long allocationsBefore = g_allocationCount.load();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        InvalidateRect(hwnd, NULL, FALSE);
+        BeginPaint(hwnd, &ps);
+        EndPaint(hwnd, &ps);
+    }
+    double seconds = SecondsSince(start);
+    long allocations = g_allocationCount.load() - allocationsBefore;
+    Report(name, frames, seconds, "frame");
+    std::string allocationsName = std::string(name) + ".allocations";
+    ReportValue(allocationsName.c_str(), (double)allocations / frames, "allocations/frame");
+    DestroyWindow(hwnd);
+}
+
+// Paint a list of rows the way owner-drawn controls do, setting the colors
+// before every call, once with GDI batching and once with it disabled
+static void BenchPaintGdi(const char* name, DWORD batchLimit, int frames) {
+    HWND hwnd = CreateWindowEx(0, "BenchWindowClass", "Paint", WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+                               0, 0, 640, 480, NULL, NULL, NULL, NULL);
+    if (!hwnd) {
+        return;
+    }
+    DWORD previousLimit = GdiSetBatchLimit(batchLimit);
+    HBRUSH stripe = CreateSolidBrush(RGB(236, 240, 248));
+    HPEN grid = CreatePen(PS_SOLID, 1, RGB(200, 200, 200));
+    const int rowHeight = 20;
+    const int rows = 480 / rowHeight;
+    PAINTSTRUCT ps;
+    long calls = 0;
+    long allocationsBefore = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = -1; i < frames; ++i) {
+        if (i == 0) {
+            // The first frame warms up the batch pool and the glyph atlas
+            allocationsBefore = g_allocationCount.load();
+            start = std::chrono::steady_clock::now();
+            calls = 0;
+        }
+        InvalidateRect(hwnd, NULL, FALSE);
+        HDC hdc = BeginPaint(hwnd, &ps);
+        HGDIOBJ oldPen = SelectObject(hdc, grid);
+        SetBkMode(hdc, TRANSPARENT);
+        for (int row = 0; row < rows; ++row) {
+            RECT rect = { 0, row * rowHeight, 640, (row + 1) * rowHeight };
+            if (row & 1) {
+                FillRect(hdc, &rect, stripe);
+            }
+            SetTextColor(hdc, RGB(0, 0, 0));
+            TextOut(hdc, 4, rect.top + 2, "Item name", 9);
+            SetTextColor(hdc, RGB(96, 96, 96));
+            TextOut(hdc, 320, rect.top + 2, "Details", 7);
+            MoveToEx(hdc, 0, rect.bottom - 1, NULL);
+            LineTo(hdc, 640, rect.bottom - 1);
+            calls += 8 + (row & 1);
+        }
+        SelectObject(hdc, oldPen);
+        EndPaint(hwnd, &ps);
+    }
+    double seconds = SecondsSince(start);
+    long allocations = g_allocationCount.load() - allocationsBefore;
+    Report(name, (double)calls, seconds, "call");
+    std::string allocationsName = std::string(name) + ".allocations";
+    ReportValue(allocationsName.c_str(), (double)allocations / frames, "allocations/frame");
+    GdiSetBatchLimit(previousLimit);
+    DeleteObject(grid);
+    DeleteObject(stripe);
+    DestroyWindow(hwnd);
+}
+
+// Fill a full-HD client area with solid rectangles
+static void BenchFillRect(int frames) {
+    HWND hwnd = CreateWindowEx(0, "BenchWindowClass", "Fill", WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+                               0, 0, 1920, 1080, NULL, NULL, NULL, NULL);
+    if (!hwnd) {
+        return;
+    }
+    HDC hdc = GetDC(hwnd);
+    RECT rect = { 0, 0, 1920, 1080 };
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        FillRect(hdc, &rect, (HBRUSH)(uintptr_t)(COLOR_WINDOW + 1 + (i & 1)));
+    }
+    Report("raster.fillrect", (double)frames * 1920 * 1080, SecondsSince(start), "px");
+    ReleaseDC(hwnd, hdc);
+    DestroyWindow(hwnd);
+}
+
+// Redraw a full screen of text, as a terminal or editor does every frame;
+// glyphs come from the atlas after the first frame. The wide run adds the
+// transcoding of UNICODE builds.
+static void BenchTextOut(int frames) {
+    HWND hwnd = CreateWindowEx(0, "BenchWindowClass", "Text", WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+                               0, 0, 1280, 800, NULL, NULL, NULL, NULL);
+    if (!hwnd) {
+        return;
+    }
+    HDC hdc = GetDC(hwnd);
+    char line[81];
+    WCHAR wideLine[81];
+    for (int i = 0; i < 80; ++i) {
+        line[i] = (char)(' ' + 1 + i % 94);
+        wideLine[i] = (WCHAR)line[i];
+    }
+    line[80] = '\0';
+    wideLine[80] = 0;
+    TEXTMETRIC tm;
+    GetTextMetrics(hdc, &tm);
+    int rows = 800 / tm.tmHeight;
+    long glyphs = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        for (int row = 0; row < rows; ++row) {
+            TextOut(hdc, 0, row * tm.tmHeight, line, 80);
+            glyphs += 80;
+        }
+    }
+    Report("text.textout", (double)glyphs, SecondsSince(start), "glyph");
+    glyphs = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        for (int row = 0; row < rows; ++row) {
+            TextOutW(hdc, 0, row * tm.tmHeight, wideLine, 80);
+            glyphs += 80;
+        }
+    }
+    Report("text.textout_w", (double)glyphs, SecondsSince(start), "glyph");
+    ReleaseDC(hwnd, hdc);
+    DestroyWindow(hwnd);
+}
+
+// Lay out centered single-line labels with DrawText, counting the pixels
+// of the text cells drawn
+static void BenchDrawText(int frames) {
+    HWND hwnd = CreateWindowEx(0, "BenchWindowClass", "Text", WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+                               0, 0, 1280, 800, NULL, NULL, NULL, NULL);
+    if (!hwnd) {
+        return;
+    }
+    HDC hdc = GetDC(hwnd);
+    static const char label[] = "The quick brown fox jumps over the lazy dog 0123456789";
+    const int length = (int)sizeof(label) - 1;
+    SIZE extent;
+    GetTextExtentPoint32(hdc, label, length, &extent);
+    int rows = 800 / extent.cy;
+    double pixels = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        for (int row = 0; row < rows; ++row) {
+            RECT rect = { 0, row * extent.cy, 1280, (row + 1) * extent.cy };
+            DrawText(hdc, label, length, &rect, DT_CENTER | DT_VCENTER | DT_SINGLELINE);
+            pixels += (double)extent.cx * extent.cy;
+        }
+    }
+    Report("text.drawtext", pixels, SecondsSince(start), "px");
+    ReleaseDC(hwnd, hdc);
+    DestroyWindow(hwnd);
+}
+
+// Redraw a list of wrapped, ellipsized item descriptions, as a details
+// view does on every paint; layouts come from the cache after the first
+// frame
+static void BenchDrawTextWrapped(int frames) {
+    HWND hwnd = CreateWindowEx(0, "BenchWindowClass", "Text", WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+                               0, 0, 1280, 800, NULL, NULL, NULL, NULL);
+    if (!hwnd) {
+        return;
+    }
+    HDC hdc = GetDC(hwnd);
+    static const char* const items[] = {
+        "Quarterly report\twith revenue and expense figures for every region, ready for review",
+        "Meeting notes from the planning session, including open questions and the owners of each action",
+        "Screenshot of the crash dialog shown after resuming from sleep with an external display attached",
+        "Draft of the release announcement; the wording of the second paragraph still needs another pass",
+    };
+    const int itemCount = (int)(sizeof(items) / sizeof(items[0]));
+    TEXTMETRIC tm;
+    GetTextMetrics(hdc, &tm);
+    int rowHeight = 3 * tm.tmHeight;
+    int rows = 800 / rowHeight;
+    long labels = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        for (int row = 0; row < rows; ++row) {
+            RECT rect = { 0, row * rowHeight, 600, (row + 1) * rowHeight };
+            DrawText(hdc, items[row % itemCount], -1, &rect, DT_WORDBREAK | DT_EXPANDTABS | DT_END_ELLIPSIS);
+            ++labels;
+        }
+    }
+    Report("text.drawtext_wrapped", (double)labels, SecondsSince(start), "label");
+    ReleaseDC(hwnd, hdc);
+    DestroyWindow(hwnd);
+}
+
+// Present a full-HD back buffer the way double-buffered apps do, then
+// stretch and alpha-blend it
+static void BenchBlit(int frames) {
+    HWND hwnd = CreateWindowEx(0, "BenchWindowClass", "Blit", WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+                               0, 0, 1920, 1080, NULL, NULL, NULL, NULL);
+    if (!hwnd) {
+        return;
+    }
+    HDC hdc = GetDC(hwnd);
+    HDC memDC = CreateCompatibleDC(hdc);
+    
+    BITMAPINFO bmi = {};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = 1920;
+    bmi.bmiHeader.biHeight = -1080;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    void* bits = NULL;
+    HBITMAP dib = CreateDIBSection(hdc, &bmi, DIB_RGB_COLORS, &bits, NULL, 0);
+    if (!dib) {
+        return;
+    }
+    // Premultiplied gradient with a mix of opaque, translucent and clear pixels
+    uint32_t* pixels = (uint32_t*)bits;
+    for (int i = 0; i < 1920 * 1080; ++i) {
+        uint32_t alpha = (i % 3 == 0) ? 255 : (i % 3 == 1) ? 128 : 0;
+        uint32_t value = (i * 7) & 0xFF;
+        pixels[i] = (alpha << 24) | ((value * alpha / 255) * 0x010101u);
+    }
+    HGDIOBJ oldBitmap = SelectObject(memDC, dib);
+    double pixelsPerFrame = 1920.0 * 1080.0;
+    
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        BitBlt(hdc, 0, 0, 1920, 1080, memDC, 0, 0, SRCCOPY);
+    }
+    Report("blit.bitblt", frames * pixelsPerFrame, SecondsSince(start), "px");
+    
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        BitBlt(hdc, 0, 0, 1920, 1080, memDC, 0, 0, SRCINVERT);
+    }
+    Report("blit.bitblt_srcinvert", frames * pixelsPerFrame, SecondsSince(start), "px");
+    
+    SetStretchBltMode(hdc, HALFTONE);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames / 4; ++i) {
+        StretchBlt(hdc, 0, 0, 1920, 1080, memDC, 0, 0, 960, 540, SRCCOPY);
+    }
+    Report("blit.stretch_bilinear", frames / 4 * pixelsPerFrame, SecondsSince(start), "px");
+    
+    BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        AlphaBlend(hdc, 0, 0, 1920, 1080, memDC, 0, 0, 1920, 1080, blend);
+    }
+    Report("blit.alphablend", frames * pixelsPerFrame, SecondsSince(start), "px");
+    
+    SelectObject(memDC, oldBitmap);
+    DeleteObject(dib);
+    DeleteDC(memDC);
+    ReleaseDC(hwnd, hdc);
+    DestroyWindow(hwnd);
+}
+
+#ifndef _WIN32
+// Paint small updates of a full-HD window flat out. EndPaint hands each
+// frame to the present thread without waiting, so the frame rate is the
+// paint rate; the present thread shows at most one frame per refresh.
+static void BenchPresent(int frames) {
+    HWND hwnd = CreateWindowEx(0, "BenchWindowClass", "Present", WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+                               0, 0, 1920, 1080, NULL, NULL, NULL, NULL);
+    if (!hwnd) {
+        return;
+    }
+    PAINTSTRUCT ps;
+    BeginPaint(hwnd, &ps);
+    EndPaint(hwnd, &ps);
+    MV32_PRESENT_STATS before = {};
+    Mv32GetPresentStats(hwnd, &before);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        RECT rect = { (i * 64) % 1920, (i / 30 * 64) % 1080, 0, 0 };
+        rect.right = rect.left + 64;
+        rect.bottom = rect.top + 64;
+        InvalidateRect(hwnd, &rect, FALSE);
+        HDC hdc = BeginPaint(hwnd, &ps);
+        FillRect(hdc, &rect, (HBRUSH)(uintptr_t)(COLOR_WINDOW + 1 + (i & 1)));
+        EndPaint(hwnd, &ps);
+    }
+    double seconds = SecondsSince(start);
+    MV32_PRESENT_STATS after = {};
+    Mv32GetPresentStats(hwnd, &after);
+    Report("present.small_updates", frames, seconds, "frame");
+    ReportValue("present.small_updates.presented", (after.framesPresented - before.framesPresented) / seconds,
+                "presents/s");
+    ReportValue("present.small_updates.dropped", (double)(after.framesDropped - before.framesDropped) / frames,
+                "dropped/frame");
+
+    // Repaint the whole window every frame while only a small spot changes,
+    // as windows that ignore the update region do: tile diffing should
+    // present little more than the spot
+    Mv32GetPresentStats(hwnd, &before);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames / 100; ++i) {
+        InvalidateRect(hwnd, NULL, FALSE);
+        HDC hdc = BeginPaint(hwnd, &ps);
+        FillRect(hdc, &ps.rcPaint, (HBRUSH)(uintptr_t)(COLOR_WINDOW + 1));
+        RECT spot = { (i * 16) % 1920, 500, 0, 516 };
+        spot.right = spot.left + 16;
+        FillRect(hdc, &spot, (HBRUSH)GetStockObject(BLACK_BRUSH));
+        EndPaint(hwnd, &ps);
+    }
+    seconds = SecondsSince(start);
+    Mv32GetPresentStats(hwnd, &after);
+    unsigned long long presents = after.framesPresented - before.framesPresented;
+    Report("present.full_repaint", frames / 100, seconds, "frame");
+    ReportValue("present.full_repaint.bytes", presents ? (double)(after.bytesPresented - before.bytesPresented) / presents : 0,
+                "bytes/present");
+    DestroyWindow(hwnd);
+
+    // Paint a CS_OWNDC window while its DC is held from GetDC, as applications
+    // that keep their own DC do: every EndPaint must still finish a frame
+    hwnd = CreateWindowEx(0, "BenchOwnDCClass", "Present", WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+                          0, 0, 1920, 1080, NULL, NULL, NULL, NULL);
+    if (!hwnd) {
+        return;
+    }
+    HDC held = GetDC(hwnd);
+    Mv32GetPresentStats(hwnd, &before);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames / 10; ++i) {
+        RECT rect = { (i * 64) % 1920, 500, 0, 564 };
+        rect.right = rect.left + 64;
+        InvalidateRect(hwnd, &rect, FALSE);
+        HDC hdc = BeginPaint(hwnd, &ps);
+        FillRect(hdc, &rect, (HBRUSH)(uintptr_t)(COLOR_WINDOW + 1 + (i & 1)));
+        EndPaint(hwnd, &ps);
+    }
+    seconds = SecondsSince(start);
+    Mv32GetPresentStats(hwnd, &after);
+    Report("present.owndc_held", frames / 10, seconds, "frame");
+    ReportValue("present.owndc_held.finished", (double)(after.framesFinished - before.framesFinished) / (frames / 10),
+                "finished/frame");
+    ReleaseDC(hwnd, held);
+    DestroyWindow(hwnd);
+}
+
+// Paint a 4K dashboard of panels, charts and labels in one batch, drawn
+// tile by tile on 1, 2, 4... threads up to one per core, and on at least 4
+// so that machines with few cores still check the tiled path. One more frame
+// is painted and hashed for each count, and must match the serial one.
+static void BenchTiledPaint(int frames) {
+    const int width = 3840;
+    const int height = 2160;
+    HWND hwnd = CreateWindowEx(0, "BenchWindowClass", "Tiled", WS_POPUP | WS_VISIBLE,
+                               0, 0, width, height, NULL, NULL, NULL, NULL);
+    if (!hwnd) {
+        return;
+    }
+    BITMAPINFO bmi = {};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -height;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    void* bits = NULL;
+    HDC memDC = CreateCompatibleDC(NULL);
+    HBITMAP dib = CreateDIBSection(memDC, &bmi, DIB_RGB_COLORS, &bits, NULL, 0);
+    if (!dib) {
+        DeleteDC(memDC);
+        DestroyWindow(hwnd);
+        return;
+    }
+    HGDIOBJ oldBitmap = SelectObject(memDC, dib);
+    DWORD previousLimit = GdiSetBatchLimit(100000);
+    HBRUSH panel = CreateSolidBrush(RGB(244, 246, 250));
+    HPEN border = CreatePen(PS_SOLID, 2, RGB(180, 186, 200));
+    HPEN series = CreatePen(PS_SOLID, 1, RGB(40, 110, 220));
+    const int columns = 12;
+    const int rows = 9;
+    const int panelWidth = width / columns;
+    const int panelHeight = height / rows;
+    PAINTSTRUCT ps;
+
+    // Paint frame i; with capture, copy the result into the DIB before the
+    // paint ends
+    auto paint = [&](int i, bool capture) {
+        InvalidateRect(hwnd, NULL, FALSE);
+        HDC hdc = BeginPaint(hwnd, &ps);
+        FillRect(hdc, &ps.rcPaint, (HBRUSH)(uintptr_t)(COLOR_WINDOW + 1));
+        SetBkMode(hdc, TRANSPARENT);
+        for (int row = 0; row < rows; ++row) {
+            for (int column = 0; column < columns; ++column) {
+                int left = column * panelWidth + 8;
+                int top = row * panelHeight + 8;
+                int right = left + panelWidth - 16;
+                int bottom = top + panelHeight - 16;
+                HGDIOBJ oldPen = SelectObject(hdc, border);
+                HGDIOBJ oldBrush = SelectObject(hdc, panel);
+                Rectangle(hdc, left, top, right, bottom);
+                SelectObject(hdc, series);
+                MoveToEx(hdc, left + 8, bottom - 24, NULL);
+                for (int x = left + 8; x < right - 8; x += 24) {
+                    LineTo(hdc, x, bottom - 32 - (x * 7 + row * 13 + i) % (panelHeight / 2));
+                }
+                SelectObject(hdc, oldPen);
+                SelectObject(hdc, oldBrush);
+                SetTextColor(hdc, RGB(30, 30, 40));
+                TextOut(hdc, left + 8, top + 6, "Requests per second", 19);
+                RECT label = { left + 8, top + 28, right - 8, top + 64 };
+                DrawText(hdc, "p50 12 ms, p99 48 ms across all regions this hour", -1, &label,
+                         DT_WORDBREAK | DT_END_ELLIPSIS);
+            }
+        }
+        if (capture) {
+            BitBlt(memDC, 0, 0, width, height, hdc, 0, 0, SRCCOPY); // Flushes the batch first
+        }
+        EndPaint(hwnd, &ps);
+    };
+
+    // FNV-1a over the captured frame
+    auto hashFrame = [&] {
+        const uint32_t* pixels = (const uint32_t*)bits;
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (size_t i = 0; i < (size_t)width * height; ++i) {
+            hash = (hash ^ pixels[i]) * 0x100000001B3ull;
+        }
+        return hash;
+    };
+
+    int maxThreads = std::max(4, (int)std::thread::hardware_concurrency());
+    int previousThreads = Mv32SetRasterThreads(1);
+    uint64_t serialHash = 0;
+    int mismatches = 0;
+    for (int threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+        Mv32SetRasterThreads(threads);
+        paint(-1, false); // Warms up the glyph atlas and the pool
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; ++i) {
+            paint(i, false);
+        }
+        double seconds = SecondsSince(start);
+        std::string name = "raster.tiled_paint.threads" + std::to_string(threads);
+        Report(name.c_str(), frames, seconds, "frame");
+
+        paint(frames, true);
+        uint64_t hash = hashFrame();
+        if (threads == 1) {
+            serialHash = hash;
+        } else if (hash != serialHash) {
+            fprintf(g_log, "raster.tiled_paint: %d threads drew a different frame than 1\n", threads);
+            ++mismatches;
+        }
+        if (threads >= maxThreads) {
+            break;
+        }
+    }
+    ReportValue("raster.tiled_paint.mismatches", mismatches, "mismatched thread counts");
+    Mv32SetRasterThreads(previousThreads);
+    GdiSetBatchLimit(previousLimit);
+    DeleteObject(series);
+    DeleteObject(border);
+    DeleteObject(panel);
+    SelectObject(memDC, oldBitmap);
+    DeleteObject(dib);
+    DeleteDC(memDC);
+    DestroyWindow(hwnd);
+}
+#endif
+
+// Resolve handles of a large window population in a scattered order
+static void BenchHandleLookup(int windowCount, int lookups) {
+    std::vector<HWND> windows;
+    windows.reserve(windowCount);
+    for (int i = 0; i < windowCount; ++i) {
+        HWND hwnd = CreateWindowEx(0, "BenchWindowClass", "", WS_OVERLAPPEDWINDOW,
+                                   0, 0, 10 + i % 100, 10, NULL, NULL, NULL, NULL);
+        if (!hwnd) {
+            break;
+        }
+        windows.push_back(hwnd);
+    }
+    if (windows.empty()) {
+        return;
+    }
+
+    // Fixed-seed LCG so every run touches the same sequence
+    uint32_t seed = 12345;
+    long checksum = 0;
+    RECT rect;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        if (GetClientRect(windows[seed % windows.size()], &rect)) {
+            checksum += rect.right;
+        }
+    }
+    Report("handle.lookup", lookups, SecondsSince(start), "lookup");
+
+    // Destroy and recreate half the windows to exercise slot recycling
+    start = std::chrono::steady_clock::now();
+    int churn = (int)windows.size() / 2;
+    for (int i = 0; i < churn; ++i) {
+        DestroyWindow(windows[i * 2]);
+        windows[i * 2] = CreateWindowEx(0, "BenchWindowClass", "", WS_OVERLAPPEDWINDOW,
+                                        0, 0, 10, 10, NULL, NULL, NULL, NULL);
+    }
+    Report("handle.churn", churn, SecondsSince(start), "window");
+
+    for (HWND hwnd : windows) {
+        DestroyWindow(hwnd);
+    }
+    // Handles of destroyed windows must no longer resolve
+    int stale = 0;
+    for (HWND hwnd : windows) {
+        if (GetClientRect(hwnd, &rect)) {
+            ++stale;
+        }
+    }
+    fprintf(g_log, "%-32s %12zu windows, checksum %ld\n", "", windows.size(), checksum);
+    ReportValue("handle.stale_resolved", stale, "stale handles resolved");
+}
+
+// Point queries against a form of many child controls laid out on a grid
+// under a few large group boxes
+static void BenchHitTest(int columns, int rows, int queries) {
+    HWND form = CreateWindowEx(0, "BenchWindowClass", "Form", WS_OVERLAPPEDWINDOW | WS_CLIPCHILDREN,
+                               0, 0, columns * 40, rows * 24, NULL, NULL, NULL, NULL);
+    if (!form) {
+        return;
+    }
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            CreateWindowEx(0, "BenchWindowClass", "", WS_CHILD | WS_VISIBLE, column * 40 + 2, row * 24 + 2,
+                           36, 20, form, (void*)(uintptr_t)(row * columns + column + 1), NULL, NULL);
+        }
+    }
+    for (int group = 0; group < 4; ++group) {
+        CreateWindowEx(0, "BenchWindowClass", "", WS_CHILD | WS_VISIBLE, (group % 2) * columns * 20,
+                       (group / 2) * rows * 12, columns * 20, rows * 12, form, NULL, NULL, NULL);
+    }
+
+    uint32_t seed = 12345;
+    long hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < queries; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        POINT pt = { (int)(seed >> 8) % (columns * 40), (int)(seed >> 20) % (rows * 24) };
+        if (ChildWindowFromPointEx(form, pt, CWP_SKIPINVISIBLE | CWP_SKIPDISABLED) != form) {
+            ++hits;
+        }
+    }
+    Report("hittest.child_from_point", queries, SecondsSince(start), "query");
+    fprintf(g_log, "%-32s %12d controls, %ld hits\n", "", columns * rows + 4, hits);
+    DestroyWindow(form);
+}
+
+static const char* PlatformName() {
+#if defined(_WIN32)
+    return "windows";
+#elif defined(__APPLE__)
+    return "macos";
+#elif defined(__linux__)
+    return "linux";
+#else
+    return "unknown";
+#endif
+}
+
+static void WriteJsonString(FILE* out, const char* text) {
+    fputc('"', out);
+    for (const char* p = text; *p; ++p) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', out);
+        }
+        if ((unsigned char)*p >= 0x20) {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void WriteJson(FILE* out, int repeat) {
+    fprintf(out, "{\n  \"suite\": \"multiverse32_bench\",\n  \"schema\": 1,\n");
+    fprintf(out, "  \"platform\": \"%s\",\n  \"compiler\": ", PlatformName());
+#if defined(__VERSION__)
+    WriteJsonString(out, __VERSION__);
+#elif defined(_MSC_FULL_VER)
+    fprintf(out, "\"msvc %d\"", _MSC_FULL_VER);
+#else
+    fprintf(out, "\"unknown\"");
+#endif
+#ifdef NDEBUG
+    fprintf(out, ",\n  \"build\": \"release\",\n");
+#else
+    fprintf(out, ",\n  \"build\": \"debug\",\n");
+#endif
+    fprintf(out, "  \"quick\": %s,\n  \"repeat\": %d,\n", g_divisor > 1 ? "true" : "false", repeat);
+    fprintf(out, "  \"timestamp\": %lld,\n  \"results\": [", (long long)time(nullptr));
+    for (size_t i = 0; i < g_results.size(); ++i) {
+        const BenchResult& result = g_results[i];
+        std::vector<double> sorted = result.samples;
+        std::sort(sorted.begin(), sorted.end());
+        size_t n = sorted.size();
+        double median = (n % 2) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+        fprintf(out, "%s\n    {\"name\": ", i ? "," : "");
+        WriteJsonString(out, result.name.c_str());
+        fprintf(out, ", \"unit\": ");
+        WriteJsonString(out, result.unit.c_str());
+        fprintf(out, ", \"value\": %.17g, \"min\": %.17g, \"max\": %.17g, \"samples\": [",
+                median, sorted.front(), sorted.back());
+        for (size_t j = 0; j < result.samples.size(); ++j) {
+            fprintf(out, "%s%.17g", j ? ", " : "", result.samples[j]);
+        }
+        fprintf(out, "]}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    // Options are space separated; paths with spaces are not supported
+    std::string commandLine = lpCmdLine ? lpCmdLine : "";
+    std::vector<std::string> args;
+    size_t position = 0;
+    while (position < commandLine.size()) {
+        size_t end = commandLine.find(' ', position);
+        if (end == std::string::npos) {
+            end = commandLine.size();
+        }
+        if (end > position) {
+            args.push_back(commandLine.substr(position, end - position));
+        }
+        position = end + 1;
+    }
+    const char* jsonPath = nullptr;
+    int repeat = 1;
+    for (size_t i = 0; i < args.size(); ++i) {
+        bool hasValue = i + 1 < args.size();
+        if (args[i] == "--json" && hasValue) {
+            jsonPath = args[++i].c_str();
+        } else if (args[i] == "--repeat" && hasValue) {
+            repeat = atoi(args[++i].c_str());
+        } else if (args[i] == "--filter" && hasValue) {
+            g_filter = args[++i].c_str();
+        } else if (args[i] == "--quick") {
+            g_divisor = 10;
+        } else {
+            fprintf(stderr, "usage: multiverse32_bench [--json <file>|-] [--repeat <n>] [--filter <text>] [--quick]\n");
+            return 2;
+        }
+    }
+    if (repeat < 1) {
+        repeat = 1;
+    }
+    if (jsonPath && strcmp(jsonPath, "-") == 0) {
+        g_log = stderr;
+    }
+
+    WNDCLASSEX wc = {};
+    wc.cbSize = sizeof(WNDCLASSEX);
+    wc.lpfnWndProc = BenchWindowProc;
+    wc.hInstance = hInstance;
+    wc.lpszClassName = "BenchWindowClass";
+    ATOM benchClass = RegisterClassEx(&wc);
+    if (!benchClass) {
+        return -1;
+    }
+    WNDCLASSEX ownDCClass = wc;
+    ownDCClass.style = CS_OWNDC;
+    ownDCClass.lpszClassName = "BenchOwnDCClass";
+    RegisterClassEx(&ownDCClass);
+
+    HWND hwnd = CreateWindowEx(0, "BenchWindowClass", "Bench", WS_OVERLAPPEDWINDOW,
+                               0, 0, 640, 480, NULL, NULL, hInstance, NULL);
+    if (!hwnd) {
+        return -1;
+    }
+
+    // Windows caps a thread queue at 10,000 posted messages and a process at
+    // 10,000 timers, so counts are kept below that there; the emulation has
+    // no such limits.
+#ifdef _WIN32
+    const int burst = Iterations(9000);
+    const int timerCount = Iterations(9000); // Also the per-process timer limit
+#else
+    const int burst = Iterations(4000000);
+    const int timerCount = Iterations(100000);
+#endif
+    for (int run = 0; run < repeat; ++run) {
+        if (repeat > 1) {
+            fprintf(g_log, "-- run %d of %d\n", run + 1, repeat);
+        }
+        // The queue benchmarks drain without dispatching, so the window
+        // stays hidden until WM_PAINT is wanted
+        ShowWindow(hwnd, SW_HIDE);
+        if (Selected("queue.post_drain")) BenchPostDrain(hwnd, burst);
+        if (Selected("queue.steady_state")) BenchSteadyState(hwnd, Iterations(4000000), 1000);
+        if (Selected("queue.range_filter")) BenchRangeFilter(hwnd, burst / 2);
+        if (Selected("queue.window_filter") || Selected("queue.message_filter")) {
+            BenchFilteredDrain(hwnd, Iterations(20000));
+        }
+        if (Selected("queue.post_dispatch")) BenchDispatch(hwnd, Iterations(4000000));
+        if (Selected("queue.cross_thread_post")) BenchCrossThread(hwnd, burst, 4);
+        if (Selected("timer.")) BenchTimers(hwnd, timerCount, Iterations(100));
+        ShowWindow(hwnd, SW_SHOW);
+        if (Selected("queue.invalidate_coalesce")) BenchInvalidateCoalescing(hwnd, burst / 2);
+        if (Selected("window.create_destroy")) {
+            BenchWindowChurn("window.create_destroy", "BenchWindowClass", Iterations(200000));
+            BenchWindowChurn("window.create_destroy_atom", MAKEINTATOM(benchClass), Iterations(200000));
+        }
+        if (Selected("paint.begin_end")) {
+            BenchPaintCycle("paint.begin_end", "BenchWindowClass", Iterations(2000000));
+            BenchPaintCycle("paint.begin_end_owndc", "BenchOwnDCClass", Iterations(2000000));
+        }
+        if (Selected("paint.gdi")) {
+            BenchPaintGdi("paint.gdi_batched", 0, Iterations(2000));
+            BenchPaintGdi("paint.gdi_unbatched", 1, Iterations(2000));
+        }
+        if (Selected("raster.fillrect")) BenchFillRect(Iterations(500));
+        if (Selected("text.textout")) BenchTextOut(Iterations(200));
+        if (Selected("text.drawtext")) BenchDrawText(Iterations(200));
+        if (Selected("text.drawtext_wrapped")) BenchDrawTextWrapped(Iterations(2000));
+        if (Selected("blit.")) BenchBlit(Iterations(200));
+#ifndef _WIN32
+        if (Selected("present.")) BenchPresent(Iterations(200000));
+        if (Selected("raster.tiled")) BenchTiledPaint(Iterations(100));
+#endif
+        if (Selected("handle.")) BenchHandleLookup(16000, Iterations(20000000));
+        if (Selected("hittest.")) BenchHitTest(32, 32, Iterations(20000000));
+    }
+
+    DestroyWindow(hwnd);
+
+    if (jsonPath) {
+        FILE* out = strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w");
+        if (!out) {
+            fprintf(stderr, "cannot write %s\n", jsonPath);
+            return 1;
+        }
+        WriteJson(out, repeat);
+        if (out != stdout) {
+            fclose(out);
+        }
+    }
+    return 0;
+}
+
+#ifdef _WIN32
+int main(int argc, char* argv[]) {
+    std::string commandLine;
+    for (int i = 1; i < argc; ++i) {
+        commandLine += (i > 1) ? " " : "";
+        commandLine += argv[i];
+    }
+    return WinMain(GetModuleHandle(NULL), NULL, (LPSTR)commandLine.c_str(), SW_SHOW);
+}
+#endif
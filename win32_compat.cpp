@@ -1,7 +1,6 @@
 // win32_compat.cpp - Win32 API Compatibility Layer Implementation
 // This file contains the cross-platform implementation of Win32 API functions
 
-#include <unistd.h> // for usleep
 #include <stdio.h>  // for printf
 #include <iostream>
 
@@ -31,320 +30,3571 @@
     #include "win32_compat.h"
 #endif
 
-#include <map>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+    #include <sys/eventfd.h>
+    #include <sys/timerfd.h>
+#endif
+
+#include <string.h>
+#include <unordered_map>
 #include <string>
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+#include "win32_atoms.h"
+#include "win32_font.h"
+#include "win32_gdibatch.h"
+#include "win32_handles.h"
+#include "win32_hittest.h"
+#include "win32_present.h"
+#include "win32_queue.h"
+#include "win32_raster.h"
+#include "win32_region.h"
+#include "win32_replay.h"
+#include "win32_textlayout.h"
+#include "win32_threadpool.h"
+#include "win32_timers.h"
+#include "win32_trace.h"
+#include "win32_unicode.h"
 
 // Internal structures for emulation
+struct WindowClass {
+    WNDCLASSEX info;      // As registered; the name strings point at the copies below
+    ATOM atom;
+    std::string name;
+    std::string menuName;
+    HDC classDC;          // Shared DC for CS_CLASSDC classes, created on first use
+    
+    WindowClass() : info(), atom(0), classDC(nullptr) {}
+};
+
+struct ThreadQueue;
+
 struct WindowData {
     std::string title;
-    int x, y, width, height;
-    bool visible;
-    LRESULT (*wndProc)(HWND, UINT, WPARAM, LPARAM);
+    HWND handle;
+    DWORD style;       // Without WS_VISIBLE, which visible tracks
+    int x, y, width, height; // Relative to the parent's client area for child windows
+    bool visible;      // Shown; a child is only seen if its ancestors are too
+    bool needsPaint;   // Update region is non-empty
+    bool paintQueued;  // Window is linked into its thread's paintQueue
+    bool needsErase;   // An invalidation asked for the background to be erased
+    Region updateRgn;  // Invalidated area, in client coordinates
+    WNDPROC wndProc;
+    WindowClass* windowClass;
+    HDC ownDC;         // Private DC of CS_OWNDC windows
+    SwapChain* swapChain; // Client area frames of a top-level window, created on first draw
     void* platformWindow;
+    ThreadQueue* thread; // Thread that created the window and receives its messages
+    HINSTANCE instance;
+    LONG_PTR userData;   // GWLP_USERDATA
+    int extraSize;       // cbWndExtra bytes of the class, zero-initialized
+    unsigned char extraInline[4 * sizeof(LONG_PTR)]; // Holds them when they fit,
+    std::unique_ptr<unsigned char[]> extraHeap;      // so creation need not allocate
+    UINT_PTR id;         // GWLP_ID: control identifier of a child window
+    // Window tree, children topmost first. A tree belongs to the thread that
+    // created its top-level window, and only that thread walks or changes it.
+    WindowData* parent;     // NULL for top-level windows
+    WindowData* root;       // Top-level ancestor, whose surface the window draws into
+    WindowData* firstChild;
+    WindowData* lastChild;
+    WindowData* prevSibling; // Above this window
+    WindowData* nextSibling; // Below this window
+    uint64_t zStamp;        // Top-level windows: later stamps are in front
+    uint32_t layoutStamp;   // Root only: bumped whenever geometry in the tree changes
+    uint32_t visibleStamp;  // layoutStamp that visibleRgn was computed for
+    Region visibleRgn;      // Unobscured part of the client area
+    HitTestGrid childGrid;  // Children by position, for hit testing
+    bool childGridStale;
+    
+    WindowData() : handle(nullptr), style(0), x(0), y(0), width(0), height(0), visible(false), needsPaint(false),
+                   paintQueued(false), needsErase(false), wndProc(nullptr), windowClass(nullptr),
+                   ownDC(nullptr), swapChain(nullptr), platformWindow(nullptr), thread(nullptr), instance(nullptr),
+                   userData(0), extraSize(0), extraInline(), id(0), parent(nullptr), root(this), firstChild(nullptr),
+                   lastChild(nullptr), prevSibling(nullptr), nextSibling(nullptr), zStamp(0), layoutStamp(1),
+                   visibleStamp(0), childGridStale(false) {}
+    
+    ~WindowData() {
+        if (swapChain) {
+            swapChain->Close(); // Windows still open at exit
+        }
+    }
+    
+    unsigned char* extra() { return extraHeap ? extraHeap.get() : extraInline; }
+};
+
+enum DCKind {
+    kCommonDC,   // Taken from the pool by BeginPaint/GetDC, returned on release
+    kOwnDC,      // Belongs to one CS_OWNDC window for its lifetime
+    kClassDC,    // Shared by all windows of a CS_CLASSDC class
+    kMemoryDC,   // CreateCompatibleDC: draws into the selected bitmap
+};
+
+struct BitmapData {
+    SurfaceBuffer pixels;
+    bool dibSection;   // Bits are handed to the application by CreateDIBSection
+    HDC selectedInto;  // Memory DC the bitmap is selected into, if any
     
-    WindowData() : x(0), y(0), width(0), height(0), visible(false), wndProc(nullptr), platformWindow(nullptr) {}
+    BitmapData() : dibSection(false), selectedInto(nullptr) {}
 };
 
+// Logical brush. Only solid colors are supported; a hollow brush paints nothing.
+struct BrushData : InternedObject {
+    COLORREF color;
+    uint32_t pixel;
+    bool hollow;
+    
+    BrushData() : color(0), pixel(0), hollow(false) {}
+};
+
+// Logical pen. Every visible style draws solid lines.
+struct PenData : InternedObject {
+    int style;
+    int width;
+    COLORREF color;
+    uint32_t pixel;
+    
+    PenData() : style(PS_SOLID), width(1), color(0), pixel(0) {}
+};
+
+struct FontObject : InternedObject, FontData {};
+
 struct DeviceContext {
     HWND window;
+    DCKind kind;
+    int useCount;      // Outstanding BeginPaint/GetDC calls on a persistent DC
+    int heldCount;     // The GetDC calls among them, which may never be released
     void* platformContext;
+    Surface surface;   // Pixels drawn into by the GDI functions
+    POINT origin;      // Surface position of the client area's top-left corner
+    Region visibleClip; // Area the DC may draw on, in client coordinates: the
+    Region selectedClip; // visible part of the paint area, and the region
+    bool hasSelectedClip; // chosen with SelectClipRgn, if any.
+    Region clip;       // Output is limited to their intersection.
+    POINT position;    // Current position for MoveToEx/LineTo
+    GdiState state;    // Selected font, pen and brush state, and colors.
+    HBRUSH brush;      // Selected objects (and state.font); NULL stands for
+    HPEN pen;          // the stock object a new DC starts with (SYSTEM_FONT,
+                       // WHITE_BRUSH, BLACK_PEN). Each selection holds a reference.
+    HBITMAP bitmap;    // Selected bitmap of a memory DC
+    int stretchMode;
+    bool batching;     // Between BeginPaint and EndPaint: drawing calls are batched
+    GdiBatch* batch;   // Commands not yet drawn, from the thread's pool
+    uint64_t paintTraceStart; // BeginPaint time while tracing
     
-    DeviceContext(HWND w = nullptr) : window(w), platformContext(nullptr) {}
+    DeviceContext(HWND w = nullptr, DCKind k = kCommonDC)
+        : window(w), kind(k), useCount(0), heldCount(0), platformContext(nullptr), origin(), hasSelectedClip(false), position(),
+          brush(nullptr), pen(nullptr), bitmap(nullptr), stretchMode(BLACKONWHITE), batching(false),
+          batch(nullptr), paintTraceStart(0) {
+        state.font = nullptr;
+        state.penPixel = ColorRefToPixel(RGB(0, 0, 0));
+        state.penWidth = 1;
+        state.penNull = false;
+        state.brushPixel = ColorRefToPixel(RGB(255, 255, 255));
+        state.brushHollow = false;
+        state.textColor = RGB(0, 0, 0);
+        state.bkColor = RGB(255, 255, 255);
+        state.bkMode = OPAQUE;
+    }
 };
 
 // Global state for emulation
-static std::map<HWND, std::unique_ptr<WindowData>> g_windows;
-static std::map<HDC, std::unique_ptr<DeviceContext>> g_deviceContexts;
-static std::map<std::string, LRESULT (*)(HWND, UINT, WPARAM, LPARAM)> g_windowClasses;
-static uintptr_t g_nextWindowHandle = 1;
-static uintptr_t g_nextDCHandle = 1;
-static std::vector<MSG> g_messageQueue;
-static bool g_quitPosted = false;
+static HandleTable<WindowData, kHandleTypeWindow> g_windows;
+static HandleTable<DeviceContext, kHandleTypeDC> g_deviceContexts;
+static InternTable<FontObject, kHandleTypeFont> g_fonts;
+static InternTable<BrushData, kHandleTypeBrush> g_brushes;
+static InternTable<PenData, kHandleTypePen> g_pens;
+static HandleTable<BitmapData, kHandleTypeBitmap> g_bitmaps;
+static HandleTable<Region, kHandleTypeRegion> g_regions;
+// Class and registered message names share one atom table, as on Windows.
+// Classes are never unregistered, so WindowClass pointers stay valid.
+static AtomTable g_userAtoms;
+static AtomTable g_globalAtoms; // GlobalAddAtom
+static AtomTable g_localAtoms;  // AddAtom
+static std::unordered_map<ATOM, std::unique_ptr<WindowClass>> g_windowClasses;
+static SpinLock g_windowClassesLock;
+
+enum PostedKind {
+    kPostedMessage,    // PostMessage/PostThreadMessage
+    kPostedInput,      // Platform input, subject to mouse move coalescing
+    kPostedInvalidate, // InvalidateRect from another thread
+    kPostedRepaint,    // Window state changed by another thread needs WM_PAINT
+};
+
+// Entry in a thread's inbox: a message, or window work that only the owning
+// thread may do
+struct PostedMessage {
+    PostedKind kind;
+    MSG msg;
+    RECT rect;         // kPostedInvalidate area, if hasRect
+    bool hasRect;
+};
+
+// Message queue of one thread, created the first time the thread uses the
+// message API. Only the owning thread touches queue, paintQueue and the
+// quit state; other threads hand their messages over through inbox, which
+// the owner drains on every PeekMessage.
+struct ThreadQueue {
+    DWORD threadId;
+    bool platformThread;           // Runs the platform event loop (main thread)
+    MessageQueue queue;
+    RingBuffer<HWND> paintQueue;   // Windows that may need WM_PAINT, oldest first
+    bool quitPosted;
+    int quitExitCode;
+    TimerQueue timers;             // SetTimer timers of this thread
+    UINT_PTR nextTimerId;          // Ids handed out for thread timers
+    MpscQueue<PostedMessage> inbox;
+    std::atomic<bool> waiting;     // Blocked, or about to block, in WaitMessage
+    std::atomic<bool> alive;       // Cleared when the thread exits
+    std::mutex wakeLock;           // Sleep and wakeup of threads other than
+    std::condition_variable wakeCondition; // the platform thread
+    bool wakeRequested;
+    ThreadQueue* next;             // Link in g_threadQueues
+    
+    ThreadQueue() : threadId(0), platformThread(false), quitPosted(false), quitExitCode(0), nextTimerId(1),
+                    waiting(false), alive(true), wakeRequested(false), next(nullptr) {}
+};
+
+// Every queue ever created, newest first, for PostThreadMessage. Queues are
+// never freed, so the list is walked without a lock; a thread that exits
+// only marks its queue dead.
+static std::atomic<ThreadQueue*> g_threadQueues(nullptr);
+static std::atomic<DWORD> g_nextThreadId(1);
+static DWORD g_platformThreadId = 0; // Set by main() before WinMain runs
+
+// Marks the thread's queue dead when the thread exits
+struct ThreadQueueOwner {
+    ThreadQueue* queue;
+    
+    ~ThreadQueueOwner() {
+        if (queue) {
+            queue->alive.store(false, std::memory_order_release);
+        }
+    }
+};
+
+static thread_local DWORD t_threadId = 0;
+static thread_local ThreadQueue* t_threadQueue = nullptr; // Plain pointer: no TLS wrapper on access
+static thread_local ThreadQueueOwner t_threadQueueOwner = { nullptr };
 
 // Forward declarations for platform-specific helpers
 void* CreatePlatformWindow(const char* title, int x, int y, int width, int height);
 void ShowPlatformWindow(void* window);
 void DestroyPlatformWindow(void* window);
+void MovePlatformWindow(void* window, int x, int y, int width, int height);
 void* BeginPlatformPaint(void* window);
 void EndPlatformPaint(void* window, void* context);
-void DrawPlatformText(void* context, const char* text, int x, int y);
+void PresentPlatformWindow(void* window, const Surface& frame, const RECT& dirty); // On the present thread
+void DrawPlatformText(void* context, const char* text, int length, int x, int y);
+bool PlatformDrawsText(); // False where DrawPlatformText is a stub
+void SetPlatformWindowText(void* window, const char* text, int length);
 void InvalidatePlatformWindow(void* window);
 void ProcessPlatformEvents();
+void WaitPlatformEvents(int64_t timeoutNs); // Negative waits without a timeout
+void WakePlatformEvents();
+
+static uint64_t MonotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static ThreadQueue* CurrentThreadQueue() {
+    ThreadQueue* queue = t_threadQueue;
+    if (!queue) {
+        queue = new ThreadQueue();
+        queue->threadId = GetCurrentThreadId();
+        queue->platformThread = queue->threadId == g_platformThreadId;
+        ThreadQueue* head = g_threadQueues.load(std::memory_order_relaxed);
+        do {
+            queue->next = head;
+        } while (!g_threadQueues.compare_exchange_weak(head, queue, std::memory_order_release,
+                                                       std::memory_order_relaxed));
+        t_threadQueue = queue;
+        t_threadQueueOwner.queue = queue;
+    }
+    return queue;
+}
+
+// Wake a thread blocked in WaitMessage. The waiting flag keeps the common
+// case (poster and pump on the same, non-sleeping thread) free of system
+// calls.
+static void WakeThread(ThreadQueue* queue) {
+    if (!queue->waiting.exchange(false)) {
+        return;
+    }
+    if (queue->platformThread) {
+        TraceScope trace("WakePlatformEvents");
+        WakePlatformEvents();
+    } else {
+        std::lock_guard<std::mutex> lock(queue->wakeLock);
+        queue->wakeRequested = true;
+        queue->wakeCondition.notify_one();
+    }
+}
+
+// Window tree helpers. They are only called on the thread owning the tree.
+
+static std::atomic<uint64_t> g_nextZStamp(1);
+
+// Geometry, visibility or stacking in window's tree changed: cached clip
+// areas of the tree and the hit test grid of window's parent are stale
+static void LayoutChanged(WindowData* window) {
+    window->root->layoutStamp++;
+    if (window->parent) {
+        window->parent->childGridStale = true;
+    }
+}
+
+// Insert window among its parent's children below insertAfter, or at the
+// top when insertAfter is NULL
+static void LinkWindow(WindowData* window, WindowData* insertAfter) {
+    WindowData* parent = window->parent;
+    WindowData* below = insertAfter ? insertAfter->nextSibling : parent->firstChild;
+    window->prevSibling = insertAfter;
+    window->nextSibling = below;
+    (insertAfter ? insertAfter->nextSibling : parent->firstChild) = window;
+    (below ? below->prevSibling : parent->lastChild) = window;
+    LayoutChanged(window);
+}
+
+static void UnlinkWindow(WindowData* window) {
+    WindowData* parent = window->parent;
+    (window->prevSibling ? window->prevSibling->nextSibling : parent->firstChild) = window->nextSibling;
+    (window->nextSibling ? window->nextSibling->prevSibling : parent->lastChild) = window->prevSibling;
+    window->prevSibling = nullptr;
+    window->nextSibling = nullptr;
+    LayoutChanged(window);
+}
+
+// The window's rectangle in its parent's client coordinates
+static RECT RectInParent(const WindowData* window) {
+    RECT rect = { window->x, window->y, window->x + window->width, window->y + window->height };
+    return rect;
+}
+
+// Position of the window's client area within its root's
+static POINT RootOffset(const WindowData* window) {
+    POINT offset = { 0, 0 };
+    for (; window->parent; window = window->parent) {
+        offset.x += window->x;
+        offset.y += window->y;
+    }
+    return offset;
+}
+
+// Shown, along with all of its ancestors
+static bool IsShown(const WindowData* window) {
+    for (; window; window = window->parent) {
+        if (!window->visible) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The part of the window's client area that can be drawn on, in client
+// coordinates: inside every ancestor's client area, and outside the windows
+// that WS_CLIPCHILDREN and WS_CLIPSIBLINGS ask to exclude. Cached until
+// the tree's layout changes; empty for hidden and fully obscured windows.
+static const Region& VisibleRegion(WindowData* window) {
+    Region& visible = window->visibleRgn;
+    if (window->visibleStamp == window->root->layoutStamp) {
+        return visible;
+    }
+    RECT client = { 0, 0, window->width, window->height };
+    if (IsShown(window)) {
+        visible.SetRect(client);
+    } else {
+        visible.SetEmpty();
+    }
+    if (window->style & WS_CLIPCHILDREN) {
+        for (WindowData* child = window->firstChild; child && !visible.empty(); child = child->nextSibling) {
+            if (child->visible) {
+                visible.CombineWith(Region(RectInParent(child)), RGN_DIFF);
+            }
+        }
+    }
+    // (dx, dy) takes the window's client coordinates to those of w's parent
+    int dx = 0;
+    int dy = 0;
+    for (WindowData* w = window; w->parent && !visible.empty(); w = w->parent) {
+        dx += w->x;
+        dy += w->y;
+        RECT parentClient = { -dx, -dy, w->parent->width - dx, w->parent->height - dy };
+        visible.CombineWith(Region(parentClient), RGN_AND);
+        if (w->style & WS_CLIPSIBLINGS) {
+            for (WindowData* sibling = w->parent->firstChild; sibling != w; sibling = sibling->nextSibling) {
+                if (sibling->visible) {
+                    RECT above = RectInParent(sibling);
+                    OffsetRect(&above, -dx, -dy);
+                    visible.CombineWith(Region(above), RGN_DIFF);
+                }
+            }
+        }
+    }
+    window->visibleStamp = window->root->layoutStamp;
+    return visible;
+}
+
+// Children of window at a point in its client coordinates, through a grid
+// rebuilt after the children have moved
+template <typename Accept>
+static WindowData* ChildAtPoint(WindowData* window, POINT pt, Accept accept) {
+    if (window->childGridStale) {
+        window->childGridStale = false;
+        window->childGrid.Clear();
+        for (WindowData* child = window->firstChild; child; child = child->nextSibling) {
+            window->childGrid.Add(RectInParent(child), child);
+        }
+        window->childGrid.Build();
+    }
+    return (WindowData*)window->childGrid.Find(pt.x, pt.y, [&](void* child) {
+        return accept((WindowData*)child);
+    });
+}
+
+static bool ReceivesMouseInput(const WindowData* window) {
+    return window->visible && !(window->style & WS_DISABLED);
+}
+
+// The deepest visible, enabled descendant of window under pt, given in
+// window's client coordinates and returned in the result's
+static WindowData* HitTestWindow(WindowData* window, POINT* pt) {
+    RECT client = { 0, 0, window->width, window->height };
+    if (!PtInRect(&client, *pt)) {
+        return window;
+    }
+    while (WindowData* child = ChildAtPoint(window, *pt, ReceivesMouseInput)) {
+        pt->x -= child->x;
+        pt->y -= child->y;
+        window = child;
+    }
+    return window;
+}
+
+// Cursor position in screen coordinates, as of the last mouse message
+// delivered to any thread; packed so it is read and written in one piece
+static std::atomic<uint64_t> g_cursorPos(0);
+
+static POINT CursorPos() {
+    uint64_t packed = g_cursorPos.load(std::memory_order_relaxed);
+    POINT pt = { (int)(int32_t)(uint32_t)packed, (int)(int32_t)(uint32_t)(packed >> 32) };
+    return pt;
+}
+
+static void SetCursorPosition(POINT pt) {
+    g_cursorPos.store((uint64_t)(uint32_t)pt.x | ((uint64_t)(uint32_t)pt.y << 32), std::memory_order_relaxed);
+}
+
+// Fill in when a message was generated and where the cursor was
+static void StampMessage(MSG* msg, uint64_t nowNs) {
+    msg->time = (DWORD)(nowNs / 1000000);
+    msg->pt = CursorPos();
+}
+
+// Platform mouse input is posted to top-level windows; it goes to the
+// child under the cursor, in that child's client coordinates. The wheel
+// carries screen coordinates and stays with the window it was sent to.
+// Either way the message moves the cursor.
+static void DeliverInput(ThreadQueue* queue, MSG msg) {
+    if (msg.message == WM_MOUSEWHEEL || msg.message == WM_MOUSEHWHEEL) {
+        POINT pt = { GET_X_LPARAM(msg.lParam), GET_Y_LPARAM(msg.lParam) };
+        SetCursorPosition(pt);
+        msg.pt = pt;
+    } else if (msg.message >= WM_MOUSEFIRST && msg.message <= WM_MOUSELAST) {
+        WindowData* window = g_windows.Lookup(msg.hwnd);
+        if (window) {
+            POINT pt = { GET_X_LPARAM(msg.lParam), GET_Y_LPARAM(msg.lParam) };
+            POINT offset = RootOffset(window);
+            msg.pt.x = window->root->x + offset.x + pt.x;
+            msg.pt.y = window->root->y + offset.y + pt.y;
+            SetCursorPosition(msg.pt);
+            if (window->firstChild) {
+                WindowData* target = HitTestWindow(window, &pt);
+                msg.hwnd = target->handle;
+                msg.lParam = MAKELPARAM(pt.x, pt.y);
+            }
+        }
+    }
+    queue->queue.PostInput(msg);
+}
+
+static void MarkWindowForPaint(HWND hWnd, WindowData* window);
+
+static PostedMessage MakePostedMessage(PostedKind kind, HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) {
+    PostedMessage posted = {};
+    posted.kind = kind;
+    posted.msg.hwnd = hWnd;
+    posted.msg.message = message;
+    posted.msg.wParam = wParam;
+    posted.msg.lParam = lParam;
+    if (kind == kPostedMessage || kind == kPostedInput) {
+        StampMessage(&posted.msg, MonotonicNs());
+    }
+    return posted;
+}
+
+// Carry out a posted entry on the thread that owns queue
+static void DeliverMessage(ThreadQueue* queue, const PostedMessage& posted) {
+    switch (posted.kind) {
+    case kPostedMessage:
+        queue->queue.Post(posted.msg);
+        break;
+    case kPostedInput:
+        DeliverInput(queue, posted.msg);
+        break;
+    case kPostedInvalidate:
+        InvalidateRect(posted.msg.hwnd, posted.hasRect ? &posted.rect : nullptr, (BOOL)posted.msg.wParam);
+        break;
+    case kPostedRepaint: {
+        WindowData* window = g_windows.Lookup(posted.msg.hwnd);
+        if (window && window->thread == queue) {
+            MarkWindowForPaint(posted.msg.hwnd, window);
+        }
+        break;
+    }
+    }
+}
+
+static void DrainInbox(ThreadQueue* queue) {
+    PostedMessage posted;
+    while (queue->inbox.Pop(&posted)) {
+        DeliverMessage(queue, posted);
+    }
+}
+
+// Hand an entry to the thread owning target: straight into its queue when
+// that is the calling thread, through its inbox otherwise. Fails if the
+// target thread has exited.
+static bool PostToThread(ThreadQueue* target, const PostedMessage& posted) {
+    if (target == t_threadQueue) {
+        // Keep order with what other threads posted before
+        DrainInbox(target);
+        DeliverMessage(target, posted);
+    } else if (target->alive.load(std::memory_order_acquire)) {
+        target->inbox.Push(posted);
+    } else {
+        return false;
+    }
+    WakeThread(target);
+    return true;
+}
+
+// Entry point for hardware input from the platform layer. Unlike
+// PostMessage, consecutive mouse moves are coalesced.
+void PostInputMessage(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) {
+    WindowData* window = hWnd ? g_windows.Lookup(hWnd) : nullptr;
+    ThreadQueue* target = window ? window->thread : CurrentThreadQueue();
+    PostToThread(target, MakePostedMessage(kPostedInput, hWnd, message, wParam, lParam));
+}
+
+// Map a native window back to its HWND (used by platform input handlers)
+HWND FindWindowForPlatformWindow(void* platformWindow) {
+    HWND found = nullptr;
+    g_windows.ForEach([&](void* hwnd, WindowData* window) {
+        if (window->platformWindow == platformWindow) {
+            found = (HWND)hwnd;
+        }
+    });
+    return found;
+}
+
+// Mark a window as needing WM_PAINT. The message itself is synthesized by
+// PeekMessage once nothing else is queued, so repeated invalidation costs
+// one repaint.
+static void MarkWindowForPaint(HWND hWnd, WindowData* window) {
+    ThreadQueue* owner = window->thread;
+    if (owner != t_threadQueue) {
+        PostToThread(owner, MakePostedMessage(kPostedRepaint, hWnd, 0, 0, 0));
+        return;
+    }
+    window->needsPaint = true;
+    if (!window->paintQueued) {
+        window->paintQueued = true;
+        owner->paintQueue.push_back(hWnd);
+    }
+    WakeThread(owner);
+}
+
+static bool MatchesMessageFilter(UINT message, UINT wMsgFilterMin, UINT wMsgFilterMax) {
+    return (wMsgFilterMin == 0 && wMsgFilterMax == 0) ||
+           (message >= wMsgFilterMin && message <= wMsgFilterMax);
+}
+
+// Window filter of PeekMessage/GetMessage applied to a timer, with the same
+// meaning of NULL and -1 as for posted messages
+static bool TimerMatchesFilter(const TimerQueue::Timer& timer, HWND hWndFilter) {
+    if (hWndFilter == nullptr) {
+        return true;
+    }
+    if (hWndFilter == (HWND)-1) {
+        return timer.hwnd == nullptr;
+    }
+    return timer.hwnd == hWndFilter;
+}
+
+// Find a visible window with a pending update for PeekMessage. Stale entries
+// (validated, hidden or destroyed windows) are dropped from the front; a
+// window that is painted but not validated rotates to the back so it cannot
+// starve the others.
+static HWND NextWindowToPaint(ThreadQueue* queue, HWND hWndFilter, bool remove) {
+    if (hWndFilter == (HWND)-1) {
+        return nullptr;
+    }
+    if (hWndFilter) {
+        WindowData* window = g_windows.Lookup(hWndFilter);
+        if (window && window->thread == queue && window->needsPaint && IsShown(window)) {
+            return hWndFilter;
+        }
+        return nullptr;
+    }
+    RingBuffer<HWND>& paintQueue = queue->paintQueue;
+    while (!paintQueue.empty()) {
+        HWND hwnd = paintQueue.front();
+        WindowData* window = g_windows.Lookup(hwnd);
+        if (!window) {
+            paintQueue.pop_front();
+            continue;
+        }
+        if (!window->needsPaint || !IsShown(window)) {
+            paintQueue.pop_front();
+            window->paintQueued = false;
+            continue;
+        }
+        if (VisibleRegion(window).empty()) {
+            // Covered since it was invalidated: nothing of it can be seen
+            window->updateRgn.SetEmpty();
+            window->needsPaint = false;
+            window->needsErase = false;
+            paintQueue.pop_front();
+            window->paintQueued = false;
+            continue;
+        }
+        if (remove) {
+            paintQueue.pop_front();
+            paintQueue.push_back(hwnd);
+        }
+        // Parents paint first, since their children draw over them
+        for (WindowData* ancestor = window->parent; ancestor; ancestor = ancestor->parent) {
+            if (ancestor->needsPaint && !VisibleRegion(ancestor).empty()) {
+                hwnd = ancestor->handle;
+            }
+        }
+        return hwnd;
+    }
+    return nullptr;
+}
+
+// Recompute the clip after one of its parts changed
+static void UpdateClip(DeviceContext* dc) {
+    if (dc->hasSelectedClip) {
+        dc->clip.Combine(dc->visibleClip, dc->selectedClip, RGN_AND);
+    } else {
+        dc->clip = dc->visibleClip;
+    }
+}
+
+// Position a window DC on the window's part of the surface and limit it to
+// area (client coordinates) within the window's unobscured part
+static void SetWindowClip(DeviceContext* dc, WindowData* window, const Region& area) {
+    dc->origin = RootOffset(window);
+    RECT bounds = dc->surface.Bounds();
+    OffsetRect(&bounds, -dc->origin.x, -dc->origin.y);
+    dc->visibleClip.Combine(VisibleRegion(window), area, RGN_AND);
+    dc->visibleClip.CombineWith(Region(bounds), RGN_AND);
+    UpdateClip(dc);
+}
+
+// Visit the parts of area (in client coordinates) inside the DC's clip, as
+// rectangles in surface coordinates
+template <typename Visit>
+static void ForEachClipRect(const DeviceContext* dc, const RECT& area, Visit visit) {
+    dc->clip.ForEachRect(area, [&](RECT part) {
+        OffsetRect(&part, dc->origin.x, dc->origin.y);
+        visit(part);
+    });
+}
+
+static bool ClipContains(const DeviceContext* dc, int x, int y) {
+    return dc->clip.Contains(x, y);
+}
+
+static void FlushBatch(HDC hdc, DeviceContext* dc);
+
+// Start a frame for the DC to draw into: the back buffer of the top-level
+// window's swap chain, sized to its client area (child windows draw into
+// their top-level window's pixels)
+static void BeginDCFrame(DeviceContext* dc, WindowData* window) {
+    WindowData* root = window->root;
+    TraceScope trace("BeginPlatformPaint");
+    dc->platformContext = BeginPlatformPaint(root->platformWindow);
+    if (!root->swapChain) {
+        root->swapChain = SwapChain::Create(root->platformWindow, root->title.c_str());
+    }
+    dc->surface = root->swapChain->BeginFrame(root->width, root->height);
+}
+
+// End the DC's frame; the chain hands it to the present thread once no other
+// DC is drawing into it
+static void EndDCFrame(DeviceContext* dc) {
+    dc->batching = false;
+    WindowData* window = g_windows.Lookup(dc->window);
+    {
+        TraceScope trace("EndPlatformPaint");
+        EndPlatformPaint(window ? window->root->platformWindow : nullptr, dc->platformContext);
+    }
+    dc->platformContext = nullptr;
+    if (window && window->root->swapChain) {
+        window->root->swapChain->EndFrame();
+    }
+    // The buffer now belongs to the present thread
+    dc->surface = Surface();
+}
+
+// Mark the area the DC may draw on as changed in the frame
+static void AddDCDamage(DeviceContext* dc, WindowData* window) {
+    RECT frame = dc->visibleClip.bounds();
+    OffsetRect(&frame, dc->origin.x, dc->origin.y);
+    window->root->swapChain->AddDamage(frame);
+}
+
+// Hand out the DC for drawing into a window. CS_OWNDC windows keep a single
+// DC for their lifetime and CS_CLASSDC windows share their class's DC, so
+// selected objects survive between paints; all other windows draw through
+// common DCs recycled by the handle table. Either way the paint path does
+// not allocate once the table has warmed up.
+static HDC AcquireWindowDC(HWND hWnd, WindowData* window, const Region& clip) {
+    DeviceContext* dc = nullptr;
+    HDC hdc = nullptr;
+    if (window->ownDC) {
+        hdc = window->ownDC;
+        dc = g_deviceContexts.Lookup(hdc);
+    } else if (window->windowClass && (window->windowClass->info.style & CS_CLASSDC)) {
+        WindowClass* windowClass = window->windowClass;
+        if (!windowClass->classDC) {
+            windowClass->classDC = (HDC)g_deviceContexts.Allocate(nullptr, hWnd, kClassDC);
+        }
+        hdc = windowClass->classDC;
+        dc = g_deviceContexts.Lookup(hdc);
+    } else {
+        hdc = (HDC)g_deviceContexts.Allocate(&dc, hWnd, kCommonDC);
+    }
+    if (!dc) {
+        return nullptr;
+    }
+    
+    // Commands already batched draw with the clip and surface they were recorded for
+    FlushBatch(hdc, dc);
+    if (dc->window != hWnd && dc->useCount > 0) {
+        // A class DC moving to another window ends the previous window's use
+        EndDCFrame(dc);
+        dc->useCount = 0;
+        dc->heldCount = 0;
+    }
+    dc->window = hWnd;
+    if (dc->useCount++ == 0) {
+        BeginDCFrame(dc, window);
+    }
+    SetWindowClip(dc, window, clip);
+    AddDCDamage(dc, window);
+    return hdc;
+}
+
+// Drop the references a DC holds on its selected objects before it is freed
+static void ReleaseSelectedObjects(DeviceContext* dc) {
+    g_fonts.Release(dc->state.font);
+    g_brushes.Release(dc->brush);
+    g_pens.Release(dc->pen);
+    dc->state.font = nullptr;
+    dc->brush = nullptr;
+    dc->pen = nullptr;
+}
+
+// Release a BeginPaint, GetDC or internal use of a window DC. A persistent
+// DC's frame ends once no paint is using it, even while GetDC handles remain:
+// applications keep a CS_OWNDC window's DC for their lifetime and ReleaseDC
+// on it is optional, so waiting for them would never hand a frame over.
+static void ReleaseWindowDC(HDC hdc, DeviceContext* dc, bool getDC = false) {
+    FlushBatch(hdc, dc);
+    bool released = false;
+    if (getDC) {
+        // A GetDC from a frame that has already ended has nothing left to release
+        if (dc->heldCount > 0) {
+            --dc->heldCount;
+            --dc->useCount;
+            released = true;
+        }
+    } else if (dc->useCount > 0) {
+        --dc->useCount;
+        released = true;
+    }
+    if (released && dc->useCount == dc->heldCount) {
+        EndDCFrame(dc);
+        dc->useCount = 0;
+        dc->heldCount = 0;
+    }
+    if (dc->kind == kCommonDC) {
+        ReleaseSelectedObjects(dc);
+        g_deviceContexts.Free(hdc);
+    }
+}
+
+// End the frame of a persistent DC whose window is being destroyed while a
+// paint or GetDC is outstanding, so its top-level window keeps presenting
+static void EndAbandonedFrame(HDC hdc, DeviceContext* dc) {
+    FlushBatch(hdc, dc);
+    if (dc->useCount > 0) {
+        EndDCFrame(dc);
+        dc->useCount = 0;
+        dc->heldCount = 0;
+    }
+}
+
+// Whether the DC has pixels to draw on. Drawing through a persistent DC's
+// handle after its frame has ended starts the next frame, which the next
+// EndPaint or ReleaseDC hands over.
+static bool DrawingSurface(DeviceContext* dc) {
+    if (!dc->surface.pixels && dc->useCount == 0 && (dc->kind == kOwnDC || dc->kind == kClassDC)) {
+        WindowData* window = g_windows.Lookup(dc->window);
+        if (window) {
+            dc->useCount = 1;
+            dc->heldCount = 1;
+            BeginDCFrame(dc, window);
+            RECT client = { 0, 0, window->width, window->height };
+            SetWindowClip(dc, window, Region(client));
+            AddDCDamage(dc, window);
+        }
+    }
+    return dc->surface.pixels != nullptr;
+}
 
 // Win32 API implementations
+
+// Rectangle functions
+BOOL SetRect(RECT* lprc, int xLeft, int yTop, int xRight, int yBottom) {
+    if (!lprc) {
+        return FALSE;
+    }
+    lprc->left = xLeft;
+    lprc->top = yTop;
+    lprc->right = xRight;
+    lprc->bottom = yBottom;
+    return TRUE;
+}
+
+BOOL SetRectEmpty(RECT* lprc) {
+    return SetRect(lprc, 0, 0, 0, 0);
+}
+
+BOOL CopyRect(RECT* lprcDst, const RECT* lprcSrc) {
+    if (!lprcDst || !lprcSrc) {
+        return FALSE;
+    }
+    *lprcDst = *lprcSrc;
+    return TRUE;
+}
+
+BOOL IsRectEmpty(const RECT* lprc) {
+    return !lprc || lprc->right <= lprc->left || lprc->bottom <= lprc->top;
+}
+
+BOOL EqualRect(const RECT* lprc1, const RECT* lprc2) {
+    return lprc1 && lprc2 &&
+           lprc1->left == lprc2->left && lprc1->top == lprc2->top &&
+           lprc1->right == lprc2->right && lprc1->bottom == lprc2->bottom;
+}
+
+BOOL PtInRect(const RECT* lprc, POINT pt) {
+    return lprc && pt.x >= lprc->left && pt.x < lprc->right && pt.y >= lprc->top && pt.y < lprc->bottom;
+}
+
+BOOL OffsetRect(RECT* lprc, int dx, int dy) {
+    if (!lprc) {
+        return FALSE;
+    }
+    lprc->left += dx;
+    lprc->right += dx;
+    lprc->top += dy;
+    lprc->bottom += dy;
+    return TRUE;
+}
+
+BOOL InflateRect(RECT* lprc, int dx, int dy) {
+    if (!lprc) {
+        return FALSE;
+    }
+    lprc->left -= dx;
+    lprc->right += dx;
+    lprc->top -= dy;
+    lprc->bottom += dy;
+    return TRUE;
+}
+
+BOOL IntersectRect(RECT* lprcDst, const RECT* lprcSrc1, const RECT* lprcSrc2) {
+    if (!lprcDst || !lprcSrc1 || !lprcSrc2) {
+        return FALSE;
+    }
+    RECT r;
+    r.left = lprcSrc1->left > lprcSrc2->left ? lprcSrc1->left : lprcSrc2->left;
+    r.top = lprcSrc1->top > lprcSrc2->top ? lprcSrc1->top : lprcSrc2->top;
+    r.right = lprcSrc1->right < lprcSrc2->right ? lprcSrc1->right : lprcSrc2->right;
+    r.bottom = lprcSrc1->bottom < lprcSrc2->bottom ? lprcSrc1->bottom : lprcSrc2->bottom;
+    if (IsRectEmpty(&r)) {
+        SetRectEmpty(lprcDst);
+        return FALSE;
+    }
+    *lprcDst = r;
+    return TRUE;
+}
+
+BOOL UnionRect(RECT* lprcDst, const RECT* lprcSrc1, const RECT* lprcSrc2) {
+    if (!lprcDst || !lprcSrc1 || !lprcSrc2) {
+        return FALSE;
+    }
+    if (IsRectEmpty(lprcSrc1)) {
+        *lprcDst = *lprcSrc2;
+    } else if (IsRectEmpty(lprcSrc2)) {
+        *lprcDst = *lprcSrc1;
+    } else {
+        RECT r;
+        r.left = lprcSrc1->left < lprcSrc2->left ? lprcSrc1->left : lprcSrc2->left;
+        r.top = lprcSrc1->top < lprcSrc2->top ? lprcSrc1->top : lprcSrc2->top;
+        r.right = lprcSrc1->right > lprcSrc2->right ? lprcSrc1->right : lprcSrc2->right;
+        r.bottom = lprcSrc1->bottom > lprcSrc2->bottom ? lprcSrc1->bottom : lprcSrc2->bottom;
+        *lprcDst = r;
+    }
+    if (IsRectEmpty(lprcDst)) {
+        SetRectEmpty(lprcDst);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Like Windows, only shrinks the source when the subtracted rectangle spans
+// it completely in one direction; otherwise the result is the source itself.
+BOOL SubtractRect(RECT* lprcDst, const RECT* lprcSrc1, const RECT* lprcSrc2) {
+    if (!lprcDst || !lprcSrc1 || !lprcSrc2) {
+        return FALSE;
+    }
+    RECT r = *lprcSrc1;
+    RECT overlap;
+    if (IntersectRect(&overlap, lprcSrc1, lprcSrc2)) {
+        if (overlap.left == r.left && overlap.right == r.right) {
+            if (overlap.top == r.top) {
+                r.top = overlap.bottom;
+            } else if (overlap.bottom == r.bottom) {
+                r.bottom = overlap.top;
+            }
+        } else if (overlap.top == r.top && overlap.bottom == r.bottom) {
+            if (overlap.left == r.left) {
+                r.left = overlap.right;
+            } else if (overlap.right == r.right) {
+                r.right = overlap.left;
+            }
+        }
+    }
+    if (IsRectEmpty(&r)) {
+        SetRectEmpty(lprcDst);
+        return FALSE;
+    }
+    *lprcDst = r;
+    return TRUE;
+}
+
+// Resolve a class name or MAKEINTATOM value without allocating
+static WindowClass* FindWindowClass(LPCSTR lpClassName) {
+    if (!lpClassName) {
+        return nullptr;
+    }
+    ATOM atom = IS_INTRESOURCE(lpClassName) ? (ATOM)(uintptr_t)lpClassName : g_userAtoms.Find(lpClassName);
+    if (!atom) {
+        return nullptr;
+    }
+    std::lock_guard<SpinLock> lock(g_windowClassesLock);
+    auto it = g_windowClasses.find(atom);
+    return it != g_windowClasses.end() ? it->second.get() : nullptr;
+}
+
 HWND CreateWindowEx(DWORD dwExStyle, LPCSTR lpClassName, LPCSTR lpWindowName,
                    DWORD dwStyle, int X, int Y, int nWidth, int nHeight,
                    HWND hWndParent, void* hMenu, HINSTANCE hInstance, LPVOID lpParam) {
     
     // Silence unused parameter warnings
-    (void)dwExStyle; (void)dwStyle; (void)hWndParent; (void)hMenu; (void)hInstance; (void)lpParam;
+    (void)dwExStyle; (void)lpParam;
+    
+    // Child windows join their parent's tree, which only the parent's
+    // thread may touch
+    WindowData* parent = nullptr;
+    if (dwStyle & WS_CHILD) {
+        parent = g_windows.Lookup(hWndParent);
+        if (!parent || parent->thread != CurrentThreadQueue()) {
+            return nullptr;
+        }
+    }
     
-    HWND hwnd = (HWND)g_nextWindowHandle++;
-    auto windowData = std::make_unique<WindowData>();
+    WindowData* windowData;
+    HWND hwnd = (HWND)g_windows.Allocate(&windowData);
+    if (!hwnd) {
+        return nullptr;
+    }
     windowData->title = lpWindowName ? lpWindowName : "";
+    windowData->handle = hwnd;
+    windowData->style = dwStyle & ~(DWORD)WS_VISIBLE;
     windowData->x = X;
     windowData->y = Y;
     windowData->width = nWidth;
     windowData->height = nHeight;
+    windowData->thread = CurrentThreadQueue();
+    
+    windowData->instance = hInstance;
+    if (parent) {
+        // Below its existing siblings, so creation order is z-order
+        windowData->id = (UINT_PTR)hMenu;
+        windowData->parent = parent;
+        windowData->root = parent->root;
+        LinkWindow(windowData, parent->lastChild);
+    }
     
     // Find window procedure
-    auto classIt = g_windowClasses.find(lpClassName);
-    if (classIt != g_windowClasses.end()) {
-        windowData->wndProc = classIt->second;
+    WindowClass* windowClass = FindWindowClass(lpClassName);
+    if (windowClass) {
+        windowData->windowClass = windowClass;
+        windowData->wndProc = windowClass->info.lpfnWndProc;
+        int extraSize = windowClass->info.cbWndExtra;
+        if (extraSize > (int)sizeof(windowData->extraInline)) {
+            windowData->extraHeap.reset(new unsigned char[extraSize]());
+        }
+        windowData->extraSize = extraSize;
+        if (windowClass->info.style & CS_OWNDC) {
+            windowData->ownDC = (HDC)g_deviceContexts.Allocate(nullptr, hwnd, kOwnDC);
+        }
     }
     
-    // Create platform-specific window
-    windowData->platformWindow = CreatePlatformWindow(windowData->title.c_str(), X, Y, nWidth, nHeight);
+    // Create platform-specific window; child windows live inside their root's
+    if (!parent) {
+        TraceScope trace("CreatePlatformWindow");
+        windowData->platformWindow = CreatePlatformWindow(windowData->title.c_str(), X, Y, nWidth, nHeight);
+    }
     
-    g_windows[hwnd] = std::move(windowData);
+    if (dwStyle & WS_VISIBLE) {
+        ShowWindow(hwnd, SW_SHOW);
+    }
     return hwnd;
 }
 
-BOOL ShowWindow(HWND hWnd, int nCmdShow) {
-    auto it = g_windows.find(hWnd);
-    if (it != g_windows.end()) {
-        it->second->visible = (nCmdShow != 0);
-        if (it->second->visible) {
-            ShowPlatformWindow(it->second->platformWindow);
-        }
+HWND CreateWindowExW(DWORD dwExStyle, LPCWSTR lpClassName, LPCWSTR lpWindowName,
+                     DWORD dwStyle, int X, int Y, int nWidth, int nHeight,
+                     HWND hWndParent, void* hMenu, HINSTANCE hInstance, LPVOID lpParam) {
+    // Class atoms pass through; names are looked up as UTF-8
+    LPCSTR className = (LPCSTR)lpClassName;
+    if (lpClassName && !IS_INTRESOURCE(lpClassName)) {
+        className = Utf16ToUtf8Scratch(lpClassName, -1, kScratchClassName, nullptr);
+    }
+    LPCSTR windowName = lpWindowName ? Utf16ToUtf8Scratch(lpWindowName, -1, kScratchText, nullptr) : nullptr;
+    return CreateWindowEx(dwExStyle, className, windowName, dwStyle, X, Y, nWidth, nHeight,
+                          hWndParent, hMenu, hInstance, lpParam);
+}
+
+static void InvalidateWindowTree(WindowData* window, const Region* area, BOOL bErase, bool children);
+
+// Show or hide a window and repaint what that reveals
+static void SetWindowVisible(WindowData* window, bool visible, bool redraw) {
+    if (window->visible == visible) {
+        return;
+    }
+    window->visible = visible;
+    LayoutChanged(window);
+    if (!window->parent && visible) {
+        window->zStamp = g_nextZStamp.fetch_add(1);
+    }
+    if (!redraw) {
+        return;
+    }
+    if (visible) {
+        InvalidateWindowTree(window, nullptr, TRUE, true);
+    } else if (window->parent) {
+        Region area(RectInParent(window));
+        InvalidateWindowTree(window->parent, &area, TRUE, true);
+    }
+}
+
+BOOL ShowWindow(HWND hWnd, int nCmdShow) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (window) {
+        bool visible = (nCmdShow != 0);
+        if (visible && !window->parent) {
+            TraceScope trace("ShowPlatformWindow");
+            ShowPlatformWindow(window->platformWindow);
+        }
+        SetWindowVisible(window, visible, true);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+BOOL UpdateWindow(HWND hWnd) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window) {
+        return FALSE;
+    }
+    // Paint synchronously if there is anything to update, bypassing the queue
+    if (window->needsPaint && window->visible) {
+        SendMessage(hWnd, WM_PAINT, 0, 0);
+    }
+    return TRUE;
+}
+
+BOOL DestroyWindow(HWND hWnd) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (window) {
+        // Children go first, then the window leaves its parent's tree
+        while (window->lastChild) {
+            DestroyWindow(window->lastChild->handle);
+        }
+        if (window->parent) {
+            WindowData* parent = window->parent;
+            Region area(RectInParent(window));
+            bool visible = window->visible;
+            UnlinkWindow(window);
+            if (visible) {
+                InvalidateWindowTree(parent, &area, TRUE, true);
+            }
+        }
+        if (window->ownDC) {
+            DeviceContext* dc = g_deviceContexts.Lookup(window->ownDC);
+            if (dc) {
+                EndAbandonedFrame(window->ownDC, dc);
+                ReleaseSelectedObjects(dc);
+            }
+            g_deviceContexts.Free(window->ownDC);
+        } else if (window->windowClass && window->windowClass->classDC) {
+            DeviceContext* dc = g_deviceContexts.Lookup(window->windowClass->classDC);
+            if (dc && dc->window == hWnd) {
+                EndAbandonedFrame(window->windowClass->classDC, dc);
+            }
+        }
+        if (window->swapChain) {
+            window->swapChain->Close();
+            window->swapChain = nullptr;
+        }
+        if (!window->parent) {
+            TraceScope trace("DestroyPlatformWindow");
+            DestroyPlatformWindow(window->platformWindow);
+        }
+        g_windows.Free(hWnd);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+BOOL InvalidateRect(HWND hWnd, const RECT* lpRect, BOOL bErase) {
+    if (!hWnd) {
+        // NULL invalidates every window, as on Windows
+        g_windows.ForEach([&](void* hwnd, WindowData*) {
+            InvalidateRect((HWND)hwnd, lpRect, bErase);
+        });
+        return TRUE;
+    }
+    
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (window && window->thread != t_threadQueue) {
+        // The update region belongs to the window's thread
+        PostedMessage posted = MakePostedMessage(kPostedInvalidate, hWnd, 0, (WPARAM)bErase, 0);
+        if (lpRect) {
+            posted.rect = *lpRect;
+            posted.hasRect = true;
+        }
+        return PostToThread(window->thread, posted) ? TRUE : FALSE;
+    }
+    if (window) {
+        // As on Windows, children are invalidated along with a parent that
+        // draws over them
+        Region area;
+        if (lpRect) {
+            area.SetRect(*lpRect);
+        }
+        InvalidateWindowTree(window, lpRect ? &area : nullptr, bErase, !(window->style & WS_CLIPCHILDREN));
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// Add an area (client coordinates, NULL for all) to the window's update
+// region, limited to the part that can be seen, and optionally to those of
+// its descendants beneath it. Fully obscured windows are left alone.
+static void InvalidateWindowTree(WindowData* window, const Region* area, BOOL bErase, bool children) {
+    Region clipped;
+    const Region* visible = &VisibleRegion(window);
+    if (area) {
+        clipped.Combine(*visible, *area, RGN_AND);
+        visible = &clipped;
+    }
+    if (!visible->empty()) {
+        window->updateRgn.CombineWith(*visible, RGN_OR);
+        if (bErase) {
+            window->needsErase = true;
+        }
+        {
+            TraceScope trace("InvalidatePlatformWindow");
+            InvalidatePlatformWindow(window->root->platformWindow);
+        }
+        MarkWindowForPaint(window->handle, window);
+    }
+    if (children) {
+        for (WindowData* child = window->firstChild; child; child = child->nextSibling) {
+            if (!child->visible) {
+                continue;
+            }
+            if (area) {
+                Region childArea = *area;
+                childArea.Offset(-child->x, -child->y);
+                InvalidateWindowTree(child, &childArea, bErase, true);
+            } else {
+                InvalidateWindowTree(child, nullptr, bErase, true);
+            }
+        }
+    }
+}
+
+BOOL InvalidateRgn(HWND hWnd, HRGN hRgn, BOOL bErase) {
+    if (!hRgn) {
+        return InvalidateRect(hWnd, nullptr, bErase);
+    }
+    WindowData* window = g_windows.Lookup(hWnd);
+    Region* region = g_regions.Lookup(hRgn);
+    if (!window || !region) {
+        return FALSE;
+    }
+    if (window->thread != t_threadQueue) {
+        // The region may be gone by the time the owner runs, so another
+        // thread invalidates its bounding box
+        return InvalidateRect(hWnd, &region->bounds(), bErase);
+    }
+    InvalidateWindowTree(window, region, bErase, !(window->style & WS_CLIPCHILDREN));
+    return TRUE;
+}
+
+BOOL ValidateRect(HWND hWnd, const RECT* lpRect) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window) {
+        return FALSE;
+    }
+    if (lpRect) {
+        window->updateRgn.CombineWith(Region(*lpRect), RGN_DIFF);
+    } else {
+        window->updateRgn.SetEmpty();
+    }
+    if (window->updateRgn.empty()) {
+        window->needsPaint = false;
+        window->needsErase = false;
+    }
+    return TRUE;
+}
+
+BOOL GetUpdateRect(HWND hWnd, RECT* lpRect, BOOL bErase) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window) {
+        return FALSE;
+    }
+    if (lpRect) {
+        *lpRect = window->updateRgn.bounds();
+    }
+    if (bErase && window->needsErase && window->needsPaint) {
+        // Erase now, clipped to the update area as BeginPaint would
+        window->needsErase = false;
+        HDC hdc = AcquireWindowDC(hWnd, window, window->updateRgn);
+        if (hdc) {
+            SendMessage(hWnd, WM_ERASEBKGND, (WPARAM)hdc, 0);
+            ReleaseWindowDC(hdc, g_deviceContexts.Lookup(hdc));
+        }
+    }
+    return window->needsPaint ? TRUE : FALSE;
+}
+
+BOOL GetClientRect(HWND hWnd, RECT* lpRect) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (window && lpRect) {
+        lpRect->left = 0;
+        lpRect->top = 0;
+        lpRect->right = window->width;
+        lpRect->bottom = window->height;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// Windows have no frame, so the window rectangle is the client area placed
+// on the screen
+BOOL GetWindowRect(HWND hWnd, RECT* lpRect) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window || !lpRect) {
+        return FALSE;
+    }
+    POINT origin = { 0, 0 };
+    ClientToScreen(hWnd, &origin);
+    SetRect(lpRect, origin.x, origin.y, origin.x + window->width, origin.y + window->height);
+    return TRUE;
+}
+
+BOOL ClientToScreen(HWND hWnd, POINT* lpPoint) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window || !lpPoint) {
+        return FALSE;
+    }
+    POINT offset = RootOffset(window);
+    lpPoint->x += window->root->x + offset.x;
+    lpPoint->y += window->root->y + offset.y;
+    return TRUE;
+}
+
+BOOL ScreenToClient(HWND hWnd, POINT* lpPoint) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window || !lpPoint) {
+        return FALSE;
+    }
+    POINT offset = RootOffset(window);
+    lpPoint->x -= window->root->x + offset.x;
+    lpPoint->y -= window->root->y + offset.y;
+    return TRUE;
+}
+
+HWND GetParent(HWND hWnd) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    return (window && window->parent) ? window->parent->handle : nullptr;
+}
+
+// Walks the sibling lists of child windows; top-level windows have none
+HWND GetWindow(HWND hWnd, UINT uCmd) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window) {
+        return nullptr;
+    }
+    WindowData* found = nullptr;
+    switch (uCmd) {
+    case GW_HWNDFIRST:
+        found = window->parent ? window->parent->firstChild : window;
+        break;
+    case GW_HWNDLAST:
+        found = window->parent ? window->parent->lastChild : window;
+        break;
+    case GW_HWNDNEXT:
+        found = window->nextSibling;
+        break;
+    case GW_HWNDPREV:
+        found = window->prevSibling;
+        break;
+    case GW_CHILD:
+        found = window->firstChild;
+        break;
+    }
+    return found ? found->handle : nullptr;
+}
+
+BOOL IsWindowVisible(HWND hWnd) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    return (window && IsShown(window)) ? TRUE : FALSE;
+}
+
+BOOL SetWindowPos(HWND hWnd, HWND hWndInsertAfter, int X, int Y, int cx, int cy, UINT uFlags) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window) {
+        return FALSE;
+    }
+    
+    // Resolve the new place in the stack first, so a bad sibling changes
+    // nothing. There is no topmost band: HWND_TOPMOST and HWND_NOTOPMOST
+    // act as HWND_TOP. Top-level windows only move to the front or back.
+    WindowData* parent = window->parent;
+    bool restack = false;
+    WindowData* insertAfter = nullptr;
+    if (!(uFlags & SWP_NOZORDER)) {
+        bool top = hWndInsertAfter == HWND_TOP || hWndInsertAfter == HWND_TOPMOST ||
+                   hWndInsertAfter == HWND_NOTOPMOST;
+        if (!parent) {
+            restack = top || hWndInsertAfter == HWND_BOTTOM;
+        } else {
+            if (hWndInsertAfter == HWND_BOTTOM) {
+                insertAfter = parent->lastChild;
+            } else if (!top) {
+                insertAfter = g_windows.Lookup(hWndInsertAfter);
+                if (!insertAfter || insertAfter->parent != parent) {
+                    return FALSE;
+                }
+            }
+            if (insertAfter == window) {
+                insertAfter = window->prevSibling; // Already in place
+            }
+            restack = window->prevSibling != insertAfter;
+        }
+    }
+    if (cx < 0) cx = 0;
+    if (cy < 0) cy = 0;
+    bool moved = !(uFlags & SWP_NOMOVE) && (X != window->x || Y != window->y);
+    bool sized = !(uFlags & SWP_NOSIZE) && (cx != window->width || cy != window->height);
+    bool redraw = !(uFlags & SWP_NOREDRAW);
+    
+    // Hiding repaints what the window covered where it was
+    bool wasVisible = window->visible;
+    if (uFlags & SWP_HIDEWINDOW) {
+        SetWindowVisible(window, false, redraw);
+    }
+    RECT oldRect = RectInParent(window);
+    if (restack) {
+        if (parent) {
+            UnlinkWindow(window);
+            LinkWindow(window, insertAfter);
+        } else {
+            window->zStamp = (hWndInsertAfter == HWND_BOTTOM) ? 0 : g_nextZStamp.fetch_add(1);
+        }
+    }
+    if (moved) {
+        window->x = X;
+        window->y = Y;
+    }
+    if (sized) {
+        window->width = cx;
+        window->height = cy;
+    }
+    if (moved || sized) {
+        LayoutChanged(window);
+        if (!parent) {
+            TraceScope trace("MovePlatformWindow");
+            MovePlatformWindow(window->platformWindow, window->x, window->y, window->width, window->height);
+        }
+    }
+    
+    // Repaint the area the window left in its parent, then the window, where
+    // a new size, position or place in the stack can uncover new parts. A
+    // top-level window that only moved keeps its pixels.
+    if (redraw && wasVisible && window->visible && (moved || sized || restack)) {
+        if (parent && (moved || sized)) {
+            Region area(oldRect);
+            InvalidateWindowTree(parent, &area, TRUE, true);
+        }
+        if (parent || sized) {
+            InvalidateWindowTree(window, nullptr, TRUE, true);
+        }
+    }
+    if (uFlags & SWP_SHOWWINDOW) {
+        if (!parent) {
+            TraceScope trace("ShowPlatformWindow");
+            ShowPlatformWindow(window->platformWindow);
+        }
+        SetWindowVisible(window, true, redraw);
+    }
+    
+    if (moved) {
+        SendMessage(hWnd, WM_MOVE, 0, MAKELPARAM(window->x, window->y));
+    }
+    if (sized) {
+        SendMessage(hWnd, WM_SIZE, SIZE_RESTORED, MAKELPARAM(window->width, window->height));
+    }
+    return TRUE;
+}
+
+BOOL MoveWindow(HWND hWnd, int X, int Y, int nWidth, int nHeight, BOOL bRepaint) {
+    return SetWindowPos(hWnd, nullptr, X, Y, nWidth, nHeight,
+                        SWP_NOZORDER | SWP_NOACTIVATE | (bRepaint ? 0 : SWP_NOREDRAW));
+}
+
+// The frontmost visible top-level window containing the point, then its
+// deepest visible and enabled descendant there
+HWND WindowFromPoint(POINT Point) {
+    WindowData* found = nullptr;
+    g_windows.ForEach([&](void*, WindowData* window) {
+        RECT rect = RectInParent(window);
+        if (!window->parent && window->visible && PtInRect(&rect, Point) &&
+            (!found || window->zStamp > found->zStamp)) {
+            found = window;
+        }
+    });
+    if (!found) {
+        return nullptr;
+    }
+    POINT pt = { Point.x - found->x, Point.y - found->y };
+    return HitTestWindow(found, &pt)->handle;
+}
+
+HWND ChildWindowFromPoint(HWND hWndParent, POINT Point) {
+    return ChildWindowFromPointEx(hWndParent, Point, CWP_ALL);
+}
+
+HWND ChildWindowFromPointEx(HWND hwnd, POINT pt, UINT flags) {
+    WindowData* window = g_windows.Lookup(hwnd);
+    RECT client = { 0, 0, window ? window->width : 0, window ? window->height : 0 };
+    if (!window || !PtInRect(&client, pt)) {
+        return nullptr;
+    }
+    WindowData* child = ChildAtPoint(window, pt, [flags](WindowData* candidate) {
+        return !((flags & CWP_SKIPINVISIBLE) && !candidate->visible) &&
+               !((flags & CWP_SKIPDISABLED) && (candidate->style & WS_DISABLED));
+    });
+    return child ? child->handle : hwnd;
+}
+
+static BOOL SetWindowTextUtf8(HWND hWnd, const char* text, int length) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window) {
+        return FALSE;
+    }
+    window->title.assign(text, length); // Keeps the string's storage
+    if (!window->parent) {
+        SetPlatformWindowText(window->platformWindow, text, length);
+    }
+    return TRUE;
+}
+
+BOOL SetWindowText(HWND hWnd, LPCSTR lpString) {
+    return SetWindowTextUtf8(hWnd, lpString ? lpString : "", lpString ? (int)strlen(lpString) : 0);
+}
+
+BOOL SetWindowTextW(HWND hWnd, LPCWSTR lpString) {
+    int length = 0;
+    const char* text = lpString ? Utf16ToUtf8Scratch(lpString, -1, kScratchText, &length) : "";
+    return SetWindowTextUtf8(hWnd, text, length);
+}
+
+// Copies at most nMaxCount - 1 bytes, never splitting a character, and
+// returns the length copied
+int GetWindowText(HWND hWnd, LPSTR lpString, int nMaxCount) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!lpString || nMaxCount <= 0) {
+        return 0;
+    }
+    size_t length = 0;
+    if (window) {
+        length = std::min(window->title.size(), (size_t)nMaxCount - 1);
+        if (length < window->title.size()) {
+            while (length > 0 && (window->title[length] & 0xC0) == 0x80) {
+                --length;
+            }
+        }
+        memcpy(lpString, window->title.data(), length);
+    }
+    lpString[length] = '\0';
+    return (int)length;
+}
+
+int GetWindowTextW(HWND hWnd, LPWSTR lpString, int nMaxCount) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!lpString || nMaxCount <= 0) {
+        return 0;
+    }
+    size_t length = 0;
+    if (window) {
+        // UTF-16 never needs more code units than UTF-8 has bytes, so a
+        // buffer that large is converted into directly
+        const std::string& title = window->title;
+        if (title.size() < (size_t)nMaxCount) {
+            length = Utf8ToUtf16(title.data(), title.size(), lpString);
+        } else {
+            const WCHAR* text = Utf8ToUtf16Scratch(title.data(), title.size(), kScratchText, &length);
+            if (length >= (size_t)nMaxCount) {
+                length = nMaxCount - 1;
+                if (length > 0 && text[length - 1] >= 0xD800 && text[length - 1] <= 0xDBFF) {
+                    --length; // Keep surrogate pairs whole
+                }
+            }
+            memcpy(lpString, text, length * sizeof(WCHAR));
+        }
+    }
+    lpString[length] = 0;
+    return (int)length;
+}
+
+HINSTANCE GetModuleHandle(LPCSTR lpModuleName) {
+    (void)lpModuleName; // Silence unused parameter warning
+    return (HINSTANCE)1; // Dummy handle
+}
+
+void* LoadCursor(HINSTANCE hInstance, LPCSTR lpCursorName) {
+    (void)hInstance; (void)lpCursorName; // Silence unused parameter warnings
+    return (void*)1; // Dummy cursor
+}
+
+ATOM RegisterClassEx(const WNDCLASSEX* lpWndClass) {
+    if (!lpWndClass || !lpWndClass->lpszClassName || lpWndClass->cbWndExtra < 0 || lpWndClass->cbClsExtra < 0) {
+        return 0;
+    }
+    ATOM atom = g_userAtoms.Add(lpWndClass->lpszClassName);
+    if (!atom) {
+        return 0;
+    }
+    std::unique_ptr<WindowClass> windowClass(new WindowClass());
+    windowClass->info = *lpWndClass;
+    windowClass->info.cbSize = sizeof(WNDCLASSEX);
+    windowClass->atom = atom;
+    if (!IS_INTRESOURCE(lpWndClass->lpszClassName)) {
+        windowClass->name = lpWndClass->lpszClassName;
+        windowClass->info.lpszClassName = windowClass->name.c_str();
+    }
+    if (lpWndClass->lpszMenuName && !IS_INTRESOURCE(lpWndClass->lpszMenuName)) {
+        windowClass->menuName = lpWndClass->lpszMenuName;
+        windowClass->info.lpszMenuName = windowClass->menuName.c_str();
+    }
+    std::lock_guard<SpinLock> lock(g_windowClassesLock);
+    std::unique_ptr<WindowClass>& slot = g_windowClasses[atom];
+    if (slot) {
+        return 0; // Already registered, as ERROR_CLASS_ALREADY_EXISTS on Windows
+    }
+    slot = std::move(windowClass);
+    return atom;
+}
+
+BOOL GetClassInfoEx(HINSTANCE hInstance, LPCSTR lpszClass, WNDCLASSEX* lpwcx) {
+    WindowClass* windowClass = FindWindowClass(lpszClass);
+    if (!windowClass || !lpwcx) {
+        return FALSE;
+    }
+    *lpwcx = windowClass->info;
+    return TRUE;
+}
+
+int GetClassName(HWND hWnd, LPSTR lpClassName, int nMaxCount) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window || !window->windowClass) {
+        return 0;
+    }
+    return (int)g_userAtoms.GetName(window->windowClass->atom, lpClassName, nMaxCount);
+}
+
+UINT RegisterWindowMessage(LPCSTR lpString) {
+    // Only string atoms, which lie in the 0xC000-0xFFFF message range
+    if (!lpString || IS_INTRESOURCE(lpString) || lpString[0] == '#') {
+        return 0;
+    }
+    return g_userAtoms.Add(lpString);
+}
+
+LONG_PTR GetWindowLongPtr(HWND hWnd, int nIndex) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window) {
+        return 0;
+    }
+    switch (nIndex) {
+    case GWLP_WNDPROC:
+        return (LONG_PTR)window->wndProc;
+    case GWLP_HINSTANCE:
+        return (LONG_PTR)window->instance;
+    case GWLP_USERDATA:
+        return window->userData;
+    case GWLP_ID:
+        return (LONG_PTR)window->id;
+    case GWL_STYLE:
+        return (LONG_PTR)(window->style | (window->visible ? WS_VISIBLE : 0));
+    }
+    if (nIndex < 0 || nIndex + (int)sizeof(LONG_PTR) > window->extraSize) {
+        return 0;
+    }
+    LONG_PTR value;
+    memcpy(&value, window->extra() + nIndex, sizeof(value));
+    return value;
+}
+
+LONG_PTR SetWindowLongPtr(HWND hWnd, int nIndex, LONG_PTR dwNewLong) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window) {
+        return 0;
+    }
+    LONG_PTR previous;
+    switch (nIndex) {
+    case GWLP_WNDPROC:
+        previous = (LONG_PTR)window->wndProc;
+        window->wndProc = (WNDPROC)dwNewLong;
+        return previous;
+    case GWLP_HINSTANCE:
+        previous = (LONG_PTR)window->instance;
+        window->instance = (HINSTANCE)dwNewLong;
+        return previous;
+    case GWLP_USERDATA:
+        previous = window->userData;
+        window->userData = dwNewLong;
+        return previous;
+    case GWLP_ID:
+        previous = (LONG_PTR)window->id;
+        window->id = (UINT_PTR)dwNewLong;
+        return previous;
+    case GWL_STYLE:
+        // Like on Windows, nothing is redrawn; WS_CHILD cannot change since
+        // the window would have to leave or join a tree
+        previous = (LONG_PTR)(window->style | (window->visible ? WS_VISIBLE : 0));
+        window->style = ((DWORD)dwNewLong & ~(DWORD)(WS_VISIBLE | WS_CHILD)) | (window->style & WS_CHILD);
+        window->visible = (dwNewLong & WS_VISIBLE) != 0;
+        LayoutChanged(window);
+        return previous;
+    }
+    if (nIndex < 0 || nIndex + (int)sizeof(LONG_PTR) > window->extraSize) {
+        return 0;
+    }
+    memcpy(&previous, window->extra() + nIndex, sizeof(previous));
+    memcpy(window->extra() + nIndex, &dwNewLong, sizeof(dwNewLong));
+    return previous;
+}
+
+ATOM GlobalAddAtom(LPCSTR lpString) {
+    return lpString ? g_globalAtoms.Add(lpString) : 0;
+}
+
+ATOM GlobalFindAtom(LPCSTR lpString) {
+    return lpString ? g_globalAtoms.Find(lpString) : 0;
+}
+
+ATOM GlobalDeleteAtom(ATOM nAtom) {
+    // Returns 0 on success, the atom otherwise
+    return g_globalAtoms.Delete(nAtom) ? 0 : nAtom;
+}
+
+UINT GlobalGetAtomName(ATOM nAtom, LPSTR lpBuffer, int nSize) {
+    return g_globalAtoms.GetName(nAtom, lpBuffer, nSize);
+}
+
+ATOM AddAtom(LPCSTR lpString) {
+    return lpString ? g_localAtoms.Add(lpString) : 0;
+}
+
+ATOM FindAtom(LPCSTR lpString) {
+    return lpString ? g_localAtoms.Find(lpString) : 0;
+}
+
+ATOM DeleteAtom(ATOM nAtom) {
+    return g_localAtoms.Delete(nAtom) ? 0 : nAtom;
+}
+
+UINT GetAtomName(ATOM nAtom, LPSTR lpBuffer, int nSize) {
+    return g_localAtoms.GetName(nAtom, lpBuffer, nSize);
+}
+
+static void WaitForMessages(HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax);
+
+BOOL GetMessage(MSG* lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax) {
+    TraceScope trace("GetMessage");
+    for (;;) {
+        if (PeekMessage(lpMsg, hWnd, wMsgFilterMin, wMsgFilterMax, PM_REMOVE)) {
+            return lpMsg->message != WM_QUIT;
+        }
+        WaitForMessages(hWnd, wMsgFilterMin, wMsgFilterMax);
+    }
+}
+
+// Hand the recorded input that is due to the queues, as the platform
+// layer would; an idle thread takes one message. Returns whether anything
+// was fed.
+static bool FeedReplay(bool idle) {
+    MSG msg;
+    bool fed = false;
+    while (!(idle && fed) && NextReplayMessage(MonotonicNs(), idle, &msg)) {
+        if (msg.message == WM_QUIT) {
+            PostQuitMessage((int)msg.wParam);
+        } else if (msg.hwnd && g_windows.Lookup(msg.hwnd)) {
+            PostInputMessage(msg.hwnd, msg.message, msg.wParam, msg.lParam);
+        }
+        fed = true;
+    }
+    return fed;
+}
+
+// The next message for PeekMessage, in priority order
+static bool NextMessage(ThreadQueue* queue, MSG* lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax,
+                        UINT wRemoveMsg) {
+    if (queue->queue.Peek(lpMsg, hWnd, wMsgFilterMin, wMsgFilterMax, (wRemoveMsg & PM_REMOVE) != 0)) {
+        return true;
+    }
+    
+    // WM_QUIT is only delivered once the queue has drained, as on Windows.
+    // Like GetMessage there, it ignores the window and range filters.
+    if (queue->quitPosted) {
+        MSG msg = {};
+        msg.message = WM_QUIT;
+        msg.wParam = (WPARAM)queue->quitExitCode;
+        StampMessage(&msg, MonotonicNs());
+        *lpMsg = msg;
+        if (wRemoveMsg & PM_REMOVE) {
+            queue->quitPosted = false;
+        }
+        return true;
+    }
+    
+    // WM_PAINT has the lowest priority and stays pending until the window
+    // is validated by BeginPaint
+    if (MatchesMessageFilter(WM_PAINT, wMsgFilterMin, wMsgFilterMax)) {
+        HWND paintWnd = NextWindowToPaint(queue, hWnd, (wRemoveMsg & PM_REMOVE) != 0);
+        if (paintWnd) {
+            MSG msg = {};
+            msg.hwnd = paintWnd;
+            msg.message = WM_PAINT;
+            StampMessage(&msg, MonotonicNs());
+            *lpMsg = msg;
+            return true;
+        }
+    }
+    
+    // WM_TIMER comes last and is generated on demand from the timer heap
+    if (!queue->timers.empty() && MatchesMessageFilter(WM_TIMER, wMsgFilterMin, wMsgFilterMax)) {
+        uint64_t now = MonotonicNs();
+        auto matches = [hWnd](const TimerQueue::Timer& timer) { return TimerMatchesFilter(timer, hWnd); };
+        size_t slot;
+        while ((slot = queue->timers.FindExpired(now, matches)) != TimerQueue::kNone) {
+            const TimerQueue::Timer& timer = queue->timers[slot];
+            if (timer.hwnd && !g_windows.Lookup(timer.hwnd)) {
+                // Timers die with their window
+                queue->timers.Remove(slot);
+                continue;
+            }
+            MSG msg = {};
+            msg.hwnd = timer.hwnd;
+            msg.message = WM_TIMER;
+            msg.wParam = (WPARAM)timer.id;
+            msg.lParam = (LPARAM)timer.proc;
+            StampMessage(&msg, now);
+            *lpMsg = msg;
+            if (wRemoveMsg & PM_REMOVE) {
+                queue->timers.Rearm(slot, now);
+            }
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+BOOL PeekMessage(MSG* lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg) {
+    if (!lpMsg) {
+        return FALSE;
+    }
+    ThreadQueue* queue = CurrentThreadQueue();
+    
+    // Process platform-specific events, and recorded input that is due
+    if (queue->platformThread) {
+        TraceScope trace("ProcessPlatformEvents");
+        ProcessPlatformEvents();
+        if (ReplayEnabled()) {
+            FeedReplay(false);
+        }
+    }
+    DrainInbox(queue);
+    
+    bool found = NextMessage(queue, lpMsg, hWnd, wMsgFilterMin, wMsgFilterMax, wRemoveMsg);
+    // A fast replay feeds the next input once an unfiltered peek finds
+    // everything the previous one caused handled, painting included
+    bool unfiltered = !hWnd && wMsgFilterMin == 0 && wMsgFilterMax == 0;
+    while (!found && unfiltered && queue->platformThread && ReplayEnabled() && FeedReplay(true)) {
+        found = NextMessage(queue, lpMsg, hWnd, wMsgFilterMin, wMsgFilterMax, wRemoveMsg);
+    }
+    if (!found) {
+        return FALSE;
+    }
+    if ((wRemoveMsg & PM_REMOVE) && RecordEnabled()) {
+        RecordMessage(*lpMsg);
+    }
+    return TRUE;
+}
+
+// Block until something arrives or the next timer a GetMessage with this
+// filter would return is due. Timers the filter excludes do not end the
+// wait, so a filtered loop does not spin on another window's timer.
+static void WaitForMessages(HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax) {
+    ThreadQueue* queue = CurrentThreadQueue();
+    uint64_t deadline = TimerQueue::kNoDeadline;
+    if (MatchesMessageFilter(WM_TIMER, wMsgFilterMin, wMsgFilterMax)) {
+        deadline = queue->timers.NextDeadline(
+            [hWnd](const TimerQueue::Timer& timer) { return TimerMatchesFilter(timer, hWnd); });
+    }
+    if (queue->platformThread && ReplayEnabled()) {
+        uint64_t replayDeadline = NextReplayDeadline();
+        deadline = replayDeadline < deadline ? replayDeadline : deadline;
+    }
+    // Publish the waiting state before the final queue check so a concurrent
+    // poster either sees the flag and wakes us, or we see its message.
+    queue->waiting.store(true);
+    uint64_t now = deadline != TimerQueue::kNoDeadline ? MonotonicNs() : 0;
+    if (!queue->queue.empty() || !queue->inbox.empty() || queue->quitPosted ||
+        NextWindowToPaint(queue, nullptr, false) || deadline <= now) {
+        queue->waiting.store(false);
+        return;
+    }
+    int64_t timeoutNs = deadline != TimerQueue::kNoDeadline ? (int64_t)(deadline - now) : -1;
+    if (queue->platformThread) {
+        TraceScope trace("WaitPlatformEvents");
+        WaitPlatformEvents(timeoutNs);
+    } else {
+        TraceScope trace("WaitThreadWakeup");
+        std::unique_lock<std::mutex> lock(queue->wakeLock);
+        auto woken = [queue] { return queue->wakeRequested; };
+        if (timeoutNs < 0) {
+            queue->wakeCondition.wait(lock, woken);
+        } else {
+            queue->wakeCondition.wait_for(lock, std::chrono::nanoseconds(timeoutNs), woken);
+        }
+        queue->wakeRequested = false;
+    }
+    queue->waiting.store(false);
+}
+
+BOOL WaitMessage(void) {
+    WaitForMessages(nullptr, 0, 0);
+    return TRUE;
+}
+
+BOOL PostMessage(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam) {
+    ThreadQueue* target;
+    if (hWnd) {
+        WindowData* window = g_windows.Lookup(hWnd);
+        if (!window) {
+            return FALSE;
+        }
+        target = window->thread;
+    } else {
+        target = CurrentThreadQueue();
+    }
+    return PostToThread(target, MakePostedMessage(kPostedMessage, hWnd, Msg, wParam, lParam)) ? TRUE : FALSE;
+}
+
+BOOL PostThreadMessage(DWORD idThread, UINT Msg, WPARAM wParam, LPARAM lParam) {
+    // As on Windows, this fails until the thread has created its queue
+    for (ThreadQueue* queue = g_threadQueues.load(std::memory_order_acquire); queue; queue = queue->next) {
+        if (queue->threadId == idThread) {
+            return PostToThread(queue, MakePostedMessage(kPostedMessage, nullptr, Msg, wParam, lParam)) ? TRUE : FALSE;
+        }
+    }
+    return FALSE;
+}
+
+DWORD GetWindowThreadProcessId(HWND hWnd, LPDWORD lpdwProcessId) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window) {
+        return 0;
+    }
+    if (lpdwProcessId) {
+        *lpdwProcessId = GetCurrentProcessId();
+    }
+    return window->thread->threadId;
+}
+
+DWORD GetCurrentThreadId(void) {
+    // Small sequential ids, assigned on first use
+    if (!t_threadId) {
+        t_threadId = g_nextThreadId.fetch_add(1, std::memory_order_relaxed);
+    }
+    return t_threadId;
+}
+
+DWORD GetCurrentProcessId(void) {
+    return (DWORD)getpid();
+}
+
+LRESULT SendMessage(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (window && window->wndProc) {
+        return window->wndProc(hWnd, Msg, wParam, lParam);
+    }
+    return 0;
+}
+
+BOOL TranslateMessage(const MSG* lpMsg) {
+    (void)lpMsg; // Silence unused parameter warning
+    return TRUE; // No-op for now
+}
+
+LRESULT DispatchMessage(const MSG* lpMsg) {
+    if (lpMsg && lpMsg->message == WM_TIMER && lpMsg->lParam) {
+        // Only call procedures of live timers, so a forged WM_TIMER cannot
+        // jump to an arbitrary address
+        ThreadQueue* queue = CurrentThreadQueue();
+        size_t slot = queue->timers.Find(lpMsg->hwnd, (UINT_PTR)lpMsg->wParam);
+        if (slot != TimerQueue::kNone && (LPARAM)queue->timers[slot].proc == lpMsg->lParam) {
+            TraceScope trace("DispatchMessage", "message", lpMsg->message);
+            queue->timers[slot].proc(lpMsg->hwnd, WM_TIMER, (UINT_PTR)lpMsg->wParam, GetTickCount());
+        }
+        return 0;
+    }
+    if (lpMsg && lpMsg->hwnd) {
+        TraceScope trace("DispatchMessage", "message", lpMsg->message);
+        WindowData* window = g_windows.Lookup(lpMsg->hwnd);
+        if (window && window->wndProc) {
+            return window->wndProc(lpMsg->hwnd, lpMsg->message, lpMsg->wParam, lpMsg->lParam);
+        }
+    }
+    return 0;
+}
+
+UINT_PTR SetTimer(HWND hWnd, UINT_PTR nIDEvent, UINT uElapse, TIMERPROC lpTimerFunc) {
+    ThreadQueue* queue = CurrentThreadQueue();
+    if (hWnd) {
+        // Like Windows, only the window's own thread may set its timers
+        WindowData* window = g_windows.Lookup(hWnd);
+        if (!window || window->thread != queue) {
+            return 0;
+        }
+    } else if (queue->timers.Find(nullptr, nIDEvent) == TimerQueue::kNone) {
+        // Thread timers get a fresh id unless an existing one is reset
+        do {
+            nIDEvent = queue->nextTimerId++;
+        } while (nIDEvent == 0 || queue->timers.Find(nullptr, nIDEvent) != TimerQueue::kNone);
+    }
+    if (uElapse < USER_TIMER_MINIMUM) {
+        uElapse = USER_TIMER_MINIMUM;
+    } else if (uElapse > USER_TIMER_MAXIMUM) {
+        uElapse = USER_TIMER_MAXIMUM;
+    }
+    queue->timers.Set(hWnd, nIDEvent, lpTimerFunc, (uint64_t)uElapse * 1000000ull, MonotonicNs());
+    // A pump blocked in another wait must pick up the earlier deadline
+    WakeThread(queue);
+    return hWnd ? (nIDEvent ? nIDEvent : 1) : nIDEvent;
+}
+
+BOOL KillTimer(HWND hWnd, UINT_PTR uIDEvent) {
+    return CurrentThreadQueue()->timers.Kill(hWnd, uIDEvent) ? TRUE : FALSE;
+}
+
+BOOL GetCursorPos(POINT* lpPoint) {
+    if (!lpPoint) {
+        return FALSE;
+    }
+    *lpPoint = CursorPos();
+    return TRUE;
+}
+
+DWORD GetTickCount(void) {
+    return (DWORD)(MonotonicNs() / 1000000);
+}
+
+void PostQuitMessage(int nExitCode) {
+    ThreadQueue* queue = CurrentThreadQueue();
+    queue->quitPosted = true;
+    queue->quitExitCode = nExitCode;
+    WakeThread(queue);
+}
+
+HDC BeginPaint(HWND hWnd, PAINTSTRUCT* lpPaint) {
+    TraceScope trace("BeginPaint");
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (window) {
+        // BeginPaint validates the window: the DC takes over the accumulated
+        // update region as its clip
+        RECT paintRect = window->updateRgn.bounds();
+        bool erase = window->needsErase;
+        HDC hdc = AcquireWindowDC(hWnd, window, window->updateRgn);
+        window->updateRgn.SetEmpty();
+        window->needsPaint = false;
+        window->needsErase = false;
+        if (!hdc) {
+            return nullptr;
+        }
+        g_deviceContexts.Lookup(hdc)->batching = true;
+        
+        if (erase) {
+            // fErase tells the application the background still needs erasing
+            erase = SendMessage(hWnd, WM_ERASEBKGND, (WPARAM)hdc, 0) == 0;
+        }
+        
+        if (lpPaint) {
+            lpPaint->hdc = hdc;
+            lpPaint->fErase = erase ? TRUE : FALSE;
+            lpPaint->rcPaint = paintRect;
+        }
+        if (TraceEnabled()) {
+            // The Paint event spans the application's drawing until EndPaint
+            g_deviceContexts.Lookup(hdc)->paintTraceStart = TraceNow();
+        }
+        
+        return hdc;
+    }
+    return nullptr;
+}
+
+BOOL EndPaint(HWND hWnd, const PAINTSTRUCT* lpPaint) {
+    TraceScope trace("EndPaint");
+    if (lpPaint && lpPaint->hdc) {
+        DeviceContext* dc = g_deviceContexts.Lookup(lpPaint->hdc);
+        if (dc && dc->window == hWnd) {
+            if (dc->paintTraceStart) {
+                TraceComplete("Paint", dc->paintTraceStart, TraceNow());
+                dc->paintTraceStart = 0;
+            }
+            ReleaseWindowDC(lpPaint->hdc, dc);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+HDC GetDC(HWND hWnd) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window) {
+        return nullptr;
+    }
+    RECT client = { 0, 0, window->width, window->height };
+    HDC hdc = AcquireWindowDC(hWnd, window, Region(client));
+    if (hdc) {
+        ++g_deviceContexts.Lookup(hdc)->heldCount;
+    }
+    return hdc;
+}
+
+int ReleaseDC(HWND hWnd, HDC hDC) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hDC);
+    if (!dc || dc->window != hWnd || dc->kind == kMemoryDC) {
+        return 0;
+    }
+    ReleaseWindowDC(hDC, dc, true);
+    return 1;
+}
+
+// System color table (Windows 10 defaults)
+static const COLORREF g_sysColors[] = {
+    RGB(200, 200, 200), RGB(0, 0, 0),       RGB(153, 180, 209), RGB(191, 205, 219),
+    RGB(240, 240, 240), RGB(255, 255, 255), RGB(100, 100, 100), RGB(0, 0, 0),
+    RGB(0, 0, 0),       RGB(0, 0, 0),       RGB(180, 180, 180), RGB(244, 247, 252),
+    RGB(171, 171, 171), RGB(0, 120, 215),   RGB(255, 255, 255), RGB(240, 240, 240),
+    RGB(160, 160, 160), RGB(109, 109, 109), RGB(0, 0, 0),       RGB(0, 0, 0),
+    RGB(255, 255, 255), RGB(105, 105, 105), RGB(227, 227, 227), RGB(0, 0, 0),
+    RGB(255, 255, 225), RGB(0, 0, 0),       RGB(0, 102, 204),   RGB(185, 209, 234),
+    RGB(215, 228, 242), RGB(0, 120, 215),   RGB(240, 240, 240),
+};
+static const int g_sysColorCount = (int)(sizeof(g_sysColors) / sizeof(g_sysColors[0]));
+
+DWORD GetSysColor(int nIndex) {
+    return (nIndex >= 0 && nIndex < g_sysColorCount) ? g_sysColors[nIndex] : 0;
+}
+
+static void InitBrush(BrushData* brush, COLORREF color, bool hollow) {
+    brush->color = color & 0x00FFFFFF;
+    brush->pixel = ColorRefToPixel(brush->color);
+    brush->hollow = hollow;
+}
+
+static void InitPen(PenData* pen, int style, int width, COLORREF color) {
+    pen->style = style;
+    pen->width = width;
+    pen->color = color & 0x00FFFFFF;
+    pen->pixel = ColorRefToPixel(pen->color);
+}
+
+static HBRUSH CreateStockBrush(COLORREF color, bool hollow) {
+    return (HBRUSH)g_brushes.CreateStock([&](BrushData* brush) { InitBrush(brush, color, hollow); });
+}
+
+static HPEN CreateStockPen(int style, COLORREF color) {
+    return (HPEN)g_pens.CreateStock([&](PenData* pen) { InitPen(pen, style, 1, color); });
+}
+
+static HFONT CreateStockFont() {
+    // Every stock font is the built-in font at the system font size
+    return (HFONT)g_fonts.CreateStock([](FontObject* font) {
+        InitFontData(font, 0, 0, FW_NORMAL, false, false, false);
+    });
+}
+
+// Stock objects and system color brushes, all created together on first
+// use. The function-local static makes that safe when several UI threads
+// ask at once.
+struct StockObjects {
+    HGDIOBJ objects[STOCK_LAST + 1];
+    HBRUSH sysColorBrushes[g_sysColorCount];
+
+    StockObjects() {
+        for (int i = 0; i <= STOCK_LAST; ++i) {
+            objects[i] = nullptr;
+        }
+        objects[WHITE_BRUSH] = CreateStockBrush(RGB(255, 255, 255), false);
+        objects[LTGRAY_BRUSH] = CreateStockBrush(RGB(192, 192, 192), false);
+        objects[GRAY_BRUSH] = CreateStockBrush(RGB(128, 128, 128), false);
+        objects[DKGRAY_BRUSH] = CreateStockBrush(RGB(64, 64, 64), false);
+        objects[BLACK_BRUSH] = CreateStockBrush(RGB(0, 0, 0), false);
+        objects[NULL_BRUSH] = CreateStockBrush(RGB(0, 0, 0), true);
+        objects[WHITE_PEN] = CreateStockPen(PS_SOLID, RGB(255, 255, 255));
+        objects[BLACK_PEN] = CreateStockPen(PS_SOLID, RGB(0, 0, 0));
+        objects[NULL_PEN] = CreateStockPen(PS_NULL, RGB(0, 0, 0));
+        // Every stock font is a separate handle; palettes and DC_BRUSH/DC_PEN
+        // are not supported
+        const int fonts[] = { OEM_FIXED_FONT, ANSI_FIXED_FONT, ANSI_VAR_FONT, SYSTEM_FONT,
+                              DEVICE_DEFAULT_FONT, SYSTEM_FIXED_FONT, DEFAULT_GUI_FONT };
+        for (int font : fonts) {
+            objects[font] = CreateStockFont();
+        }
+        for (int i = 0; i < g_sysColorCount; ++i) {
+            sysColorBrushes[i] = CreateStockBrush(g_sysColors[i], false);
+        }
+    }
+};
+
+static const StockObjects& Stock() {
+    static const StockObjects stock;
+    return stock;
+}
+
+HGDIOBJ GetStockObject(int i) {
+    if (i < 0 || i > STOCK_LAST) {
+        return nullptr;
+    }
+    return Stock().objects[i];
+}
+
+HBRUSH GetSysColorBrush(int nIndex) {
+    if (nIndex < 0 || nIndex >= g_sysColorCount) {
+        return nullptr;
+    }
+    return Stock().sysColorBrushes[nIndex];
+}
+
+HBRUSH CreateSolidBrush(COLORREF color) {
+    color &= 0x00FFFFFF;
+    return (HBRUSH)g_brushes.Intern(color, [&](BrushData* brush) { InitBrush(brush, color, false); });
+}
+
+HPEN CreatePen(int iStyle, int cWidth, COLORREF color) {
+    if (iStyle < PS_SOLID || iStyle > PS_INSIDEFRAME) {
+        return nullptr;
+    }
+    // A null pen draws nothing, so its width and color do not matter
+    int width = (cWidth < 1 || iStyle == PS_NULL) ? 1 : cWidth;
+    color = (iStyle == PS_NULL) ? 0 : (color & 0x00FFFFFF);
+    uint64_t key = (uint64_t)color | ((uint64_t)(uint32_t)width << 24) | ((uint64_t)iStyle << 56);
+    return (HPEN)g_pens.Intern(key, [&](PenData* pen) { InitPen(pen, iStyle, width, color); });
+}
+
+// Resolve a brush handle to the pixel it paints with. Hollow brushes
+// resolve but leave *pixel unset and *hollow true.
+static bool ResolveBrushPixel(HBRUSH hBrush, uint32_t* pixel, bool* hollow) {
+    uintptr_t value = (uintptr_t)hBrush;
+    *hollow = false;
+    if (value >= 1 && value <= (uintptr_t)g_sysColorCount) {
+        // (HBRUSH)(COLOR_x + 1), as used for hbrBackground
+        *pixel = ColorRefToPixel(g_sysColors[value - 1]);
+        return true;
+    }
+    BrushData* brush = g_brushes.Lookup(hBrush);
+    if (!brush) {
+        return false;
+    }
+    *pixel = brush->pixel;
+    *hollow = brush->hollow;
+    return true;
+}
+
+// ==============================================================================
+// GDI BATCHING
+// ==============================================================================
+
+static const DWORD kDefaultBatchLimit = 256;
+
+static thread_local DWORD t_batchLimit = kDefaultBatchLimit;
+static thread_local DWORD t_batchedCalls = 0;                        // Calls in this thread's batches
+static thread_local std::vector<HDC> t_pendingBatches;               // DCs holding a batch
+static thread_local std::vector<std::unique_ptr<GdiBatch>> t_freeBatches;
+
+static bool Batching(const DeviceContext* dc) {
+    return dc->batching && t_batchLimit > 1;
+}
+
+// Record the parts of the DC's state a command reads that differ from the
+// state at the end of the batch
+static void RecordState(GdiBatch& batch, const GdiState& state, int parts) {
+    GdiState& recorded = batch.recorded();
+    if (parts & kGdiStateText) {
+        if (state.font != recorded.font) {
+            g_fonts.AddRef(state.font); // Released once the batch has run
+            batch.Append(MV32_GDI_SET_FONT).font = state.font;
+            recorded.font = state.font;
+        }
+        if (state.textColor != recorded.textColor) {
+            batch.Append(MV32_GDI_SET_TEXT_COLOR).value = state.textColor;
+            recorded.textColor = state.textColor;
+        }
+        if (state.bkColor != recorded.bkColor) {
+            batch.Append(MV32_GDI_SET_BK_COLOR).value = state.bkColor;
+            recorded.bkColor = state.bkColor;
+        }
+        if (state.bkMode != recorded.bkMode) {
+            batch.Append(MV32_GDI_SET_BK_MODE).value = state.bkMode;
+            recorded.bkMode = state.bkMode;
+        }
+    }
+    if ((parts & kGdiStatePen) && (state.penPixel != recorded.penPixel || state.penWidth != recorded.penWidth ||
+                                   state.penNull != recorded.penNull)) {
+        GdiCommand& command = batch.Append(MV32_GDI_SET_PEN);
+        command.value = state.penPixel;
+        command.rect.left = state.penWidth;
+        command.length = state.penNull ? 1 : 0;
+        recorded.penPixel = state.penPixel;
+        recorded.penWidth = state.penWidth;
+        recorded.penNull = state.penNull;
+    }
+    if ((parts & kGdiStateBrush) &&
+        (state.brushPixel != recorded.brushPixel || state.brushHollow != recorded.brushHollow)) {
+        GdiCommand& command = batch.Append(MV32_GDI_SET_BRUSH);
+        command.value = state.brushPixel;
+        command.length = state.brushHollow ? 1 : 0;
+        recorded.brushPixel = state.brushPixel;
+        recorded.brushHollow = state.brushHollow;
+    }
+}
+
+// Append a drawing command to a batching DC, after the state it reads.
+// A thread that has reached its batch limit flushes first.
+static GdiCommand& RecordCommand(HDC hdc, DeviceContext* dc, uint32_t op, int parts) {
+    if (t_batchedCalls >= t_batchLimit) {
+        GdiFlush();
+    }
+    GdiBatch* batch = dc->batch;
+    if (!batch) {
+        if (!t_freeBatches.empty()) {
+            batch = t_freeBatches.back().release();
+            t_freeBatches.pop_back();
+        } else {
+            batch = new GdiBatch();
+        }
+        g_fonts.AddRef(dc->state.font);
+        batch->Begin(dc->state);
+        dc->batch = batch;
+        t_pendingBatches.push_back(hdc);
+    }
+    RecordState(*batch, dc->state, parts);
+    batch->CountCall();
+    ++t_batchedCalls;
+    return batch->Append(op);
+}
+
+// Fill a rectangle given in DC coordinates, clipped to the DC
+static void FillDCRect(DeviceContext* dc, const RECT& rect, uint32_t pixel) {
+    if (DrawingSurface(dc)) {
+        ForEachClipRect(dc, rect, [&](const RECT& part) { FillRectPixels(dc->surface, part, pixel); });
+    }
+}
+
+// Interior with the brush, then the outline with the pen, both excluding
+// the right and bottom edges as on Windows. Wide outlines are drawn inside
+// the rectangle, like PS_INSIDEFRAME.
+static void DrawRectangle(DeviceContext* dc, int left, int top, int right, int bottom) {
+    int edge = dc->state.penNull ? 0 : dc->state.penWidth;
+    int limit = ((right - left) < (bottom - top) ? (right - left) : (bottom - top)) / 2;
+    if (edge > limit) {
+        edge = limit;
+    }
+    if (!dc->state.brushHollow) {
+        RECT interior = { left + edge, top + edge, right - edge, bottom - edge };
+        FillDCRect(dc, interior, dc->state.brushPixel);
+    }
+    if (edge > 0) {
+        RECT edges[4] = {
+            { left, top, right, top + edge },
+            { left, bottom - edge, right, bottom },
+            { left, top + edge, left + edge, bottom - edge },
+            { right - edge, top + edge, right, bottom - edge },
+        };
+        for (const RECT& r : edges) {
+            FillDCRect(dc, r, dc->state.penPixel);
+        }
+    }
+}
+
+BOOL Rectangle(HDC hdc, int left, int top, int right, int bottom) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc) {
+        return FALSE;
+    }
+    if (right < left) { int t = left; left = right; right = t; }
+    if (bottom < top) { int t = top; top = bottom; bottom = t; }
+    if (right - left < 2 || bottom - top < 2) {
+        return TRUE;
+    }
+    if (Batching(dc)) {
+        RECT& rect = RecordCommand(hdc, dc, MV32_GDI_RECTANGLE, kGdiStatePen | kGdiStateBrush).rect;
+        SetRect(&rect, left, top, right, bottom);
+    } else {
+        DrawRectangle(dc, left, top, right, bottom);
+    }
+    return TRUE;
+}
+
+BOOL FillRect(HDC hdc, const RECT* lpRect, HBRUSH hBrush) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    uint32_t pixel;
+    bool hollow;
+    if (!dc || !lpRect || !ResolveBrushPixel(hBrush, &pixel, &hollow)) {
+        return FALSE;
+    }
+    if (hollow) {
+        return TRUE;
+    }
+    if (Batching(dc)) {
+        GdiCommand& command = RecordCommand(hdc, dc, MV32_GDI_FILL_RECT, 0);
+        command.rect = *lpRect;
+        command.value = pixel;
+    } else {
+        FillDCRect(dc, *lpRect, pixel);
+    }
+    return TRUE;
+}
+
+// The clip cannot change while commands are batched, so SetPixel checks
+// it right away and only the store is deferred
+COLORREF SetPixel(HDC hdc, int x, int y, COLORREF color) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc || !DrawingSurface(dc) || !ClipContains(dc, x, y)) {
+        return CLR_INVALID;
+    }
+    if (Batching(dc)) {
+        GdiCommand& command = RecordCommand(hdc, dc, MV32_GDI_SET_PIXEL, 0);
+        command.rect.left = x;
+        command.rect.top = y;
+        command.value = ColorRefToPixel(color);
+    } else {
+        dc->surface.Row(y + dc->origin.y)[x + dc->origin.x] = ColorRefToPixel(color);
+    }
+    return color & 0x00FFFFFF;
+}
+
+COLORREF GetPixel(HDC hdc, int x, int y) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc || !DrawingSurface(dc) || !ClipContains(dc, x, y)) {
+        return CLR_INVALID;
+    }
+    FlushBatch(hdc, dc);
+    return PixelToColorRef(dc->surface.Row(y + dc->origin.y)[x + dc->origin.x]);
+}
+
+BOOL MoveToEx(HDC hdc, int x, int y, POINT* lppt) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc) {
+        return FALSE;
+    }
+    if (lppt) {
+        *lppt = dc->position;
+    }
+    dc->position.x = x;
+    dc->position.y = y;
+    return TRUE;
+}
+
+// Draw a line with the pen, excluding its last pixel
+static void DrawLine(DeviceContext* dc, int fromX, int fromY, int x, int y) {
+    if (DrawingSurface(dc) && !dc->state.penNull) {
+        // Wide pens repeat the line across its minor axis
+        int dx = x - fromX;
+        int dy = y - fromY;
+        bool steep = (dx < 0 ? -dx : dx) < (dy < 0 ? -dy : dy);
+        int x0 = fromX + dc->origin.x;
+        int y0 = fromY + dc->origin.y;
+        int x1 = x + dc->origin.x;
+        int y1 = y + dc->origin.y;
+        ForEachClipRect(dc, dc->clip.bounds(), [&](const RECT& clip) {
+            for (int i = 0; i < dc->state.penWidth; ++i) {
+                int offset = i - (dc->state.penWidth - 1) / 2;
+                int ox = steep ? offset : 0;
+                int oy = steep ? 0 : offset;
+                DrawLinePixels(dc->surface, clip, x0 + ox, y0 + oy, x1 + ox, y1 + oy, dc->state.penPixel);
+            }
+        });
+    }
+}
+
+BOOL LineTo(HDC hdc, int x, int y) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc) {
+        return FALSE;
+    }
+    if (Batching(dc)) {
+        RECT& line = RecordCommand(hdc, dc, MV32_GDI_LINE, kGdiStatePen).rect;
+        SetRect(&line, dc->position.x, dc->position.y, x, y);
+    } else {
+        DrawLine(dc, dc->position.x, dc->position.y, x, y);
+    }
+    dc->position.x = x;
+    dc->position.y = y;
+    return TRUE;
+}
+
+// Bitmap selected into new memory DCs, standing in for the 1x1 stock
+// bitmap of Windows. Like a stock object it is never deleted and may be
+// selected into any number of DCs.
+static HBITMAP g_defaultBitmap = nullptr;
+
+static HBITMAP DefaultBitmap() {
+    if (!g_bitmaps.Lookup(g_defaultBitmap)) {
+        BitmapData* bitmap = nullptr;
+        g_defaultBitmap = (HBITMAP)g_bitmaps.Allocate(&bitmap);
+        if (bitmap) {
+            bitmap->pixels.Resize(1, 1, kLayoutAligned, ColorRefToPixel(RGB(0, 0, 0)));
+        }
+    }
+    return g_defaultBitmap;
+}
+
+// Point a memory DC at a bitmap's pixels; returns the previous bitmap
+static HBITMAP AttachBitmap(HDC hdc, DeviceContext* dc, HBITMAP hBitmap, BitmapData* bitmap) {
+    HBITMAP previous = dc->bitmap;
+    BitmapData* old = g_bitmaps.Lookup(previous);
+    if (old && old->selectedInto == hdc) {
+        old->selectedInto = nullptr;
+    }
+    if (hBitmap != g_defaultBitmap) {
+        bitmap->selectedInto = hdc;
+    }
+    dc->bitmap = hBitmap;
+    dc->surface = bitmap->pixels.surface();
+    dc->origin.x = 0;
+    dc->origin.y = 0;
+    dc->visibleClip.SetRect(dc->surface.Bounds());
+    UpdateClip(dc);
+    return previous;
+}
+
+HDC CreateCompatibleDC(HDC hdc) {
+    // Every surface is 32bpp, so the reference DC does not matter
+    DeviceContext* dc = nullptr;
+    HDC memoryDC = (HDC)g_deviceContexts.Allocate(&dc, nullptr, kMemoryDC);
+    HBITMAP hBitmap = DefaultBitmap();
+    BitmapData* bitmap = g_bitmaps.Lookup(hBitmap);
+    if (!memoryDC || !bitmap) {
+        g_deviceContexts.Free(memoryDC);
+        return nullptr;
+    }
+    AttachBitmap(memoryDC, dc, hBitmap, bitmap);
+    return memoryDC;
+}
+
+BOOL DeleteDC(HDC hdc) {
+    // Window DCs are returned with ReleaseDC/EndPaint instead
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc || dc->kind != kMemoryDC) {
+        return FALSE;
+    }
+    BitmapData* bitmap = g_bitmaps.Lookup(dc->bitmap);
+    if (bitmap && bitmap->selectedInto == hdc) {
+        bitmap->selectedInto = nullptr;
+    }
+    ReleaseSelectedObjects(dc);
+    g_deviceContexts.Free(hdc);
+    return TRUE;
+}
+
+static HBITMAP CreateBitmapSurface(int width, int height, SurfaceLayout layout, uint32_t fill, BitmapData** out) {
+    BitmapData* bitmap = nullptr;
+    HBITMAP hBitmap = (HBITMAP)g_bitmaps.Allocate(&bitmap);
+    if (!hBitmap) {
+        return nullptr;
+    }
+    if (!bitmap->pixels.Resize(width, height, layout, fill)) {
+        g_bitmaps.Free(hBitmap);
+        return nullptr;
+    }
+    if (out) {
+        *out = bitmap;
+    }
+    return hBitmap;
+}
+
+HBITMAP CreateCompatibleBitmap(HDC hdc, int cx, int cy) {
+    if (!g_deviceContexts.Lookup(hdc) || cx <= 0 || cy <= 0) {
+        return nullptr;
+    }
+    return CreateBitmapSurface(cx, cy, kLayoutAligned, ColorRefToPixel(RGB(0, 0, 0)), nullptr);
+}
+
+HBITMAP CreateDIBSection(HDC hdc, const BITMAPINFO* pbmi, UINT usage, void** ppvBits,
+                         HANDLE hSection, DWORD offset) {
+    if (ppvBits) {
+        *ppvBits = nullptr;
+    }
+    // Only 32bpp BI_RGB, the format of every surface here, is supported
+    if (!pbmi || pbmi->bmiHeader.biBitCount != 32 || pbmi->bmiHeader.biCompression != BI_RGB ||
+        pbmi->bmiHeader.biWidth <= 0 || pbmi->bmiHeader.biHeight == 0 || hSection) {
+        return nullptr;
+    }
+    int width = pbmi->bmiHeader.biWidth;
+    int height = pbmi->bmiHeader.biHeight;
+    SurfaceLayout layout = (height < 0) ? kLayoutDIBTopDown : kLayoutDIBBottomUp;
+    BitmapData* bitmap = nullptr;
+    // DIB section memory starts zeroed, as on Windows
+    HBITMAP hBitmap = CreateBitmapSurface(width, height < 0 ? -height : height, layout, 0, &bitmap);
+    if (!hBitmap) {
+        return nullptr;
+    }
+    bitmap->dibSection = true;
+    if (ppvBits) {
+        *ppvBits = bitmap->pixels.storage();
+    }
+    return hBitmap;
+}
+
+// Map a ternary raster operation that combines source and destination
+static bool SourceRasterOp(DWORD rop, RasterOp* op) {
+    switch (rop) {
+        case SRCCOPY:     *op = kRopSrcCopy; return true;
+        case SRCAND:      *op = kRopSrcAnd; return true;
+        case SRCPAINT:    *op = kRopSrcPaint; return true;
+        case SRCINVERT:   *op = kRopSrcInvert; return true;
+        case SRCERASE:    *op = kRopSrcErase; return true;
+        case NOTSRCCOPY:  *op = kRopNotSrcCopy; return true;
+        case NOTSRCERASE: *op = kRopNotSrcErase; return true;
+        case MERGEPAINT:  *op = kRopMergePaint; return true;
+    }
+    return false;
+}
+
+// Raster operations that ignore the source: fill or invert the clipped area
+static bool DestinationRasterOp(DeviceContext* dc, const RECT& rect, DWORD rop) {
+    switch (rop) {
+        case BLACKNESS:
+        case WHITENESS:
+        case PATCOPY: {
+            uint32_t pixel = (rop == PATCOPY) ? dc->state.brushPixel
+                           : ColorRefToPixel(rop == BLACKNESS ? RGB(0, 0, 0) : RGB(255, 255, 255));
+            FillDCRect(dc, rect, pixel);
+            return true;
+        }
+        case DSTINVERT:
+            if (DrawingSurface(dc)) {
+                ForEachClipRect(dc, rect, [&](const RECT& part) { InvertRectPixels(dc->surface, part); });
+            }
+            return true;
+    }
+    return false;
+}
+
+// Blits draw right away, after the batches of both DCs: the source may be
+// changed next or be the destination itself
+static void FlushBlitBatches(HDC hdcDest, DeviceContext* dc, HDC hdcSrc, DeviceContext* src) {
+    FlushBatch(hdcDest, dc);
+    if (src) {
+        FlushBatch(hdcSrc, src);
+    }
+}
+
+BOOL BitBlt(HDC hdc, int x, int y, int cx, int cy, HDC hdcSrc, int x1, int y1, DWORD rop) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc) {
+        return FALSE;
+    }
+    FlushBlitBatches(hdc, dc, hdcSrc, g_deviceContexts.Lookup(hdcSrc));
+    RECT rect = { x, y, x + cx, y + cy };
+    if (DestinationRasterOp(dc, rect, rop)) {
+        return TRUE;
+    }
+    RasterOp op;
+    DeviceContext* src = g_deviceContexts.Lookup(hdcSrc);
+    if (!src || !SourceRasterOp(rop, &op)) {
+        return FALSE;
+    }
+    if (!DrawingSurface(dc) || !src->surface.pixels) {
+        return TRUE;
+    }
+    
+    // Clip against the destination, then against the source surface;
+    // pixels with no source are left untouched. (dx, dy) maps source
+    // surface coordinates to destination surface coordinates.
+    int dx = (x + dc->origin.x) - (x1 + src->origin.x);
+    int dy = (y + dc->origin.y) - (y1 + src->origin.y);
+    RECT srcBounds = src->surface.Bounds();
+    ForEachClipRect(dc, rect, [&](const RECT& part) {
+        RECT srcArea = part;
+        OffsetRect(&srcArea, -dx, -dy);
+        if (IntersectRect(&srcArea, &srcArea, &srcBounds)) {
+            BlitPixels(dc->surface, srcArea.left + dx, srcArea.top + dy, src->surface, srcArea.left, srcArea.top,
+                       srcArea.right - srcArea.left, srcArea.bottom - srcArea.top, op);
+        }
+    });
+    return TRUE;
+}
+
+BOOL StretchBlt(HDC hdcDest, int xDest, int yDest, int wDest, int hDest,
+                HDC hdcSrc, int xSrc, int ySrc, int wSrc, int hSrc, DWORD rop) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdcDest);
+    if (!dc) {
+        return FALSE;
+    }
+    FlushBlitBatches(hdcDest, dc, hdcSrc, g_deviceContexts.Lookup(hdcSrc));
+    RECT dstRect = { xDest, yDest, xDest + wDest, yDest + hDest };
+    RECT srcRect = { xSrc, ySrc, xSrc + wSrc, ySrc + hSrc };
+    // Negative extents on either side mirror the image
+    bool mirrorX = (wDest < 0) != (wSrc < 0);
+    bool mirrorY = (hDest < 0) != (hSrc < 0);
+    if (wDest < 0) { dstRect.left = xDest + wDest + 1; dstRect.right = xDest + 1; }
+    if (hDest < 0) { dstRect.top = yDest + hDest + 1; dstRect.bottom = yDest + 1; }
+    if (wSrc < 0) { srcRect.left = xSrc + wSrc + 1; srcRect.right = xSrc + 1; }
+    if (hSrc < 0) { srcRect.top = ySrc + hSrc + 1; srcRect.bottom = ySrc + 1; }
+    
+    if (DestinationRasterOp(dc, dstRect, rop)) {
+        return TRUE;
+    }
+    RasterOp op;
+    DeviceContext* src = g_deviceContexts.Lookup(hdcSrc);
+    if (!src || !SourceRasterOp(rop, &op) || wSrc == 0 || hSrc == 0) {
+        return FALSE;
+    }
+    if (DrawingSurface(dc) && src->surface.pixels) {
+        // HALFTONE filters; the other modes pick the nearest source pixel
+        StretchFilter filter = (dc->stretchMode == HALFTONE) ? kStretchBilinear : kStretchNearest;
+        RECT dstSurfaceRect = dstRect;
+        OffsetRect(&dstSurfaceRect, dc->origin.x, dc->origin.y);
+        OffsetRect(&srcRect, src->origin.x, src->origin.y);
+        ForEachClipRect(dc, dstRect, [&](const RECT& clip) {
+            StretchPixels(dc->surface, dstSurfaceRect, clip, src->surface, srcRect, mirrorX, mirrorY, filter, op);
+        });
+    }
+    return TRUE;
+}
+
+BOOL AlphaBlend(HDC hdcDest, int xoriginDest, int yoriginDest, int wDest, int hDest,
+                HDC hdcSrc, int xoriginSrc, int yoriginSrc, int wSrc, int hSrc, BLENDFUNCTION ftn) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdcDest);
+    DeviceContext* src = g_deviceContexts.Lookup(hdcSrc);
+    if (!dc || !src || ftn.BlendOp != AC_SRC_OVER || wDest < 0 || hDest < 0 || wSrc < 0 || hSrc < 0) {
+        return FALSE;
+    }
+    FlushBlitBatches(hdcDest, dc, hdcSrc, src);
+    // The source rectangle has to lie within the source surface
+    RECT srcRect = { xoriginSrc, yoriginSrc, xoriginSrc + wSrc, yoriginSrc + hSrc };
+    OffsetRect(&srcRect, src->origin.x, src->origin.y);
+    RECT srcBounds = src->surface.Bounds();
+    RECT inside;
+    if (!src->surface.pixels || !IntersectRect(&inside, &srcRect, &srcBounds) || !EqualRect(&inside, &srcRect)) {
+        return FALSE;
+    }
+    if (DrawingSurface(dc)) {
+        RECT dstRect = { xoriginDest, yoriginDest, xoriginDest + wDest, yoriginDest + hDest };
+        RECT dstSurfaceRect = dstRect;
+        OffsetRect(&dstSurfaceRect, dc->origin.x, dc->origin.y);
+        ForEachClipRect(dc, dstRect, [&](const RECT& clip) {
+            AlphaBlendPixels(dc->surface, dstSurfaceRect, clip, src->surface, srcRect,
+                             ftn.SourceConstantAlpha, (ftn.AlphaFormat & AC_SRC_ALPHA) != 0);
+        });
+    }
+    return TRUE;
+}
+
+int SetStretchBltMode(HDC hdc, int mode) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc || mode < BLACKONWHITE || mode > HALFTONE) {
+        return 0;
+    }
+    int previous = dc->stretchMode;
+    dc->stretchMode = mode;
+    return previous;
+}
+
+HRGN CreateRectRgn(int x1, int y1, int x2, int y2) {
+    // Like Windows, accept the corners in either order
+    RECT rect = { x1 < x2 ? x1 : x2, y1 < y2 ? y1 : y2, x1 < x2 ? x2 : x1, y1 < y2 ? y2 : y1 };
+    Region* region = nullptr;
+    HRGN hrgn = (HRGN)g_regions.Allocate(&region);
+    if (region) {
+        region->SetRect(rect);
+    }
+    return hrgn;
+}
+
+HRGN CreateRectRgnIndirect(const RECT* lprect) {
+    return lprect ? CreateRectRgn(lprect->left, lprect->top, lprect->right, lprect->bottom) : nullptr;
+}
+
+int CombineRgn(HRGN hrgnDst, HRGN hrgnSrc1, HRGN hrgnSrc2, int iMode) {
+    Region* dst = g_regions.Lookup(hrgnDst);
+    Region* src1 = g_regions.Lookup(hrgnSrc1);
+    Region* src2 = (iMode == RGN_COPY) ? src1 : g_regions.Lookup(hrgnSrc2);
+    if (!dst || !src1 || !src2 || iMode < RGN_AND || iMode > RGN_COPY) {
+        return RGN_ERROR;
+    }
+    if (dst == src1) {
+        dst->CombineWith(*src2, iMode);
+    } else if (dst == src2) {
+        // Only the first operand can be combined in place
+        Region result;
+        result.Combine(*src1, *src2, iMode);
+        dst->Swap(result);
+    } else {
+        dst->Combine(*src1, *src2, iMode);
+    }
+    return dst->Type();
+}
+
+int OffsetRgn(HRGN hrgn, int x, int y) {
+    Region* region = g_regions.Lookup(hrgn);
+    if (!region) {
+        return RGN_ERROR;
+    }
+    region->Offset(x, y);
+    return region->Type();
+}
+
+int GetRgnBox(HRGN hrgn, RECT* lprc) {
+    Region* region = g_regions.Lookup(hrgn);
+    if (!region || !lprc) {
+        return RGN_ERROR;
+    }
+    *lprc = region->bounds();
+    return region->Type();
+}
+
+BOOL PtInRegion(HRGN hrgn, int x, int y) {
+    Region* region = g_regions.Lookup(hrgn);
+    return region && region->Contains(x, y) ? TRUE : FALSE;
+}
+
+// The DC keeps a copy, so the region may be changed or deleted afterwards.
+// NULL goes back to the window's own clipping.
+int SelectClipRgn(HDC hdc, HRGN hrgn) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    Region* region = g_regions.Lookup(hrgn);
+    if (!dc || (hrgn && !region)) {
+        return RGN_ERROR;
+    }
+    FlushBatch(hdc, dc); // Batched commands draw with the clip they were recorded under
+    dc->hasSelectedClip = region != nullptr;
+    if (region) {
+        dc->selectedClip = *region;
+    } else {
+        dc->selectedClip.SetEmpty();
+    }
+    UpdateClip(dc);
+    return dc->clip.Type();
+}
+
+int GetClipBox(HDC hdc, RECT* lprect) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc || !lprect) {
+        return RGN_ERROR;
+    }
+    *lprect = dc->clip.bounds();
+    return dc->clip.Type();
+}
+
+// The font of a drawing state; no selection stands for the stock system
+// font. Selections hold a reference, so a selected font outlives DeleteObject.
+static FontData* SelectedFont(const GdiState& state) {
+    FontObject* font = g_fonts.Lookup(state.font);
+    if (!font) {
+        font = g_fonts.Lookup(GetStockObject(SYSTEM_FONT));
+    }
+    return font;
+}
+
+static FontData* SelectedFont(DeviceContext* dc) {
+    return SelectedFont(dc->state);
+}
+
+// Rasterize one line of text with its cell's top-left corner at (x, y),
+// honoring the DC's background mode and the font's decorations
+static void DrawTextLine(DeviceContext* dc, FontData* font, const char* text, int length,
+                         int x, int y, const RECT& clip) {
+    if (!DrawingSurface(dc)) {
+        return;
+    }
+    RECT area;
+    RECT cell = { x, y, x + MeasureTextWidth(*font, text, length) + font->overhang, y + font->height };
+    if (!IntersectRect(&area, &cell, &clip)) {
+        return;
+    }
+    x += dc->origin.x;
+    y += dc->origin.y;
+    uint32_t pixel = ColorRefToPixel(dc->state.textColor);
+    int thickness = (font->height + 15) / 16;
+    ForEachClipRect(dc, area, [&](const RECT& visible) {
+        if (dc->state.bkMode == OPAQUE) {
+            FillRectPixels(dc->surface, visible, ColorRefToPixel(dc->state.bkColor));
+        }
+        int width = DrawGlyphRun(dc->surface, visible, *font, text, length, x, y, pixel);
+        if (font->underline) {
+            int top = y + font->ascent + (font->height - font->ascent - thickness) / 2;
+            RECT line = { x, top, x + width, top + thickness };
+            if (IntersectRect(&line, &line, &visible)) {
+                FillRectPixels(dc->surface, line, pixel);
+            }
+        }
+        if (font->strikeOut) {
+            RECT line = { x, y + font->ascent * 5 / 8, x + width, y + font->ascent * 5 / 8 + thickness };
+            if (IntersectRect(&line, &line, &visible)) {
+                FillRectPixels(dc->surface, line, pixel);
+            }
+        }
+    });
+}
+
+// Top of the first line of a DrawText layout in rect
+static int TextTop(const FontData* font, const RECT& rect, UINT format) {
+    int y = rect.top;
+    if (format & DT_SINGLELINE) {
+        if (format & DT_VCENTER) {
+            y += ((rect.bottom - rect.top) - font->height) / 2;
+        } else if (format & DT_BOTTOM) {
+            y = rect.bottom - font->height;
+        }
+    }
+    return y;
+}
+
+// Draw the lines of a DrawText layout
+static void PaintText(DeviceContext* dc, FontData* font, const TextLayout& layout, const char* text,
+                      const RECT& rect, UINT format) {
+    // Text is confined to rect, so skip it entirely outside the clip area
+    RECT clip = dc->clip.bounds();
+    if (!(format & DT_NOCLIP) && !IntersectRect(&clip, &rect, &dc->clip.bounds())) {
+        return;
+    }
+    int y = TextTop(font, rect, format);
+    for (const TextLine& line : layout.lines) {
+        if (y >= clip.bottom) {
+            break;
+        }
+        if (y + font->height > clip.top) {
+            // Lines are aligned by their measured extent
+            int x = rect.left;
+            if (format & (DT_CENTER | DT_RIGHT)) {
+                int slack = (rect.right - rect.left) - line.width;
+                x += (format & DT_CENTER) ? slack / 2 : slack;
+            }
+            ForEachTextRun(*font, text, line, format, [&](const char* run, int runLength, int runX) {
+                DrawTextLine(dc, font, run, runLength, x + runX, y, clip);
+                if (dc->platformContext) {
+                    TraceScope trace("DrawPlatformText");
+                    DrawPlatformText(dc->platformContext, run, runLength, x + runX, y);
+                }
+            });
+        }
+        y += font->height;
+    }
+}
+
+// Record text for a batching DC; the batch keeps a copy of it
+static void RecordText(HDC hdc, DeviceContext* dc, uint32_t op, const char* text, int len, const RECT& rect,
+                       UINT format) {
+    GdiCommand& command = RecordCommand(hdc, dc, op, kGdiStateText);
+    command.rect = rect;
+    command.value = format;
+    command.length = len;
+    command.text = dc->batch->AddText(text, len);
+}
+
+// DrawText for length bytes of UTF-8, drawn straight from the caller's string
+static int DrawTextUtf8(HDC hdc, DeviceContext* dc, const char* lpchText, int len, RECT* lpRect, UINT format) {
+    FontData* font = SelectedFont(dc);
+    const TextLayout& layout = LayoutText(*font, lpchText, len, lpRect->right - lpRect->left, format);
+    int textHeight = (int)layout.lines.size() * font->height;
+    if (format & DT_CALCRECT) {
+        lpRect->right = lpRect->left + layout.width;
+        lpRect->bottom = lpRect->top + textHeight;
+        return textHeight;
+    }
+    
+    // With DT_VCENTER/DT_BOTTOM the result is the offset of the text bottom
+    int result = ((format & DT_SINGLELINE) && (format & (DT_VCENTER | DT_BOTTOM)))
+                 ? TextTop(font, *lpRect, format) + font->height - lpRect->top : textHeight;
+    if (Batching(dc)) {
+        RECT visible;
+        if ((format & DT_NOCLIP) || IntersectRect(&visible, lpRect, &dc->clip.bounds())) {
+            RecordText(hdc, dc, MV32_GDI_DRAW_TEXT, lpchText, len, *lpRect, format);
+        }
+    } else {
+        PaintText(dc, font, layout, lpchText, *lpRect, format);
+    }
+    return result;
+}
+
+int DrawText(HDC hdc, LPCSTR lpchText, int cchText, RECT* lpRect, UINT format) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc || !lpchText || !lpRect) {
+        return 0;
+    }
+    int len = (cchText == -1) ? (int)strlen(lpchText) : cchText;
+    return DrawTextUtf8(hdc, dc, lpchText, len, lpRect, format);
+}
+
+// cchText counts UTF-16 code units
+int DrawTextW(HDC hdc, LPCWSTR lpchText, int cchText, RECT* lpRect, UINT format) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc || !lpchText || !lpRect) {
+        return 0;
+    }
+    int len;
+    const char* text = Utf16ToUtf8Scratch(lpchText, cchText, kScratchText, &len);
+    return DrawTextUtf8(hdc, dc, text, len, lpRect, format);
+}
+
+static void DrawTextOut(DeviceContext* dc, int x, int y, const char* text, int len) {
+    DrawTextLine(dc, SelectedFont(dc), text, len, x, y, dc->clip.bounds());
+    if (dc->platformContext) {
+        TraceScope trace("DrawPlatformText");
+        DrawPlatformText(dc->platformContext, text, len, x, y);
+    }
+}
+
+static void TextOutUtf8(HDC hdc, DeviceContext* dc, int x, int y, const char* text, int len) {
+    if (Batching(dc)) {
+        RECT origin = { x, y, x, y };
+        RecordText(hdc, dc, MV32_GDI_TEXT_OUT, text, len, origin, 0);
+    } else {
+        DrawTextOut(dc, x, y, text, len);
+    }
+}
+
+BOOL TextOut(HDC hdc, int x, int y, LPCSTR lpString, int c) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (dc && lpString) {
+        TextOutUtf8(hdc, dc, x, y, lpString, (c == -1) ? (int)strlen(lpString) : c);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+BOOL TextOutW(HDC hdc, int x, int y, LPCWSTR lpString, int c) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (dc && lpString) {
+        int len;
+        const char* text = Utf16ToUtf8Scratch(lpString, c, kScratchText, &len);
+        TextOutUtf8(hdc, dc, x, y, text, len);
         return TRUE;
     }
     return FALSE;
 }
 
-BOOL UpdateWindow(HWND hWnd) {
-    // Send WM_PAINT message
-    MSG msg = {};
-    msg.hwnd = hWnd;
-    msg.message = WM_PAINT;
-    g_messageQueue.push_back(msg);
+BOOL GetTextExtentPoint32(HDC hdc, LPCSTR lpString, int c, SIZE* lpSize) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc || !lpSize || (c > 0 && !lpString) || c < 0) {
+        return FALSE;
+    }
+    FontData* font = SelectedFont(dc);
+    lpSize->cx = (c > 0) ? MeasureTextWidth(*font, lpString, c) : 0;
+    lpSize->cy = font->height;
     return TRUE;
 }
 
-BOOL DestroyWindow(HWND hWnd) {
-    auto it = g_windows.find(hWnd);
-    if (it != g_windows.end()) {
-        DestroyPlatformWindow(it->second->platformWindow);
-        g_windows.erase(it);
-        return TRUE;
+BOOL GetTextMetrics(HDC hdc, TEXTMETRIC* lptm) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc || !lptm) {
+        return FALSE;
     }
-    return FALSE;
+    GetFontTextMetrics(*SelectedFont(dc), lptm);
+    return TRUE;
 }
 
-BOOL InvalidateRect(HWND hWnd, const RECT* lpRect, BOOL bErase) {
-    (void)lpRect; (void)bErase; // Silence unused parameter warnings
-    
-    auto it = g_windows.find(hWnd);
-    if (it != g_windows.end()) {
-        InvalidatePlatformWindow(it->second->platformWindow);
-        // Queue a paint message
-        MSG msg = {};
-        msg.hwnd = hWnd;
-        msg.message = WM_PAINT;
-        g_messageQueue.push_back(msg);
-        return TRUE;
-    }
-    return FALSE;
+HFONT CreateFont(int cHeight, int cWidth, int cEscapement, int cOrientation,
+                int cWeight, DWORD bItalic, DWORD bUnderline, DWORD bStrikeOut,
+                DWORD iCharSet, DWORD iOutPrecision, DWORD iClipPrecision,
+                DWORD iQuality, DWORD iPitchAndFamily, LPCSTR pszFaceName) {
+    // Every face maps to the built-in font; size and style are honored.
+    // Requests are interned by the resolved cell, so equivalent parameters
+    // share one font and its cached glyphs.
+    FontData resolved;
+    InitFontData(&resolved, cHeight, cWidth, cWeight, bItalic != 0, bUnderline != 0, bStrikeOut != 0);
+    uint64_t key = (uint64_t)(uint32_t)resolved.height | ((uint64_t)(uint32_t)resolved.advance << 16) |
+                   ((uint64_t)(resolved.weight & 0xFFFF) << 32) | ((uint64_t)resolved.italic << 48) |
+                   ((uint64_t)resolved.underline << 49) | ((uint64_t)resolved.strikeOut << 50);
+    return (HFONT)g_fonts.Intern(key, [&](FontObject* font) { static_cast<FontData&>(*font) = resolved; });
 }
 
-BOOL GetClientRect(HWND hWnd, RECT* lpRect) {
-    auto it = g_windows.find(hWnd);
-    if (it != g_windows.end() && lpRect) {
-        lpRect->left = 0;
-        lpRect->top = 0;
-        lpRect->right = it->second->width;
-        lpRect->bottom = it->second->height;
-        return TRUE;
+// Select h into a DC slot, moving the slot's reference to it. Returns the
+// previous selection, or the stock object an empty slot stands for.
+template <typename Table>
+static HGDIOBJ SwapSelection(Table& table, HGDIOBJ* slot, HGDIOBJ h, int stockIndex) {
+    HGDIOBJ previous = *slot ? *slot : GetStockObject(stockIndex);
+    table.AddRef(h);
+    table.Release(*slot);
+    *slot = h;
+    return previous;
+}
+
+HGDIOBJ SelectObject(HDC hdc, HGDIOBJ h) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc) {
+        return nullptr;
     }
-    return FALSE;
+    if (g_fonts.Lookup(h)) {
+        return SwapSelection(g_fonts, &dc->state.font, h, SYSTEM_FONT);
+    }
+    BrushData* brush = g_brushes.Lookup(h);
+    if (brush) {
+        dc->state.brushPixel = brush->pixel;
+        dc->state.brushHollow = brush->hollow;
+        return SwapSelection(g_brushes, &dc->brush, h, WHITE_BRUSH);
+    }
+    PenData* pen = g_pens.Lookup(h);
+    if (pen) {
+        dc->state.penPixel = pen->pixel;
+        dc->state.penWidth = pen->width;
+        dc->state.penNull = pen->style == PS_NULL;
+        return SwapSelection(g_pens, &dc->pen, h, BLACK_PEN);
+    }
+    BitmapData* bitmap = g_bitmaps.Lookup(h);
+    if (bitmap) {
+        // Bitmaps go into memory DCs only, and into one DC at a time
+        if (dc->kind != kMemoryDC || (bitmap->selectedInto && bitmap->selectedInto != hdc)) {
+            return nullptr;
+        }
+        return AttachBitmap(hdc, dc, (HBITMAP)h, bitmap);
+    }
+    if (g_regions.Lookup(h)) {
+        // Selecting a region sets the clip and returns the region type
+        return (HGDIOBJ)(intptr_t)SelectClipRgn(hdc, (HRGN)h);
+    }
+    return nullptr;
 }
 
-BOOL SetWindowText(HWND hWnd, LPCSTR lpString) {
-    auto it = g_windows.find(hWnd);
-    if (it != g_windows.end()) {
-        it->second->title = lpString ? lpString : "";
+BOOL DeleteObject(HGDIOBJ ho) {
+    // Fonts, brushes and pens stay alive while selected into a DC and are
+    // released along with the last selection; stock objects are permanent
+    if (g_fonts.Release(ho) || g_brushes.Release(ho) || g_pens.Release(ho)) {
         return TRUE;
     }
-    return FALSE;
+    BitmapData* bitmap = g_bitmaps.Lookup(ho);
+    if (bitmap) {
+        // A selected bitmap is still drawn into, so it cannot go away yet
+        if (bitmap->selectedInto) {
+            return FALSE;
+        }
+        if (ho != g_defaultBitmap) {
+            g_bitmaps.Free(ho);
+        }
+        return TRUE;
+    }
+    return g_regions.Free(ho) ? TRUE : FALSE;
 }
 
-HINSTANCE GetModuleHandle(LPCSTR lpModuleName) {
-    (void)lpModuleName; // Silence unused parameter warning
-    return (HINSTANCE)1; // Dummy handle
+int GetObject(HANDLE h, int c, LPVOID pv) {
+    BitmapData* bitmap = g_bitmaps.Lookup(h);
+    if (!bitmap) {
+        return 0;
+    }
+    if (!pv) {
+        return (int)sizeof(BITMAP);
+    }
+    if (c < (int)sizeof(BITMAP)) {
+        return 0;
+    }
+    const Surface& pixels = bitmap->pixels.surface();
+    BITMAP* info = (BITMAP*)pv;
+    info->bmType = 0;
+    info->bmWidth = pixels.width;
+    info->bmHeight = pixels.height;
+    info->bmWidthBytes = pixels.width * 4;
+    info->bmPlanes = 1;
+    info->bmBitsPixel = 32;
+    info->bmBits = bitmap->dibSection ? bitmap->pixels.storage() : nullptr;
+    return (int)sizeof(BITMAP);
 }
 
-void* LoadCursor(HINSTANCE hInstance, LPCSTR lpCursorName) {
-    (void)hInstance; (void)lpCursorName; // Silence unused parameter warnings
-    return (void*)1; // Dummy cursor
+DWORD SetTextColor(HDC hdc, DWORD color) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc) {
+        return CLR_INVALID;
+    }
+    COLORREF previous = dc->state.textColor;
+    dc->state.textColor = color & 0x00FFFFFF;
+    return previous;
 }
 
-BOOL RegisterClassEx(const WNDCLASSEX* lpWndClass) {
-    if (lpWndClass && lpWndClass->lpszClassName) {
-        g_windowClasses[lpWndClass->lpszClassName] = lpWndClass->lpfnWndProc;
-        return TRUE;
+COLORREF SetBkColor(HDC hdc, COLORREF color) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc) {
+        return CLR_INVALID;
     }
-    return FALSE;
+    COLORREF previous = dc->state.bkColor;
+    dc->state.bkColor = color & 0x00FFFFFF;
+    return previous;
 }
 
-BOOL GetMessage(MSG* lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax) {
-    (void)hWnd; (void)wMsgFilterMin; (void)wMsgFilterMax; // Silence unused parameter warnings
-    
-    if (g_quitPosted) {
-        return FALSE;
-    }
-    
-    // Process platform-specific events
-    ProcessPlatformEvents();
-    
-    // Process platform messages here
-    // For now, return messages from queue
-    if (!g_messageQueue.empty()) {
-        *lpMsg = g_messageQueue.front();
-        g_messageQueue.erase(g_messageQueue.begin());
-        return TRUE;
+int SetBkMode(HDC hdc, int mode) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc || (mode != TRANSPARENT && mode != OPAQUE)) {
+        return 0;
     }
-    
-    // Create a synthetic paint message to keep the loop alive
-    if (g_messageQueue.empty() && !g_windows.empty()) {
-        MSG msg = {};
-        msg.hwnd = g_windows.begin()->first; // First window
-        msg.message = WM_PAINT;
-        g_messageQueue.push_back(msg);
+    int previous = dc->state.bkMode;
+    dc->state.bkMode = mode;
+    return previous;
+}
+
+// Apply a batched state change to state; false for drawing commands
+static bool ApplyStateCommand(GdiState& state, const GdiCommand& command) {
+    switch (command.op) {
+        case MV32_GDI_SET_TEXT_COLOR: state.textColor = command.value; return true;
+        case MV32_GDI_SET_BK_COLOR: state.bkColor = command.value; return true;
+        case MV32_GDI_SET_BK_MODE: state.bkMode = (int)command.value; return true;
+        case MV32_GDI_SET_FONT: state.font = command.font; return true;
+        case MV32_GDI_SET_PEN:
+            state.penPixel = command.value;
+            state.penWidth = command.rect.left;
+            state.penNull = command.length != 0;
+            return true;
+        case MV32_GDI_SET_BRUSH:
+            state.brushPixel = command.value;
+            state.brushHollow = command.length != 0;
+            return true;
     }
-    
-    // Small delay to prevent busy waiting
-    usleep(16000); // ~60 FPS
-    return TRUE;
+    return false;
 }
 
-BOOL TranslateMessage(const MSG* lpMsg) {
-    (void)lpMsg; // Silence unused parameter warning
-    return TRUE; // No-op for now
+// Draw one batched command with the DC's state
+static void DrawCommand(DeviceContext* dc, const GdiBatch& batch, const GdiCommand& command) {
+    const RECT& r = command.rect;
+    switch (command.op) {
+        case MV32_GDI_FILL_RECT: FillDCRect(dc, r, command.value); break;
+        case MV32_GDI_RECTANGLE: DrawRectangle(dc, r.left, r.top, r.right, r.bottom); break;
+        case MV32_GDI_LINE: DrawLine(dc, r.left, r.top, r.right, r.bottom); break;
+        case MV32_GDI_SET_PIXEL:
+            // Clipped when recorded; a tile only draws the pixels inside it
+            if (dc->surface.pixels && ClipContains(dc, r.left, r.top)) {
+                dc->surface.Row(r.top + dc->origin.y)[r.left + dc->origin.x] = command.value;
+            }
+            break;
+        case MV32_GDI_TEXT_OUT: DrawTextOut(dc, r.left, r.top, batch.Text(command), command.length); break;
+        case MV32_GDI_DRAW_TEXT: {
+            const char* text = batch.Text(command);
+            FontData* font = SelectedFont(dc);
+            const TextLayout& layout = LayoutText(*font, text, command.length, r.right - r.left, command.value);
+            PaintText(dc, font, layout, text, r, command.value);
+            break;
+        }
+    }
 }
 
-LRESULT DispatchMessage(const MSG* lpMsg) {
-    if (lpMsg && lpMsg->hwnd) {
-        auto it = g_windows.find(lpMsg->hwnd);
-        if (it != g_windows.end() && it->second->wndProc) {
-            return it->second->wndProc(lpMsg->hwnd, lpMsg->message, lpMsg->wParam, lpMsg->lParam);
+// Draw a batch's commands, starting from the state it was begun with
+static void RunBatch(DeviceContext* dc, const GdiBatch& batch) {
+    dc->state = batch.initial();
+    for (const GdiCommand& command : batch.commands()) {
+        if (!ApplyStateCommand(dc->state, command)) {
+            DrawCommand(dc, batch, command);
         }
     }
-    return 0;
 }
 
-void PostQuitMessage(int nExitCode) {
-    g_quitPosted = true;
-    MSG msg = {};
-    msg.message = WM_QUIT;
-    msg.wParam = nExitCode;
-    g_messageQueue.push_back(msg);
+// ==============================================================================
+// PARALLEL RASTERIZATION
+// ==============================================================================
+
+// A flushed batch that covers enough pixels is split into square tiles of
+// the DC's surface, drawn on the work-stealing pool. Each tile draws the
+// commands that touch it, in order and clipped to the tile, so every pixel
+// sees the same operations as in a serial flush and the output is the same
+// whatever the thread count.
+static const int kRasterTileSize = 128;
+static const uint64_t kParallelRasterPixels = 256 * 256;
+
+// Thread count for a request, 0 or less for one per core
+static int RasterThreads(int threads) {
+    if (threads <= 0) {
+        threads = (int)std::thread::hardware_concurrency();
+    }
+    return std::max(1, std::min(threads, WorkStealingPool::kMaxThreads));
 }
 
-HDC BeginPaint(HWND hWnd, PAINTSTRUCT* lpPaint) {
-    auto it = g_windows.find(hWnd);
-    if (it != g_windows.end()) {
-        HDC hdc = (HDC)g_nextDCHandle++;
-        auto dc = std::make_unique<DeviceContext>(hWnd);
-        dc->platformContext = BeginPlatformPaint(it->second->platformWindow);
-        g_deviceContexts[hdc] = std::move(dc);
-        
-        if (lpPaint) {
-            lpPaint->hdc = hdc;
-            lpPaint->fErase = FALSE;
-            GetClientRect(hWnd, &lpPaint->rcPaint);
+// MULTIVERSE32_RASTER_THREADS=<count> sets the initial thread count, 0 for
+// one per core; the default of 1 draws on the flushing thread
+static int RasterThreadsFromEnvironment() {
+    const char* value = getenv("MULTIVERSE32_RASTER_THREADS");
+    return (value && *value) ? RasterThreads(atoi(value)) : 1;
+}
+
+static std::atomic<int> g_rasterThreads(RasterThreadsFromEnvironment());
+
+// A batch binned by tile. Storage is kept by the flushing thread.
+struct RasterJob {
+    const DeviceContext* dc;
+    const GdiBatch* batch;
+    int columns;
+    std::vector<GdiState> states;    // Per command: the state it draws with
+    std::vector<RECT> bounds;        // Per command: surface area it may touch, empty for state changes
+    std::vector<uint32_t> binStarts; // Per tile, where its commands start in binned; one extra at the end
+    std::vector<uint32_t> binned;    // Indices of the commands touching each tile, in order
+    std::vector<int> tiles;          // Tiles with commands
+};
+
+static thread_local RasterJob t_rasterJob;
+
+// Surface area a drawing command may touch, from the state it draws with
+static RECT CommandBounds(const DeviceContext* dc, const GdiBatch& batch, const GdiCommand& command,
+                          const GdiState& state) {
+    const RECT& r = command.rect;
+    RECT area;
+    switch (command.op) {
+        case MV32_GDI_LINE: {
+            // Wide pens spread across the minor axis, by less than their width
+            int spread = state.penWidth;
+            SetRect(&area, std::min(r.left, r.right) - spread, std::min(r.top, r.bottom) - spread,
+                    std::max(r.left, r.right) + spread + 1, std::max(r.top, r.bottom) + spread + 1);
+            break;
         }
-        
-        return hdc;
+        case MV32_GDI_SET_PIXEL:
+            SetRect(&area, r.left, r.top, r.left + 1, r.top + 1);
+            break;
+        case MV32_GDI_TEXT_OUT: {
+            FontData* font = SelectedFont(state);
+            int width = MeasureTextWidth(*font, batch.Text(command), command.length) + font->overhang;
+            SetRect(&area, r.left, r.top, r.left + width, r.top + font->height);
+            break;
+        }
+        case MV32_GDI_DRAW_TEXT:
+            area = (command.value & DT_NOCLIP) ? dc->clip.bounds() : r;
+            break;
+        default:
+            area = r;
+            break;
     }
-    return nullptr;
+    if (!IntersectRect(&area, &area, &dc->clip.bounds())) {
+        SetRectEmpty(&area);
+    }
+    OffsetRect(&area, dc->origin.x, dc->origin.y);
+    return area;
 }
 
-BOOL EndPaint(HWND hWnd, const PAINTSTRUCT* lpPaint) {
-    if (lpPaint && lpPaint->hdc) {
-        auto it = g_deviceContexts.find(lpPaint->hdc);
-        if (it != g_deviceContexts.end()) {
-            auto windowIt = g_windows.find(hWnd);
-            if (windowIt != g_windows.end()) {
-                EndPlatformPaint(windowIt->second->platformWindow, it->second->platformContext);
-            }
-            g_deviceContexts.erase(it);
-            return TRUE;
+// Bin the batch's drawing commands by the tiles they touch. Returns false
+// if the batch is too small to be worth splitting.
+static bool BinBatch(RasterJob& job, const DeviceContext* dc, const GdiBatch& batch) {
+    const std::vector<GdiCommand>& commands = batch.commands();
+    size_t count = commands.size();
+    job.states.resize(count);
+    job.bounds.resize(count);
+    GdiState state = batch.initial();
+    uint64_t pixels = 0;
+    for (size_t i = 0; i < count; ++i) {
+        RECT& area = job.bounds[i];
+        if (ApplyStateCommand(state, commands[i])) {
+            SetRectEmpty(&area);
+            continue;
+        }
+        job.states[i] = state;
+        area = CommandBounds(dc, batch, commands[i], state);
+        if (!IsRectEmpty(&area)) {
+            pixels += (uint64_t)(area.right - area.left) * (area.bottom - area.top);
         }
     }
-    return FALSE;
-}
+    if (pixels < kParallelRasterPixels) {
+        return false;
+    }
 
-int DrawText(HDC hdc, LPCSTR lpchText, int cchText, RECT* lpRect, UINT format) {
-    auto it = g_deviceContexts.find(hdc);
-    if (it != g_deviceContexts.end() && lpchText && lpRect) {
-        int len = (cchText == -1) ? strlen(lpchText) : cchText;
-        std::string text(lpchText, len);
-        
-        int x = lpRect->left;
-        int y = lpRect->top;
-        
-        if (format & DT_CENTER) {
-            x = lpRect->left + (lpRect->right - lpRect->left) / 2;
+    // Count the commands of each tile, then place them in command order
+    job.columns = (dc->surface.width + kRasterTileSize - 1) / kRasterTileSize;
+    int rows = (dc->surface.height + kRasterTileSize - 1) / kRasterTileSize;
+    job.binStarts.assign((size_t)job.columns * rows + 1, 0);
+    auto forEachTile = [&](const RECT& area, auto visit) {
+        for (int row = area.top / kRasterTileSize; row <= (area.bottom - 1) / kRasterTileSize; ++row) {
+            for (int column = area.left / kRasterTileSize; column <= (area.right - 1) / kRasterTileSize; ++column) {
+                visit(row * job.columns + column);
+            }
         }
-        if (format & DT_VCENTER) {
-            y = lpRect->top + (lpRect->bottom - lpRect->top) / 2;
+    };
+    for (size_t i = 0; i < count; ++i) {
+        if (!IsRectEmpty(&job.bounds[i])) {
+            forEachTile(job.bounds[i], [&](int tile) { ++job.binStarts[tile + 1]; });
         }
-        
-        DrawPlatformText(it->second->platformContext, text.c_str(), x, y);
-        return len;
     }
-    return 0;
+    job.tiles.clear();
+    for (size_t tile = 0; tile + 1 < job.binStarts.size(); ++tile) {
+        if (job.binStarts[tile + 1]) {
+            job.tiles.push_back((int)tile);
+        }
+        job.binStarts[tile + 1] += job.binStarts[tile];
+    }
+    job.binned.resize(job.binStarts.back());
+    for (size_t i = 0; i < count; ++i) {
+        if (!IsRectEmpty(&job.bounds[i])) {
+            // binStarts[tile] serves as the tile's cursor, then ends up at its successor's start
+            forEachTile(job.bounds[i], [&](int tile) { job.binned[job.binStarts[tile]++] = (uint32_t)i; });
+        }
+    }
+    for (size_t tile = job.binStarts.size() - 1; tile > 0; --tile) {
+        job.binStarts[tile] = job.binStarts[tile - 1];
+    }
+    job.binStarts[0] = 0;
+    job.dc = dc;
+    job.batch = &batch;
+    return job.tiles.size() > 1;
 }
 
-BOOL TextOut(HDC hdc, int x, int y, LPCSTR lpString, int c) {
-    auto it = g_deviceContexts.find(hdc);
-    if (it != g_deviceContexts.end() && lpString) {
-        int len = (c == -1) ? strlen(lpString) : c;
-        std::string text(lpString, len);
-        DrawPlatformText(it->second->platformContext, text.c_str(), x, y);
-        return TRUE;
+// Pool task: draw one tile through a per-thread DC limited to it
+static void RasterizeTile(void* context, int index) {
+    static thread_local DeviceContext t_tileDC;
+    const RasterJob& job = *(const RasterJob*)context;
+    const DeviceContext* dc = job.dc;
+    int tile = job.tiles[index];
+    DeviceContext* tileDC = &t_tileDC;
+    tileDC->surface = dc->surface;
+    tileDC->origin = dc->origin;
+    tileDC->platformContext = nullptr;
+    RECT area = { (tile % job.columns) * kRasterTileSize - dc->origin.x,
+                  (tile / job.columns) * kRasterTileSize - dc->origin.y, 0, 0 };
+    area.right = area.left + kRasterTileSize;
+    area.bottom = area.top + kRasterTileSize;
+    tileDC->clip.Combine(dc->clip, Region(area), RGN_AND);
+    const std::vector<GdiCommand>& commands = job.batch->commands();
+    for (uint32_t i = job.binStarts[tile]; i < job.binStarts[tile + 1]; ++i) {
+        uint32_t command = job.binned[i];
+        tileDC->state = job.states[command];
+        DrawCommand(tileDC, *job.batch, commands[command]);
     }
-    return FALSE;
 }
 
-BOOL Rectangle(HDC hdc, int left, int top, int right, int bottom) {
-    // Stub implementation
-    return TRUE;
+// Draw a batch, split into tiles on the pool when it is large enough
+static void RasterizeBatch(DeviceContext* dc, const GdiBatch& batch) {
+    int threads = g_rasterThreads.load(std::memory_order_relaxed);
+    RasterJob& job = t_rasterJob;
+    if (threads <= 1 || !dc->surface.pixels || !BinBatch(job, dc, batch)) {
+        RunBatch(dc, batch);
+        return;
+    }
+    {
+        TraceScope trace("RasterizeTiles", "tiles", job.tiles.size());
+        WorkStealingPool::Get().Run((int)job.tiles.size(), threads, RasterizeTile, &job);
+    }
+    if (dc->platformContext && PlatformDrawsText()) {
+        // The tiles only drew pixels: pass the text to the platform once
+        Surface surface = dc->surface;
+        dc->surface = Surface();
+        const std::vector<GdiCommand>& commands = batch.commands();
+        for (size_t i = 0; i < commands.size(); ++i) {
+            if (commands[i].op == MV32_GDI_TEXT_OUT || commands[i].op == MV32_GDI_DRAW_TEXT) {
+                dc->state = job.states[i];
+                DrawCommand(dc, batch, commands[i]);
+            }
+        }
+        dc->surface = surface;
+    }
 }
 
-BOOL FillRect(HDC hdc, const RECT* lpRect, HBRUSH hBrush) {
-    // Stub implementation
+int Mv32SetRasterThreads(int threads) {
+    return g_rasterThreads.exchange(RasterThreads(threads), std::memory_order_relaxed);
+}
+
+// Draw and release the DC's batch, if it has one. The commands are dropped
+// when the DC no longer draws anywhere: a window destroyed by another thread.
+static void FlushBatch(HDC hdc, DeviceContext* dc) {
+    GdiBatch* batch = dc->batch;
+    if (!batch) {
+        return;
+    }
+    dc->batch = nullptr;
+    for (size_t i = 0; i < t_pendingBatches.size(); ++i) {
+        if (t_pendingBatches[i] == hdc) {
+            t_pendingBatches[i] = t_pendingBatches.back();
+            t_pendingBatches.pop_back();
+            t_batchedCalls -= (DWORD)batch->calls();
+            break;
+        }
+    }
+    if (dc->kind == kMemoryDC || g_windows.Lookup(dc->window)) {
+        TraceScope trace("GdiFlush");
+        GdiState live = dc->state;
+        RasterizeBatch(dc, *batch);
+        dc->state = live;
+    }
+    g_fonts.Release(batch->initial().font);
+    for (const GdiCommand& command : batch->commands()) {
+        if (command.op == MV32_GDI_SET_FONT) {
+            g_fonts.Release(command.font);
+        }
+    }
+    batch->Clear();
+    t_freeBatches.emplace_back(batch);
+}
+
+BOOL GdiFlush(void) {
+    while (!t_pendingBatches.empty()) {
+        HDC hdc = t_pendingBatches.back();
+        DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+        if (dc && dc->batch) {
+            FlushBatch(hdc, dc);
+        } else {
+            t_pendingBatches.pop_back();
+        }
+    }
+    t_batchedCalls = 0;
     return TRUE;
 }
 
-HFONT CreateFont(int cHeight, int cWidth, int cEscapement, int cOrientation,
-                int cWeight, DWORD bItalic, DWORD bUnderline, DWORD bStrikeOut,
-                DWORD iCharSet, DWORD iOutPrecision, DWORD iClipPrecision,
-                DWORD iQuality, DWORD iPitchAndFamily, LPCSTR pszFaceName) {
-    return (HFONT)1; // Dummy font handle
+DWORD GdiSetBatchLimit(DWORD dw) {
+    DWORD previous = t_batchLimit;
+    GdiFlush();
+    t_batchLimit = dw ? dw : kDefaultBatchLimit;
+    return previous;
 }
 
-HGDIOBJ SelectObject(HDC hdc, HGDIOBJ h) {
-    return (HGDIOBJ)1; // Dummy previous object
+DWORD GdiGetBatchLimit(void) {
+    return t_batchLimit;
 }
 
-BOOL DeleteObject(HGDIOBJ ho) {
+#ifndef _WIN32
+BOOL Mv32GetFramebufferName(HWND hWnd, char* name, int size) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window || !name || size <= 0 || !window->root->swapChain) {
+        return FALSE;
+    }
+    SwapChain* swapChain = window->root->swapChain;
+    swapChain->WaitPresented();
+    const char* exported = swapChain->FramebufferName();
+    if (!exported || (int)strlen(exported) >= size) {
+        return FALSE;
+    }
+    strcpy(name, exported);
     return TRUE;
 }
 
-DWORD SetTextColor(HDC hdc, DWORD color) {
-    return 0; // Previous color
+BOOL Mv32GetPresentStats(HWND hWnd, MV32_PRESENT_STATS* stats) {
+    WindowData* window = g_windows.Lookup(hWnd);
+    if (!window || !stats || !window->root->swapChain) {
+        return FALSE;
+    }
+    window->root->swapChain->GetStats(stats);
+    return TRUE;
 }
 
-int SetBkMode(HDC hdc, int mode) {
-    return 0; // Previous mode
+int Mv32GetGdiBatch(HDC hdc, MV32_GDI_COMMAND* commands, int count) {
+    DeviceContext* dc = g_deviceContexts.Lookup(hdc);
+    if (!dc) {
+        return -1;
+    }
+    if (!dc->batch) {
+        return 0;
+    }
+    const std::vector<GdiCommand>& batched = dc->batch->commands();
+    for (int i = 0; i < count && i < (int)batched.size(); ++i) {
+        const GdiCommand& command = batched[i];
+        MV32_GDI_COMMAND& out = commands[i];
+        out.op = command.op;
+        out.value = command.value;
+        out.rect = command.rect;
+        out.text = command.op == MV32_GDI_TEXT_OUT || command.op == MV32_GDI_DRAW_TEXT
+                   ? dc->batch->Text(command) : nullptr;
+        out.length = command.length;
+        out.object = command.font;
+        switch (command.op) {
+            case MV32_GDI_SET_PEN:
+            case MV32_GDI_SET_BRUSH:
+            case MV32_GDI_FILL_RECT:
+            case MV32_GDI_SET_PIXEL:
+                out.value = PixelToColorRef(command.value);
+                break;
+        }
+    }
+    return (int)batched.size();
 }
+#endif
 
 #ifndef _WIN32
 // Provide DefWindowProc for non-Windows platforms
 LRESULT DefWindowProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam) {
+    if (Msg == WM_PAINT) {
+        // Validate so an unhandled WM_PAINT is not regenerated forever
+        PAINTSTRUCT ps;
+        if (BeginPaint(hWnd, &ps)) {
+            EndPaint(hWnd, &ps);
+        }
+    } else if (Msg == WM_ERASEBKGND) {
+        // Erase the clipped area with the class background brush
+        WindowData* window = g_windows.Lookup(hWnd);
+        DeviceContext* dc = g_deviceContexts.Lookup((HDC)wParam);
+        if (window && dc && window->windowClass && window->windowClass->info.hbrBackground) {
+            FillRect((HDC)wParam, &dc->clip.bounds(), window->windowClass->info.hbrBackground);
+            return 1;
+        }
+    }
     return 0; // Default processing
 }
 #endif
@@ -362,6 +3612,34 @@ LRESULT DefWindowProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam) {
 
 @implementation CustomTextView
 
+// Translate Cocoa mouse events into queued Win32 input (client coordinates
+// have a top-left origin, Cocoa views a bottom-left one)
+- (void)postMouseEvent:(NSEvent*)event message:(UINT)message keys:(WPARAM)keys {
+    HWND hwnd = FindWindowForPlatformWindow((__bridge void*)[self window]);
+    if (hwnd) {
+        NSPoint p = [self convertPoint:[event locationInWindow] fromView:nil];
+        int x = (int)p.x;
+        int y = (int)([self bounds].size.height - p.y);
+        PostInputMessage(hwnd, message, keys, MAKELPARAM(x, y));
+    }
+}
+
+- (void)mouseMoved:(NSEvent*)event {
+    [self postMouseEvent:event message:WM_MOUSEMOVE keys:0];
+}
+
+- (void)mouseDragged:(NSEvent*)event {
+    [self postMouseEvent:event message:WM_MOUSEMOVE keys:MK_LBUTTON];
+}
+
+- (void)mouseDown:(NSEvent*)event {
+    [self postMouseEvent:event message:WM_LBUTTONDOWN keys:MK_LBUTTON];
+}
+
+- (void)mouseUp:(NSEvent*)event {
+    [self postMouseEvent:event message:WM_LBUTTONUP keys:0];
+}
+
 - (void)drawRect:(NSRect)dirtyRect {
     [super drawRect:dirtyRect];
     
@@ -406,6 +3684,37 @@ void ProcessPlatformEvents() {
     }
 }
 
+void WaitPlatformEvents(int64_t timeoutNs) {
+    @autoreleasepool {
+        [NSApplication sharedApplication];
+        NSDate* until = (timeoutNs < 0) ? [NSDate distantFuture]
+                                        : [NSDate dateWithTimeIntervalSinceNow:timeoutNs / 1.0e9];
+        // Block in the run loop until input arrives or WakePlatformEvents posts
+        NSEvent* event = [NSApp nextEventMatchingMask:NSEventMaskAny
+                                            untilDate:until
+                                               inMode:NSDefaultRunLoopMode
+                                              dequeue:YES];
+        if (event) {
+            [NSApp sendEvent:event];
+        }
+    }
+}
+
+void WakePlatformEvents() {
+    @autoreleasepool {
+        NSEvent* event = [NSEvent otherEventWithType:NSEventTypeApplicationDefined
+                                            location:NSZeroPoint
+                                       modifierFlags:0
+                                           timestamp:0
+                                        windowNumber:0
+                                             context:nil
+                                             subtype:0
+                                               data1:0
+                                               data2:0];
+        [NSApp postEvent:event atStart:NO];
+    }
+}
+
 // Setup macOS menu bar
 void SetupMacOSMenuBar() {
     @autoreleasepool {
@@ -565,6 +3874,7 @@ void* CreatePlatformWindow(const char* title, int x, int y, int width, int heigh
             printf("Creating custom content view...\n");
             CustomTextView* customView = [[CustomTextView alloc] initWithFrame:frame];
             [window setContentView:customView];
+            [window setAcceptsMouseMovedEvents:YES];
             printf("Set custom content view\n");
             
             printf("Centering window...\n");
@@ -622,6 +3932,18 @@ void DestroyPlatformWindow(void* window) {
     }
 }
 
+void MovePlatformWindow(void* window, int x, int y, int width, int height) {
+    @autoreleasepool {
+        NSWindow* nsWindow = (__bridge NSWindow*)window;
+        // Win32 screen coordinates grow downwards from the top of the main
+        // screen, Cocoa's upwards from its bottom
+        NSScreen* screen = [NSScreen mainScreen];
+        CGFloat top = screen ? NSMaxY([screen frame]) : 0;
+        NSRect content = NSMakeRect(x, top - y - height, width, height);
+        [nsWindow setFrame:[nsWindow frameRectForContentRect:content] display:YES];
+    }
+}
+
 void* BeginPlatformPaint(void* window) {
     @autoreleasepool {
         NSWindow* nsWindow = (__bridge NSWindow*)window;
@@ -633,29 +3955,48 @@ void* BeginPlatformPaint(void* window) {
 void EndPlatformPaint(void* window, void* context) {
     @autoreleasepool {
         NSView* view = (__bridge_transfer NSView*)context;
-        [view setNeedsDisplay:YES];
+        (void)view; // Released here; the present thread asks for the redraw
     }
 }
 
-void DrawPlatformText(void* context, const char* text, int x, int y) {
+void PresentPlatformWindow(void* window, const Surface& frame, const RECT& dirty) {
+    // AppKit views may only be touched on the main thread
+    NSWindow* nsWindow = (__bridge NSWindow*)window;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [[nsWindow contentView] setNeedsDisplay:YES];
+    });
+}
+
+void DrawPlatformText(void* context, const char* text, int length, int x, int y) {
     @autoreleasepool {
         NSView* view = (__bridge NSView*)context;
-        NSString* nsText = [NSString stringWithUTF8String:text];
+        NSString* nsText = [[NSString alloc] initWithBytes:text length:length encoding:NSUTF8StringEncoding];
         
         // Check if this is our custom text view
         if ([view isKindOfClass:[CustomTextView class]]) {
             CustomTextView* customView = (CustomTextView*)view;
             customView.textToRender = nsText;
             [customView setNeedsDisplay:YES];
-            printf("Set text '%s' on custom view and triggered redraw\n", text);
+            printf("Set text '%.*s' on custom view and triggered redraw\n", length, text);
         } else {
             // Fallback for other view types
             [view setNeedsDisplay:YES];
-            printf("Triggered redraw on standard view for text '%s'\n", text);
+            printf("Triggered redraw on standard view for text '%.*s'\n", length, text);
         }
     }
 }
 
+bool PlatformDrawsText() {
+    return true;
+}
+
+void SetPlatformWindowText(void* window, const char* text, int length) {
+    @autoreleasepool {
+        NSWindow* nsWindow = (__bridge NSWindow*)window;
+        [nsWindow setTitle:[[NSString alloc] initWithBytes:text length:length encoding:NSUTF8StringEncoding]];
+    }
+}
+
 void InvalidatePlatformWindow(void* window) {
     @autoreleasepool {
         NSWindow* nsWindow = (__bridge NSWindow*)window;
@@ -672,6 +4013,34 @@ void ProcessPlatformEvents() {
     // Stub for non-MacOS platforms
 }
 
+// A signalled run loop source stays pending until the loop services it, so a
+// wakeup posted just before the pump blocks is never lost.
+static CFRunLoopSourceRef g_wakeupSource = NULL;
+static CFRunLoopRef g_pumpRunLoop = NULL;
+
+static void WakeupSourcePerform(void* info) {
+    // Nothing to do: servicing the source is what ends the wait
+}
+
+void WaitPlatformEvents(int64_t timeoutNs) {
+    if (!g_wakeupSource) {
+        CFRunLoopSourceContext context = {};
+        context.perform = WakeupSourcePerform;
+        g_wakeupSource = CFRunLoopSourceCreate(kCFAllocatorDefault, 0, &context);
+        g_pumpRunLoop = CFRunLoopGetCurrent();
+        CFRunLoopAddSource(g_pumpRunLoop, g_wakeupSource, kCFRunLoopDefaultMode);
+    }
+    CFTimeInterval seconds = (timeoutNs < 0) ? 1.0e10 : timeoutNs / 1.0e9;
+    CFRunLoopRunInMode(kCFRunLoopDefaultMode, seconds, true);
+}
+
+void WakePlatformEvents() {
+    if (g_wakeupSource) {
+        CFRunLoopSourceSignal(g_wakeupSource);
+        CFRunLoopWakeUp(g_pumpRunLoop);
+    }
+}
+
 void* CreatePlatformWindow(const char* title, int x, int y, int width, int height) {
     printf("=== CreatePlatformWindow Debug ===\n");
     printf("Title: %s\n", title ? title : "(null)");
@@ -706,6 +4075,13 @@ void DestroyPlatformWindow(void* window) {
     }
 }
 
+void MovePlatformWindow(void* window, int x, int y, int width, int height) {
+    @autoreleasepool {
+        UIWindow* uiWindow = (__bridge UIWindow*)window;
+        [uiWindow setFrame:CGRectMake(x, y, width, height)];
+    }
+}
+
 void* BeginPlatformPaint(void* window) {
     @autoreleasepool {
         UIWindow* uiWindow = (__bridge UIWindow*)window;
@@ -716,11 +4092,19 @@ void* BeginPlatformPaint(void* window) {
 void EndPlatformPaint(void* window, void* context) {
     @autoreleasepool {
         UIWindow* uiWindow = (__bridge_transfer UIWindow*)context;
-        [uiWindow setNeedsDisplay];
+        (void)uiWindow; // Released here; the present thread asks for the redraw
     }
 }
 
-void DrawPlatformText(void* context, const char* text, int x, int y) {
+void PresentPlatformWindow(void* window, const Surface& frame, const RECT& dirty) {
+    // UIKit views may only be touched on the main thread
+    UIWindow* uiWindow = (__bridge UIWindow*)window;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [uiWindow setNeedsDisplay];
+    });
+}
+
+void DrawPlatformText(void* context, const char* text, int length, int x, int y) {
     @autoreleasepool {
         // iOS text drawing would require a graphics context
         // This is a placeholder implementation
@@ -729,6 +4113,14 @@ void DrawPlatformText(void* context, const char* text, int x, int y) {
     }
 }
 
+bool PlatformDrawsText() {
+    return false;
+}
+
+void SetPlatformWindowText(void* window, const char* text, int length) {
+    // UIWindows have no title bar
+}
+
 void InvalidatePlatformWindow(void* window) {
     @autoreleasepool {
         UIWindow* uiWindow = (__bridge UIWindow*)window;
@@ -744,6 +4136,77 @@ void ProcessPlatformEvents() {
     // Stub
 }
 
+// Wakeup descriptor for the blocking message wait: an eventfd on Linux, a
+// self-pipe elsewhere. Both stay readable until drained, so wakeups latch.
+static int g_wakeupReadFd = -1;
+static int g_wakeupWriteFd = -1;
+
+static void InitWakeupFd() {
+    if (g_wakeupReadFd >= 0) {
+        return;
+    }
+#ifdef __linux__
+    g_wakeupReadFd = g_wakeupWriteFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+    int fds[2];
+    if (pipe(fds) == 0) {
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+        g_wakeupReadFd = fds[0];
+        g_wakeupWriteFd = fds[1];
+    }
+#endif
+}
+
+#ifdef __linux__
+// poll() only takes milliseconds; timer deadlines are kept to the
+// nanosecond by waiting on a timerfd alongside the wakeup descriptor
+static int g_timerFd = -1;
+#endif
+
+void WaitPlatformEvents(int64_t timeoutNs) {
+    InitWakeupFd();
+    struct pollfd pfds[2] = { { g_wakeupReadFd, POLLIN, 0 }, { -1, POLLIN, 0 } };
+    int timeoutMs = -1;
+    if (timeoutNs >= 0) {
+#ifdef __linux__
+        if (g_timerFd < 0) {
+            g_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        }
+        struct itimerspec spec = {};
+        spec.it_value.tv_sec = (time_t)(timeoutNs / 1000000000);
+        spec.it_value.tv_nsec = (long)(timeoutNs % 1000000000);
+        if (timeoutNs == 0) {
+            spec.it_value.tv_nsec = 1; // A zero value would disarm the timer
+        }
+        if (g_timerFd >= 0 && timerfd_settime(g_timerFd, 0, &spec, nullptr) == 0) {
+            pfds[1].fd = g_timerFd;
+        } else
+#endif
+        {
+            int64_t ms = (timeoutNs + 999999) / 1000000;
+            timeoutMs = ms > 0x7FFFFFFF ? 0x7FFFFFFF : (int)ms;
+        }
+    }
+    if (poll(pfds, 2, timeoutMs) > 0) {
+        uint64_t value;
+        while (read(g_wakeupReadFd, &value, sizeof(value)) > 0) {
+            // Drain every pending wakeup
+        }
+        if (pfds[1].fd >= 0) {
+            ssize_t expirations = read(pfds[1].fd, &value, sizeof(value));
+            (void)expirations; // Unexpired is fine too: the next wait rearms it
+        }
+    }
+}
+
+void WakePlatformEvents() {
+    InitWakeupFd();
+    uint64_t one = 1;
+    ssize_t written = write(g_wakeupWriteFd, &one, sizeof(one));
+    (void)written; // A full pipe/counter already guarantees a wakeup
+}
+
 void* CreatePlatformWindow(const char* title, int x, int y, int width, int height) {
     return (void*)9999; // Stub
 }
@@ -756,6 +4219,10 @@ void DestroyPlatformWindow(void* window) {
     // Stub
 }
 
+void MovePlatformWindow(void* window, int x, int y, int width, int height) {
+    // Stub
+}
+
 void* BeginPlatformPaint(void* window) {
     return (void*)1; // Stub
 }
@@ -764,10 +4231,22 @@ void EndPlatformPaint(void* window, void* context) {
     // Stub
 }
 
-void DrawPlatformText(void* context, const char* text, int x, int y) {
+void PresentPlatformWindow(void* window, const Surface& frame, const RECT& dirty) {
+    // Stub - no display yet; exported framebuffers are the only output
+}
+
+void DrawPlatformText(void* context, const char* text, int length, int x, int y) {
     // Stub - would need platform-specific text rendering
 }
 
+bool PlatformDrawsText() {
+    return false;
+}
+
+void SetPlatformWindowText(void* window, const char* text, int length) {
+    // Stub
+}
+
 void InvalidatePlatformWindow(void* window) {
     // Stub
 }
@@ -780,7 +4259,17 @@ void InvalidatePlatformWindow(void* window) {
 // Cross-platform main function
 #ifndef _WIN32
 int main(int argc, char* argv[]) {
-    return WinMain(GetModuleHandle(NULL), NULL, NULL, SW_SHOW);
+    // As on Windows, lpCmdLine holds the arguments after the program name
+    static std::string commandLine;
+    for (int i = 1; i < argc; ++i) {
+        if (i > 1) {
+            commandLine += ' ';
+        }
+        commandLine += argv[i];
+    }
+    // The platform event loop runs on this thread
+    g_platformThreadId = GetCurrentThreadId();
+    return WinMain(GetModuleHandle(NULL), NULL, (LPSTR)commandLine.c_str(), SW_SHOW);
 }
 #endif
 
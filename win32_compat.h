@@ -20,15 +20,25 @@
     typedef void* HBRUSH;
     typedef void* HPEN;
     typedef void* HGDIOBJ;
+    typedef void* HBITMAP;
+    typedef void* HRGN;
+    typedef void* HANDLE;
     typedef unsigned int UINT;
+    typedef unsigned short WORD;
+    typedef WORD ATOM;
     typedef intptr_t LONG_PTR;
     typedef uintptr_t UINT_PTR;
     typedef UINT_PTR WPARAM;
     typedef LONG_PTR LPARAM;
     typedef LONG_PTR LRESULT;
     typedef unsigned long DWORD;
+    typedef DWORD* LPDWORD;
+    typedef DWORD COLORREF;
     typedef const char* LPCSTR;
     typedef char* LPSTR;
+    typedef char16_t WCHAR; // UTF-16 code unit, as on Windows: write literals as u"..."
+    typedef const WCHAR* LPCWSTR;
+    typedef WCHAR* LPWSTR;
     typedef void* LPVOID;
     
     // Handle BOOL conflict with Objective-C on Apple platforms
@@ -50,33 +60,188 @@
     #define WM_PAINT 0x000F
     #define WM_CLOSE 0x0010
     #define WM_DESTROY 0x0002
+    #define WM_MOVE 0x0003
     #define WM_SIZE 0x0005
     #define WM_KEYDOWN 0x0100
     #define WM_KEYUP 0x0101
     #define WM_LBUTTONDOWN 0x0201
     #define WM_LBUTTONUP 0x0202
     #define WM_MOUSEMOVE 0x0200
+    #define WM_MOUSEWHEEL 0x020A
+    #define WM_MOUSEHWHEEL 0x020E
+    #define WM_ERASEBKGND 0x0014
     #define WM_QUIT 0x0012
+    #define WM_TIMER 0x0113
+    #define WM_NULL 0x0000
+    #define WM_USER 0x0400
+    #define WM_APP 0x8000
+    #define WM_KEYFIRST 0x0100
+    #define WM_KEYLAST 0x0109
+    #define WM_MOUSEFIRST 0x0200
+    #define WM_MOUSELAST 0x020E
     
+    // PeekMessage options
+    #define PM_NOREMOVE 0x0000
+    #define PM_REMOVE 0x0001
+    
+    // SetTimer intervals are clamped to this range, in milliseconds
+    #define USER_TIMER_MINIMUM 0x0000000A
+    #define USER_TIMER_MAXIMUM 0x7FFFFFFF
+    
+    #define WS_OVERLAPPED 0x00000000L
+    #define WS_POPUP 0x80000000L
+    #define WS_CHILD 0x40000000L
+    #define WS_VISIBLE 0x10000000L
+    #define WS_DISABLED 0x08000000L
+    #define WS_CLIPSIBLINGS 0x04000000L
+    #define WS_CLIPCHILDREN 0x02000000L
     #define WS_OVERLAPPEDWINDOW 0x00CF0000L
     #define CS_HREDRAW 0x0002
     #define CS_VREDRAW 0x0001
+    #define CS_OWNDC 0x0020
+    #define CS_CLASSDC 0x0040
+    #define CS_PARENTDC 0x0080
+    
+    // System colors (GetSysColor indices; COLOR_x + 1 is usable as an HBRUSH)
+    #define COLOR_SCROLLBAR 0
+    #define COLOR_BACKGROUND 1
+    #define COLOR_ACTIVECAPTION 2
+    #define COLOR_INACTIVECAPTION 3
+    #define COLOR_MENU 4
     #define COLOR_WINDOW 5
+    #define COLOR_WINDOWFRAME 6
+    #define COLOR_MENUTEXT 7
+    #define COLOR_WINDOWTEXT 8
+    #define COLOR_CAPTIONTEXT 9
+    #define COLOR_ACTIVEBORDER 10
+    #define COLOR_INACTIVEBORDER 11
+    #define COLOR_APPWORKSPACE 12
+    #define COLOR_HIGHLIGHT 13
+    #define COLOR_HIGHLIGHTTEXT 14
+    #define COLOR_BTNFACE 15
+    #define COLOR_BTNSHADOW 16
+    #define COLOR_GRAYTEXT 17
+    #define COLOR_BTNTEXT 18
+    #define COLOR_INACTIVECAPTIONTEXT 19
+    #define COLOR_BTNHIGHLIGHT 20
+    #define COLOR_3DDKSHADOW 21
+    #define COLOR_3DLIGHT 22
+    #define COLOR_INFOTEXT 23
+    #define COLOR_INFOBK 24
+    #define COLOR_HOTLIGHT 26
+    #define COLOR_GRADIENTACTIVECAPTION 27
+    #define COLOR_GRADIENTINACTIVECAPTION 28
+    #define COLOR_MENUHILIGHT 29
+    #define COLOR_MENUBAR 30
+    #define COLOR_3DFACE COLOR_BTNFACE
+    #define CLR_INVALID 0xFFFFFFFF
+    
+    // Region combination modes (CombineRgn) and region types
+    #define RGN_AND 1
+    #define RGN_OR 2
+    #define RGN_XOR 3
+    #define RGN_DIFF 4
+    #define RGN_COPY 5
+    #define RGN_ERROR 0
+    #ifndef ERROR
+    #define ERROR RGN_ERROR
+    #endif
+    #define NULLREGION 1
+    #define SIMPLEREGION 2
+    #define COMPLEXREGION 3
+    
+    #define SW_HIDE 0
     #define SW_SHOW 5
     #define IDC_ARROW 32512
-    #define DT_SINGLELINE 0x00000020
+    #define DT_TOP 0x00000000
+    #define DT_LEFT 0x00000000
     #define DT_CENTER 0x00000001
+    #define DT_RIGHT 0x00000002
     #define DT_VCENTER 0x00000004
+    #define DT_BOTTOM 0x00000008
+    #define DT_WORDBREAK 0x00000010
+    #define DT_SINGLELINE 0x00000020
+    #define DT_EXPANDTABS 0x00000040
+    #define DT_NOCLIP 0x00000100
+    #define DT_CALCRECT 0x00000400
+    #define DT_END_ELLIPSIS 0x00008000
+    
+    // Font weights, character sets and families (CreateFont)
+    #define FW_DONTCARE 0
+    #define FW_THIN 100
+    #define FW_LIGHT 300
+    #define FW_NORMAL 400
+    #define FW_MEDIUM 500
+    #define FW_SEMIBOLD 600
+    #define FW_BOLD 700
+    #define FW_HEAVY 900
+    #define ANSI_CHARSET 0
+    #define DEFAULT_CHARSET 1
+    #define FF_DONTCARE 0x00
+    #define FF_ROMAN 0x10
+    #define FF_SWISS 0x20
+    #define FF_MODERN 0x30
+    
+    // Stock objects (GetStockObject)
+    #define WHITE_BRUSH 0
+    #define LTGRAY_BRUSH 1
+    #define GRAY_BRUSH 2
+    #define DKGRAY_BRUSH 3
+    #define BLACK_BRUSH 4
+    #define NULL_BRUSH 5
+    #define HOLLOW_BRUSH NULL_BRUSH
+    #define WHITE_PEN 6
+    #define BLACK_PEN 7
+    #define NULL_PEN 8
+    #define OEM_FIXED_FONT 10
+    #define ANSI_FIXED_FONT 11
+    #define ANSI_VAR_FONT 12
+    #define SYSTEM_FONT 13
+    #define DEVICE_DEFAULT_FONT 14
+    #define DEFAULT_PALETTE 15
+    #define SYSTEM_FIXED_FONT 16
+    #define DEFAULT_GUI_FONT 17
+    #define DC_BRUSH 18
+    #define DC_PEN 19
+    #define STOCK_LAST 19
+    
+    // Pen styles (CreatePen)
+    #define PS_SOLID 0
+    #define PS_DASH 1
+    #define PS_DOT 2
+    #define PS_DASHDOT 3
+    #define PS_DASHDOTDOT 4
+    #define PS_NULL 5
+    #define PS_INSIDEFRAME 6
+    
+    // Mouse key state flags (wParam of mouse messages)
+    #define MK_LBUTTON 0x0001
+    #define MK_RBUTTON 0x0002
+    #define MK_SHIFT 0x0004
+    #define MK_CONTROL 0x0008
+    #define MK_MBUTTON 0x0010
+    
+    // Word packing macros
+    #define LOWORD(l) ((unsigned short)(((uintptr_t)(l)) & 0xffff))
+    #define HIWORD(l) ((unsigned short)((((uintptr_t)(l)) >> 16) & 0xffff))
+    #define MAKELONG(a, b) ((long)(((unsigned short)(((uintptr_t)(a)) & 0xffff)) | ((unsigned long)((unsigned short)(((uintptr_t)(b)) & 0xffff))) << 16))
+    #define MAKELPARAM(l, h) ((LPARAM)(DWORD)MAKELONG(l, h))
+    #define GET_X_LPARAM(lp) ((int)(short)LOWORD(lp))
+    #define GET_Y_LPARAM(lp) ((int)(short)HIWORD(lp))
     
     // Resource handling macros
     #define MAKEINTRESOURCE(i) ((LPCSTR)((uintptr_t)((unsigned short)(i))))
     #define IS_INTRESOURCE(r) ((((uintptr_t)(r)) >> 16) == 0)
+    #define MAKEINTATOM(i) ((LPCSTR)((uintptr_t)((WORD)(i))))
 
     // Win32 structures
+    typedef LRESULT (*WNDPROC)(HWND, UINT, WPARAM, LPARAM);
+    typedef void (*TIMERPROC)(HWND, UINT, UINT_PTR, DWORD);
+    
     typedef struct {
         UINT cbSize;
         UINT style;
-        LRESULT (*lpfnWndProc)(HWND, UINT, WPARAM, LPARAM);
+        WNDPROC lpfnWndProc;
         int cbClsExtra;
         int cbWndExtra;
         HINSTANCE hInstance;
@@ -95,6 +260,83 @@
         int bottom;
     } RECT;
     
+    typedef struct {
+        int x;
+        int y;
+    } POINT;
+    
+    typedef struct {
+        int cx;
+        int cy;
+    } SIZE;
+    
+    typedef struct {
+        int tmHeight;
+        int tmAscent;
+        int tmDescent;
+        int tmInternalLeading;
+        int tmExternalLeading;
+        int tmAveCharWidth;
+        int tmMaxCharWidth;
+        int tmWeight;
+        int tmOverhang;
+        int tmDigitizedAspectX;
+        int tmDigitizedAspectY;
+        char tmFirstChar;
+        char tmLastChar;
+        char tmDefaultChar;
+        char tmBreakChar;
+        unsigned char tmItalic;
+        unsigned char tmUnderlined;
+        unsigned char tmStruckOut;
+        unsigned char tmPitchAndFamily;
+        unsigned char tmCharSet;
+    } TEXTMETRIC;
+    
+    // Bitmap structures use fixed-size fields so they match the BMP file layout
+    typedef struct {
+        uint32_t biSize;
+        int32_t biWidth;
+        int32_t biHeight;      // Positive for bottom-up DIBs, negative for top-down
+        uint16_t biPlanes;
+        uint16_t biBitCount;
+        uint32_t biCompression;
+        uint32_t biSizeImage;
+        int32_t biXPelsPerMeter;
+        int32_t biYPelsPerMeter;
+        uint32_t biClrUsed;
+        uint32_t biClrImportant;
+    } BITMAPINFOHEADER;
+    
+    typedef struct {
+        unsigned char rgbBlue;
+        unsigned char rgbGreen;
+        unsigned char rgbRed;
+        unsigned char rgbReserved;
+    } RGBQUAD;
+    
+    typedef struct {
+        BITMAPINFOHEADER bmiHeader;
+        RGBQUAD bmiColors[1];
+    } BITMAPINFO;
+    
+    typedef struct {
+        int32_t bmType;
+        int32_t bmWidth;
+        int32_t bmHeight;
+        int32_t bmWidthBytes;
+        uint16_t bmPlanes;
+        uint16_t bmBitsPixel;
+        void* bmBits;
+    } BITMAP;
+    
+    typedef struct {
+        unsigned char BlendOp;
+        unsigned char BlendFlags;
+        unsigned char SourceConstantAlpha;
+        unsigned char AlphaFormat;
+    } BLENDFUNCTION;
+    
     typedef struct {
         HDC hdc;
         BOOL fErase;
@@ -110,37 +352,161 @@
         WPARAM wParam;
         LPARAM lParam;
         DWORD time;
-        struct { int x, y; } pt;
+        POINT pt;
     } MSG;
     
     // Win32 API function declarations
     HWND CreateWindowEx(DWORD dwExStyle, LPCSTR lpClassName, LPCSTR lpWindowName,
                        DWORD dwStyle, int X, int Y, int nWidth, int nHeight,
                        HWND hWndParent, void* hMenu, HINSTANCE hInstance, LPVOID lpParam);
+    HWND CreateWindowExW(DWORD dwExStyle, LPCWSTR lpClassName, LPCWSTR lpWindowName,
+                        DWORD dwStyle, int X, int Y, int nWidth, int nHeight,
+                        HWND hWndParent, void* hMenu, HINSTANCE hInstance, LPVOID lpParam);
     
     BOOL ShowWindow(HWND hWnd, int nCmdShow);
     BOOL UpdateWindow(HWND hWnd);
     BOOL DestroyWindow(HWND hWnd);
     BOOL InvalidateRect(HWND hWnd, const RECT* lpRect, BOOL bErase);
+    BOOL InvalidateRgn(HWND hWnd, HRGN hRgn, BOOL bErase);
+    BOOL ValidateRect(HWND hWnd, const RECT* lpRect);
+    BOOL GetUpdateRect(HWND hWnd, RECT* lpRect, BOOL bErase);
     BOOL GetClientRect(HWND hWnd, RECT* lpRect);
+    BOOL GetWindowRect(HWND hWnd, RECT* lpRect);
+    BOOL ClientToScreen(HWND hWnd, POINT* lpPoint);
+    BOOL ScreenToClient(HWND hWnd, POINT* lpPoint);
     BOOL SetWindowText(HWND hWnd, LPCSTR lpString);
+    BOOL SetWindowTextW(HWND hWnd, LPCWSTR lpString);
+    int GetWindowText(HWND hWnd, LPSTR lpString, int nMaxCount);
+    int GetWindowTextW(HWND hWnd, LPWSTR lpString, int nMaxCount);
+    
+    // Window tree and placement
+    #define GW_HWNDFIRST 0
+    #define GW_HWNDLAST 1
+    #define GW_HWNDNEXT 2
+    #define GW_HWNDPREV 3
+    #define GW_CHILD 5
+    #define HWND_TOP ((HWND)0)
+    #define HWND_BOTTOM ((HWND)1)
+    #define HWND_TOPMOST ((HWND)-1)
+    #define HWND_NOTOPMOST ((HWND)-2)
+    #define SWP_NOSIZE 0x0001
+    #define SWP_NOMOVE 0x0002
+    #define SWP_NOZORDER 0x0004
+    #define SWP_NOREDRAW 0x0008
+    #define SWP_NOACTIVATE 0x0010
+    #define SWP_SHOWWINDOW 0x0040
+    #define SWP_HIDEWINDOW 0x0080
+    #define SIZE_RESTORED 0
+    #define CWP_ALL 0x0000
+    #define CWP_SKIPINVISIBLE 0x0001
+    #define CWP_SKIPDISABLED 0x0002
+    HWND GetParent(HWND hWnd);
+    HWND GetWindow(HWND hWnd, UINT uCmd);
+    BOOL IsWindowVisible(HWND hWnd);
+    BOOL SetWindowPos(HWND hWnd, HWND hWndInsertAfter, int X, int Y, int cx, int cy, UINT uFlags);
+    BOOL MoveWindow(HWND hWnd, int X, int Y, int nWidth, int nHeight, BOOL bRepaint);
+    BOOL GetCursorPos(POINT* lpPoint);
+    HWND WindowFromPoint(POINT Point);
+    HWND ChildWindowFromPoint(HWND hWndParent, POINT Point);
+    HWND ChildWindowFromPointEx(HWND hwnd, POINT pt, UINT flags);
+    
+    BOOL SetRect(RECT* lprc, int xLeft, int yTop, int xRight, int yBottom);
+    BOOL SetRectEmpty(RECT* lprc);
+    BOOL CopyRect(RECT* lprcDst, const RECT* lprcSrc);
+    BOOL IsRectEmpty(const RECT* lprc);
+    BOOL EqualRect(const RECT* lprc1, const RECT* lprc2);
+    BOOL PtInRect(const RECT* lprc, POINT pt);
+    BOOL OffsetRect(RECT* lprc, int dx, int dy);
+    BOOL InflateRect(RECT* lprc, int dx, int dy);
+    BOOL IntersectRect(RECT* lprcDst, const RECT* lprcSrc1, const RECT* lprcSrc2);
+    BOOL UnionRect(RECT* lprcDst, const RECT* lprcSrc1, const RECT* lprcSrc2);
+    BOOL SubtractRect(RECT* lprcDst, const RECT* lprcSrc1, const RECT* lprcSrc2);
     
     HINSTANCE GetModuleHandle(LPCSTR lpModuleName);
     void* LoadCursor(HINSTANCE hInstance, LPCSTR lpCursorName);
-    BOOL RegisterClassEx(const WNDCLASSEX* lpWndClass);
+    ATOM RegisterClassEx(const WNDCLASSEX* lpWndClass);
+    BOOL GetClassInfoEx(HINSTANCE hInstance, LPCSTR lpszClass, WNDCLASSEX* lpwcx);
+    int GetClassName(HWND hWnd, LPSTR lpClassName, int nMaxCount);
+    UINT RegisterWindowMessage(LPCSTR lpString);
+    
+    // GetWindowLongPtr/SetWindowLongPtr indices; offsets from 0 up address
+    // the cbWndExtra bytes
+    #define GWLP_WNDPROC (-4)
+    #define GWLP_HINSTANCE (-6)
+    #define GWLP_ID (-12)
+    #define GWL_STYLE (-16)
+    #define GWLP_USERDATA (-21)
+    LONG_PTR GetWindowLongPtr(HWND hWnd, int nIndex);
+    LONG_PTR SetWindowLongPtr(HWND hWnd, int nIndex, LONG_PTR dwNewLong);
+    
+    ATOM GlobalAddAtom(LPCSTR lpString);
+    ATOM GlobalFindAtom(LPCSTR lpString);
+    ATOM GlobalDeleteAtom(ATOM nAtom);
+    UINT GlobalGetAtomName(ATOM nAtom, LPSTR lpBuffer, int nSize);
+    ATOM AddAtom(LPCSTR lpString);
+    ATOM FindAtom(LPCSTR lpString);
+    ATOM DeleteAtom(ATOM nAtom);
+    UINT GetAtomName(ATOM nAtom, LPSTR lpBuffer, int nSize);
     
     BOOL GetMessage(MSG* lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax);
+    BOOL PeekMessage(MSG* lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg);
+    BOOL WaitMessage(void);
+    BOOL PostMessage(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
+    LRESULT SendMessage(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
     BOOL TranslateMessage(const MSG* lpMsg);
     LRESULT DispatchMessage(const MSG* lpMsg);
     void PostQuitMessage(int nExitCode);
+    BOOL PostThreadMessage(DWORD idThread, UINT Msg, WPARAM wParam, LPARAM lParam);
+    DWORD GetWindowThreadProcessId(HWND hWnd, LPDWORD lpdwProcessId);
+    DWORD GetCurrentThreadId(void);
+    DWORD GetCurrentProcessId(void);
+    
+    UINT_PTR SetTimer(HWND hWnd, UINT_PTR nIDEvent, UINT uElapse, TIMERPROC lpTimerFunc);
+    BOOL KillTimer(HWND hWnd, UINT_PTR uIDEvent);
+    DWORD GetTickCount(void);
     
     HDC BeginPaint(HWND hWnd, PAINTSTRUCT* lpPaint);
     BOOL EndPaint(HWND hWnd, const PAINTSTRUCT* lpPaint);
+    HDC GetDC(HWND hWnd);
+    int ReleaseDC(HWND hWnd, HDC hDC);
     
     int DrawText(HDC hdc, LPCSTR lpchText, int cchText, RECT* lpRect, UINT format);
     BOOL TextOut(HDC hdc, int x, int y, LPCSTR lpString, int c);
+    int DrawTextW(HDC hdc, LPCWSTR lpchText, int cchText, RECT* lpRect, UINT format);
+    BOOL TextOutW(HDC hdc, int x, int y, LPCWSTR lpString, int c);
     BOOL Rectangle(HDC hdc, int left, int top, int right, int bottom);
     BOOL FillRect(HDC hdc, const RECT* lpRect, HBRUSH hBrush);
+    COLORREF SetPixel(HDC hdc, int x, int y, COLORREF color);
+    COLORREF GetPixel(HDC hdc, int x, int y);
+    BOOL MoveToEx(HDC hdc, int x, int y, POINT* lppt);
+    BOOL LineTo(HDC hdc, int x, int y);
+    
+    HDC CreateCompatibleDC(HDC hdc);
+    BOOL DeleteDC(HDC hdc);
+    HBITMAP CreateCompatibleBitmap(HDC hdc, int cx, int cy);
+    HBITMAP CreateDIBSection(HDC hdc, const BITMAPINFO* pbmi, UINT usage, void** ppvBits,
+                             HANDLE hSection, DWORD offset);
+    BOOL BitBlt(HDC hdc, int x, int y, int cx, int cy, HDC hdcSrc, int x1, int y1, DWORD rop);
+    BOOL StretchBlt(HDC hdcDest, int xDest, int yDest, int wDest, int hDest,
+                    HDC hdcSrc, int xSrc, int ySrc, int wSrc, int hSrc, DWORD rop);
+    BOOL AlphaBlend(HDC hdcDest, int xoriginDest, int yoriginDest, int wDest, int hDest,
+                    HDC hdcSrc, int xoriginSrc, int yoriginSrc, int wSrc, int hSrc, BLENDFUNCTION ftn);
+    int SetStretchBltMode(HDC hdc, int mode);
+    
+    HRGN CreateRectRgn(int x1, int y1, int x2, int y2);
+    HRGN CreateRectRgnIndirect(const RECT* lprect);
+    int CombineRgn(HRGN hrgnDst, HRGN hrgnSrc1, HRGN hrgnSrc2, int iMode);
+    int OffsetRgn(HRGN hrgn, int x, int y);
+    int GetRgnBox(HRGN hrgn, RECT* lprc);
+    BOOL PtInRegion(HRGN hrgn, int x, int y);
+    int SelectClipRgn(HDC hdc, HRGN hrgn);
+    int GetClipBox(HDC hdc, RECT* lprect);
+    
+    DWORD GetSysColor(int nIndex);
+    HBRUSH GetSysColorBrush(int nIndex);
+    HGDIOBJ GetStockObject(int i);
+    HBRUSH CreateSolidBrush(COLORREF color);
+    HPEN CreatePen(int iStyle, int cWidth, COLORREF color);
     
     HFONT CreateFont(int cHeight, int cWidth, int cEscapement, int cOrientation,
                     int cWeight, DWORD bItalic, DWORD bUnderline, DWORD bStrikeOut,
@@ -149,13 +515,119 @@
     
     HGDIOBJ SelectObject(HDC hdc, HGDIOBJ h);
     BOOL DeleteObject(HGDIOBJ ho);
+    int GetObject(HANDLE h, int c, LPVOID pv);
     
     DWORD SetTextColor(HDC hdc, DWORD color);
+    COLORREF SetBkColor(HDC hdc, COLORREF color);
     int SetBkMode(HDC hdc, int mode);
     
+    // Drawing calls on a BeginPaint DC are batched until EndPaint, GdiFlush,
+    // or the thread's batch limit (default 256 calls; 1 draws every call
+    // right away, 0 restores the default)
+    BOOL GdiFlush(void);
+    DWORD GdiSetBatchLimit(DWORD dw);
+    DWORD GdiGetBatchLimit(void);
+    
+    // Multiverse32 extensions (no Win32 equivalent)
+    
+    // Name of the shared memory segment a window's frames are exported to
+    // when MULTIVERSE32_FRAMEBUFFER is set: a shm_open name, or a /proc path
+    // for memfd segments. The layout is described in win32_framebuffer.h.
+    // Returns FALSE if the window is not exported or has not drawn yet.
+    // Waits for the window's last finished frame to be presented.
+    BOOL Mv32GetFramebufferName(HWND hWnd, char* name, int size);
+
+    // Presentation counters of a top-level window (or a child's top-level
+    // window), kept by the present thread
+    typedef struct {
+        unsigned long long framesFinished;  // Paints handed to the present thread
+        unsigned long long framesPresented;
+        unsigned long long framesDropped;   // Finished but replaced before being presented
+        unsigned long long lastFrameNs;     // Time between the last two presents
+        unsigned long long maxFrameNs;
+        unsigned long long lastLatencyNs;   // From the EndPaint of the oldest change in the last
+                                            // presented frame to its present
+        unsigned long long lastTilesCompared; // Tiles of the last presented frame inside its
+                                              // damaged area, hashed and compared
+        unsigned long long lastTilesChanged;  // Those that differed from the frame shown before
+        unsigned long long lastBytesPresented; // Pixels of the changed tiles, in bytes
+        unsigned long long bytesPresented;     // The same over all presents
+    } MV32_PRESENT_STATS;
+
+    // Returns FALSE if the window does not exist or has not drawn yet
+    BOOL Mv32GetPresentStats(HWND hWnd, MV32_PRESENT_STATS* stats);
+
+    // Commands waiting in a DC's GDI batch. State changes are only recorded
+    // ahead of the drawing that uses them, and only when they differ from
+    // the state the batch already holds.
+    #define MV32_GDI_SET_TEXT_COLOR 1 // value: color
+    #define MV32_GDI_SET_BK_COLOR 2   // value: color
+    #define MV32_GDI_SET_BK_MODE 3    // value: mode
+    #define MV32_GDI_SET_FONT 4       // object: font, NULL for the stock font
+    #define MV32_GDI_SET_PEN 5        // value: color, rect.left: width, length: 1 for PS_NULL
+    #define MV32_GDI_SET_BRUSH 6      // value: color, length: 1 for a hollow brush
+    #define MV32_GDI_FILL_RECT 7      // value: color, rect
+    #define MV32_GDI_RECTANGLE 8      // rect
+    #define MV32_GDI_LINE 9           // rect: from (left, top) to (right, bottom)
+    #define MV32_GDI_SET_PIXEL 10     // value: color, rect.left/top: position
+    #define MV32_GDI_TEXT_OUT 11      // rect.left/top: position, text
+    #define MV32_GDI_DRAW_TEXT 12     // value: format, rect, text
+    typedef struct {
+        UINT op;           // MV32_GDI_*
+        DWORD value;
+        RECT rect;
+        const char* text;  // UTF-8, valid until the batch is flushed
+        int length;        // Bytes of text
+        HGDIOBJ object;
+    } MV32_GDI_COMMAND;
+
+    // Copy up to count of the commands waiting in a DC's batch, oldest
+    // first. Returns how many are waiting, or -1 for an invalid DC.
+    int Mv32GetGdiBatch(HDC hdc, MV32_GDI_COMMAND* commands, int count);
+
+    // Draw flushed GDI batches that cover a large area tile by tile on up to
+    // threads threads; 0 uses one per core and 1 draws on the flushing
+    // thread. The pixels do not depend on the count. The initial count comes
+    // from MULTIVERSE32_RASTER_THREADS, 1 if unset. Returns the previous one.
+    int Mv32SetRasterThreads(int threads);
+    
+    BOOL GetTextExtentPoint32(HDC hdc, LPCSTR lpString, int c, SIZE* lpSize);
+    BOOL GetTextMetrics(HDC hdc, TEXTMETRIC* lptm);
+    
     LRESULT DefWindowProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
     
     #define TRANSPARENT 1
+    #define OPAQUE 2
+    
+    // Raster operation codes (BitBlt, StretchBlt)
+    #define SRCCOPY 0x00CC0020
+    #define SRCPAINT 0x00EE0086
+    #define SRCAND 0x008800C6
+    #define SRCINVERT 0x00660046
+    #define SRCERASE 0x00440328
+    #define NOTSRCCOPY 0x00330008
+    #define NOTSRCERASE 0x001100A6
+    #define MERGEPAINT 0x00BB0226
+    #define PATCOPY 0x00F00021
+    #define DSTINVERT 0x00550009
+    #define BLACKNESS 0x00000042
+    #define WHITENESS 0x00FF0062
+    
+    // StretchBlt modes
+    #define BLACKONWHITE 1
+    #define WHITEONBLACK 2
+    #define COLORONCOLOR 3
+    #define HALFTONE 4
+    #define STRETCH_ANDSCANS BLACKONWHITE
+    #define STRETCH_ORSCANS WHITEONBLACK
+    #define STRETCH_DELETESCANS COLORONCOLOR
+    #define STRETCH_HALFTONE HALFTONE
+    
+    // DIB formats and AlphaBlend flags
+    #define BI_RGB 0
+    #define DIB_RGB_COLORS 0
+    #define AC_SRC_OVER 0x00
+    #define AC_SRC_ALPHA 0x01
     #define RGB(r,g,b) ((DWORD)(((unsigned char)(r)|((unsigned short)((unsigned char)(g))<<8))|(((DWORD)(unsigned char)(b))<<16)))
     
     // Win32 callback function type
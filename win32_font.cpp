@@ -0,0 +1,424 @@
+// win32_font.cpp - Built-in font and glyph cache for the Win32 API Compatibility Layer
+// Glyphs are rasterized once per (font, codepoint) into a shared coverage
+// atlas; drawing text is then a run of blends from the atlas.
+
+#ifndef _WIN32
+
+#include "win32_font.h"
+#include "win32_unicode.h"
+
+#include <math.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+// ==============================================================================
+// BUILT-IN BITMAP FONT
+// ==============================================================================
+
+// Public domain 8x8 font (font8x8_basic, U+0020..U+007E). One byte per row,
+// top row first, bit 0 is the leftmost pixel. Row 7 holds descenders.
+static const uint8_t g_font8x8[95][8] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ' '
+    { 0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00 }, // '!'
+    { 0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '"'
+    { 0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00 }, // '#'
+    { 0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00 }, // '$'
+    { 0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00 }, // '%'
+    { 0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00 }, // '&'
+    { 0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '''
+    { 0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00 }, // '('
+    { 0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00 }, // ')'
+    { 0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00 }, // '*'
+    { 0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00 }, // '+'
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06 }, // ','
+    { 0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00 }, // '-'
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // '.'
+    { 0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00 }, // '/'
+    { 0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00 }, // '0'
+    { 0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00 }, // '1'
+    { 0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00 }, // '2'
+    { 0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00 }, // '3'
+    { 0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00 }, // '4'
+    { 0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00 }, // '5'
+    { 0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00 }, // '6'
+    { 0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00 }, // '7'
+    { 0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00 }, // '8'
+    { 0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00 }, // '9'
+    { 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // ':'
+    { 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06 }, // ';'
+    { 0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00 }, // '<'
+    { 0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00 }, // '='
+    { 0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00 }, // '>'
+    { 0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00 }, // '?'
+    { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00 }, // '@'
+    { 0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00 }, // 'A'
+    { 0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00 }, // 'B'
+    { 0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00 }, // 'C'
+    { 0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00 }, // 'D'
+    { 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00 }, // 'E'
+    { 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00 }, // 'F'
+    { 0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00 }, // 'G'
+    { 0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00 }, // 'H'
+    { 0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'I'
+    { 0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00 }, // 'J'
+    { 0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00 }, // 'K'
+    { 0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00 }, // 'L'
+    { 0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00 }, // 'M'
+    { 0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00 }, // 'N'
+    { 0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00 }, // 'O'
+    { 0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00 }, // 'P'
+    { 0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00 }, // 'Q'
+    { 0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00 }, // 'R'
+    { 0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00 }, // 'S'
+    { 0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'T'
+    { 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00 }, // 'U'
+    { 0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 }, // 'V'
+    { 0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00 }, // 'W'
+    { 0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00 }, // 'X'
+    { 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00 }, // 'Y'
+    { 0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00 }, // 'Z'
+    { 0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00 }, // '['
+    { 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00 }, // '\'
+    { 0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00 }, // ']'
+    { 0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00 }, // '^'
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF }, // '_'
+    { 0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '`'
+    { 0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00 }, // 'a'
+    { 0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00 }, // 'b'
+    { 0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00 }, // 'c'
+    { 0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00 }, // 'd'
+    { 0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00 }, // 'e'
+    { 0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00 }, // 'f'
+    { 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F }, // 'g'
+    { 0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00 }, // 'h'
+    { 0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'i'
+    { 0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E }, // 'j'
+    { 0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00 }, // 'k'
+    { 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'l'
+    { 0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00 }, // 'm'
+    { 0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00 }, // 'n'
+    { 0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00 }, // 'o'
+    { 0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F }, // 'p'
+    { 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78 }, // 'q'
+    { 0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00 }, // 'r'
+    { 0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00 }, // 's'
+    { 0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00 }, // 't'
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00 }, // 'u'
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 }, // 'v'
+    { 0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00 }, // 'w'
+    { 0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00 }, // 'x'
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F }, // 'y'
+    { 0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00 }, // 'z'
+    { 0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00 }, // '{'
+    { 0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00 }, // '|'
+    { 0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00 }, // '}'
+    { 0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '~'
+};
+
+// Drawn for codepoints the font does not cover, as Windows draws a box
+static const uint8_t g_missingGlyph[8] = { 0x00, 0x3F, 0x21, 0x21, 0x21, 0x21, 0x3F, 0x00 };
+
+static const int kMaxCellSize = 255;
+
+static const uint8_t* GlyphBits(uint32_t codepoint) {
+    if (codepoint >= 0x20 && codepoint <= 0x7E) {
+        return g_font8x8[codepoint - 0x20];
+    }
+    return g_missingGlyph;
+}
+
+// ==============================================================================
+// GLYPH ATLAS
+// ==============================================================================
+
+struct Glyph {
+    uint16_t x, y;         // Position of the coverage mask in the atlas
+    int16_t width, height; // Zero for blank glyphs
+    int16_t offsetX;       // Mask origin relative to the pen position
+};
+
+// 8-bit coverage atlas shared by all fonts, packed in shelves. When it fills
+// up it is cleared and refilled on demand; the epoch tells fonts that their
+// cached glyph indices are stale.
+class GlyphAtlas {
+public:
+    static const int kSize = 512;
+
+    GlyphAtlas() : shelfX_(0), shelfY_(0), shelfHeight_(0), epoch_(1) {}
+
+    const Glyph& GetGlyph(int32_t index) const { return glyphs_[index]; }
+    const uint8_t* Row(const Glyph& glyph, int row) const {
+        return pixels_.get() + (size_t)(glyph.y + row) * kSize + glyph.x;
+    }
+
+    // The glyph's index if it is in the atlas, -1 if it must be rasterized.
+    // Only reads, so any number of threads may call it together.
+    int32_t Lookup(const FontData& font, uint32_t codepoint) const {
+        if (codepoint < 128) {
+            return font.asciiEpoch == epoch_ ? font.asciiGlyphs[codepoint] : -1;
+        }
+        auto it = index_.find(((uint64_t)font.id << 32) | codepoint);
+        return it != index_.end() ? it->second : -1;
+    }
+
+    int32_t Find(FontData& font, uint32_t codepoint) {
+        SyncFont(font);
+        if (codepoint < 128) {
+            if (font.asciiGlyphs[codepoint] < 0) {
+                int32_t glyph = Rasterize(font, codepoint);
+                SyncFont(font);
+                font.asciiGlyphs[codepoint] = glyph;
+            }
+            return font.asciiGlyphs[codepoint];
+        }
+        uint64_t key = ((uint64_t)font.id << 32) | codepoint;
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            return it->second;
+        }
+        int32_t glyph = Rasterize(font, codepoint);
+        index_[key] = glyph;
+        return glyph;
+    }
+
+private:
+    // Drop a font's cached indices if the atlas was reset since it last drew
+    void SyncFont(FontData& font) {
+        if (font.asciiEpoch != epoch_) {
+            for (int i = 0; i < 128; ++i) {
+                font.asciiGlyphs[i] = -1;
+            }
+            font.asciiEpoch = epoch_;
+        }
+    }
+
+    int32_t Rasterize(FontData& font, uint32_t codepoint);
+    void Reserve(int width, int height, int* x, int* y);
+
+    std::unique_ptr<uint8_t[]> pixels_;
+    std::vector<Glyph> glyphs_;
+    std::unordered_map<uint64_t, int32_t> index_; // Non-ASCII glyphs by (font id, codepoint)
+    int shelfX_, shelfY_, shelfHeight_;
+    uint32_t epoch_;
+};
+
+// The atlas is shared by every thread that draws text. Runs look glyphs up
+// and blend them holding the lock shared, so text on several threads draws
+// in parallel. A missing glyph is rasterized holding it exclusively, since
+// that may reset the atlas under the other runs.
+static GlyphAtlas g_glyphAtlas;
+static std::shared_mutex g_glyphAtlasLock;
+static std::atomic<uint32_t> g_nextFontId(1);
+
+void GlyphAtlas::Reserve(int width, int height, int* x, int* y) {
+    if (!pixels_) {
+        pixels_.reset(new uint8_t[(size_t)kSize * kSize]);
+    }
+    if (shelfX_ + width > kSize) {
+        shelfY_ += shelfHeight_;
+        shelfX_ = 0;
+        shelfHeight_ = 0;
+    }
+    if (shelfY_ + height > kSize) {
+        // Full: start over and let every font refill its glyphs
+        glyphs_.clear();
+        index_.clear();
+        shelfX_ = shelfY_ = shelfHeight_ = 0;
+        ++epoch_;
+    }
+    *x = shelfX_;
+    *y = shelfY_;
+    shelfX_ += width;
+    if (height > shelfHeight_) {
+        shelfHeight_ = height;
+    }
+}
+
+// Scale the 8x8 bitmap to the font's cell by area coverage, so integer
+// scales stay crisp and fractional ones get smooth edges
+int32_t GlyphAtlas::Rasterize(FontData& font, uint32_t codepoint) {
+    const uint8_t* source = GlyphBits(codepoint);
+    uint8_t bits[8];
+    for (int row = 0; row < 8; ++row) {
+        bits[row] = source[row];
+        if (font.weight >= FW_BOLD) {
+            bits[row] |= (uint8_t)(source[row] << 1);
+        }
+    }
+
+    int cellWidth = font.advance;
+    int cellHeight = font.height;
+    // Italic shears rows right above the baseline and left below it
+    int minShift = 0;
+    int maxShift = 0;
+    if (font.italic) {
+        minShift = (int)floor((font.ascent - cellHeight) / 4.0);
+        maxShift = font.ascent / 4;
+    }
+    int width = cellWidth + maxShift - minShift;
+
+    Glyph glyph = {};
+    bool blank = true;
+    for (int row = 0; row < 8; ++row) {
+        blank = blank && bits[row] == 0;
+    }
+    if (!blank) {
+        int x, y;
+        Reserve(width, cellHeight, &x, &y);
+        glyph.x = (uint16_t)x;
+        glyph.y = (uint16_t)y;
+        glyph.width = (int16_t)width;
+        glyph.height = (int16_t)cellHeight;
+        glyph.offsetX = (int16_t)minShift;
+
+        double sx = 8.0 / cellWidth;
+        double sy = 8.0 / cellHeight;
+        for (int dy = 0; dy < cellHeight; ++dy) {
+            uint8_t* out = pixels_.get() + (size_t)(y + dy) * kSize + x;
+            memset(out, 0, width);
+            int shift = font.italic ? (int)floor((font.ascent - dy) / 4.0) - minShift : 0;
+            double y0 = dy * sy, y1 = (dy + 1) * sy;
+            for (int dx = 0; dx < cellWidth; ++dx) {
+                double x0 = dx * sx, x1 = (dx + 1) * sx;
+                double covered = 0.0;
+                for (int row = (int)y0; row < 8 && row < y1; ++row) {
+                    double h = fmin(y1, row + 1.0) - fmax(y0, (double)row);
+                    if (h <= 0.0 || bits[row] == 0) {
+                        continue;
+                    }
+                    for (int col = (int)x0; col < 8 && col < x1; ++col) {
+                        if (bits[row] & (1u << col)) {
+                            covered += h * (fmin(x1, col + 1.0) - fmax(x0, (double)col));
+                        }
+                    }
+                }
+                out[dx + shift] = (uint8_t)lrint(covered / (sx * sy) * 255.0);
+            }
+        }
+    }
+
+    glyphs_.push_back(glyph);
+    return (int32_t)glyphs_.size() - 1;
+}
+
+// ==============================================================================
+// FONT INTERFACE
+// ==============================================================================
+
+void InitFontData(FontData* font, int height, int width, int weight,
+                  bool italic, bool underline, bool strikeOut) {
+    if (height < 0) {
+        height = -height;
+    }
+    if (height == 0) {
+        height = 16; // Matches the height of the Windows system font
+    }
+    if (height > kMaxCellSize) {
+        height = kMaxCellSize;
+    }
+    // The bitmap font is square; a nonzero width stretches it
+    if (width <= 0) {
+        width = height;
+    }
+    if (width > kMaxCellSize) {
+        width = kMaxCellSize;
+    }
+
+    font->id = g_nextFontId++;
+    font->height = height;
+    font->ascent = (height * 7 + 4) / 8; // Row 7 of the bitmap is the descender
+    font->advance = width;
+    font->weight = (weight == FW_DONTCARE) ? FW_NORMAL : weight;
+    font->italic = italic;
+    font->underline = underline;
+    font->strikeOut = strikeOut;
+    font->overhang = italic ? font->ascent / 4 : 0;
+    font->asciiEpoch = 0;
+}
+
+void GetFontTextMetrics(const FontData& font, TEXTMETRIC* metrics) {
+    memset(metrics, 0, sizeof(*metrics));
+    metrics->tmHeight = font.height;
+    metrics->tmAscent = font.ascent;
+    metrics->tmDescent = font.height - font.ascent;
+    metrics->tmAveCharWidth = font.advance;
+    metrics->tmMaxCharWidth = font.advance;
+    metrics->tmWeight = font.weight;
+    metrics->tmOverhang = font.overhang;
+    metrics->tmDigitizedAspectX = 96;
+    metrics->tmDigitizedAspectY = 96;
+    metrics->tmFirstChar = 0x20;
+    metrics->tmLastChar = 0x7E;
+    metrics->tmDefaultChar = '?';
+    metrics->tmBreakChar = ' ';
+    metrics->tmItalic = font.italic ? 1 : 0;
+    metrics->tmUnderlined = font.underline ? 1 : 0;
+    metrics->tmStruckOut = font.strikeOut ? 1 : 0;
+    metrics->tmPitchAndFamily = FF_MODERN; // Fixed pitch: TMPF_FIXED_PITCH is clear
+    metrics->tmCharSet = ANSI_CHARSET;
+}
+
+int MeasureTextWidth(const FontData& font, const char* text, int length) {
+    // Every glyph shares the cell advance; only the character count matters
+    const unsigned char* p = (const unsigned char*)text;
+    const unsigned char* end = p + length;
+    int count = 0;
+    while (p < end) {
+        if (*p < 0x80) {
+            ++p;
+        } else {
+            NextCodepoint(p, end);
+        }
+        ++count;
+    }
+    return count * font.advance;
+}
+
+int DrawGlyphRun(const Surface& surface, const RECT& clip, FontData& font,
+                 const char* text, int length, int x, int y, uint32_t pixel) {
+    const unsigned char* p = (const unsigned char*)text;
+    const unsigned char* end = p + length;
+    int penX = x;
+    bool rowsVisible = y < clip.bottom && y + font.height > clip.top;
+    std::shared_lock<std::shared_mutex> lock(g_glyphAtlasLock);
+    while (p < end) {
+        uint32_t codepoint = NextCodepoint(p, end);
+        int glyphX = penX;
+        penX += font.advance;
+        if (!rowsVisible || glyphX + font.advance + font.overhang <= clip.left || glyphX - font.overhang >= clip.right) {
+            continue;
+        }
+
+        int32_t index;
+        while ((index = g_glyphAtlas.Lookup(font, codepoint)) < 0) {
+            // The glyphs already blended are done; a reset while the lock is
+            // released only sends this one back to the atlas
+            lock.unlock();
+            {
+                std::lock_guard<std::shared_mutex> exclusive(g_glyphAtlasLock);
+                g_glyphAtlas.Find(font, codepoint);
+            }
+            lock.lock();
+        }
+        const Glyph& glyph = g_glyphAtlas.GetGlyph(index);
+        if (glyph.width == 0) {
+            continue;
+        }
+        int left = glyphX + glyph.offsetX;
+        int x0 = (left > clip.left) ? left : clip.left;
+        int x1 = (left + glyph.width < clip.right) ? left + glyph.width : clip.right;
+        int y0 = (y > clip.top) ? y : clip.top;
+        int y1 = (y + glyph.height < clip.bottom) ? y + glyph.height : clip.bottom;
+        for (int row = y0; row < y1; ++row) {
+            BlendCoverageSpan(surface.Row(row) + x0, g_glyphAtlas.Row(glyph, row - y) + (x0 - left), x1 - x0, pixel);
+        }
+    }
+    return penX - x;
+}
+
+#endif // !_WIN32
@@ -0,0 +1,54 @@
+// win32_font.h - Built-in font and glyph cache for the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+#pragma once
+
+#include "win32_compat.h"
+#include "win32_raster.h"
+
+#include <stdint.h>
+
+// Logical font created by CreateFont. Glyphs come from a built-in 8x8 bitmap
+// font scaled to the requested cell size, so every font is fixed pitch.
+struct FontData {
+    uint32_t id;       // Unique per font, keys its glyphs in the atlas
+    int height;        // Cell height (tmHeight)
+    int ascent;        // Rows above the baseline
+    int advance;       // Cell width, the advance of every character
+    int weight;
+    bool italic;
+    bool underline;
+    bool strikeOut;
+    int overhang;      // Extra width of italic glyphs past their cell
+
+    // Atlas indices of the ASCII glyphs, so the common case needs no hash
+    // lookup. Valid while asciiEpoch matches the atlas epoch.
+    int32_t asciiGlyphs[128];
+    uint32_t asciiEpoch;
+
+    FontData() : id(0), height(0), ascent(0), advance(0), weight(0), italic(false), underline(false),
+                 strikeOut(false), overhang(0), asciiEpoch(0) {}
+};
+
+// Fill in a font for CreateFont parameters. Negative heights request a
+// character height, positive ones a cell height; the built-in font has no
+// internal leading so both map to the same cell.
+void InitFontData(FontData* font, int height, int width, int weight,
+                  bool italic, bool underline, bool strikeOut);
+
+void GetFontTextMetrics(const FontData& font, TEXTMETRIC* metrics);
+
+// Pen advance of one codepoint; the built-in font is fixed pitch
+inline int GlyphAdvance(const FontData& font, uint32_t codepoint) {
+    (void)codepoint;
+    return font.advance;
+}
+
+// Width of a UTF-8 string in pixels
+int MeasureTextWidth(const FontData& font, const char* text, int length);
+
+// Draw a UTF-8 string with its cell's top-left corner at (x, y), blending
+// glyph coverage from the atlas with pixel. Glyphs are rasterized the first
+// time a font uses them and blitted from the atlas afterwards.
+// Returns the pen advance.
+int DrawGlyphRun(const Surface& surface, const RECT& clip, FontData& font,
+                 const char* text, int length, int x, int y, uint32_t pixel);
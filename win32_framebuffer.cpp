@@ -0,0 +1,208 @@
+// win32_framebuffer.cpp - Shared-memory framebuffer export for the Win32 API Compatibility Layer
+// Each exported window's frames are copied into a shared memory segment
+// that other processes can map, so they are observable without a display.
+
+#ifndef _WIN32
+
+#define MULTIVERSE32_FRAMEBUFFER_WRITER
+#include "win32_framebuffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+
+// Pixels start on a cache line boundary after the header
+static const size_t kPixelOffset = (sizeof(FramebufferHeader) + 63) & ~(size_t)63;
+
+enum ExportMode {
+    kExportOff,
+    kExportShm,    // Named POSIX shared memory: /dev/shm/multiverse32.<pid>.<n>
+    kExportMemfd,  // Anonymous memfd, reachable as /proc/<pid>/fd/<fd>
+};
+
+// MULTIVERSE32_FRAMEBUFFER=1 (or shm) exports through shm_open, =memfd
+// through memfd_create where available; unset, empty or 0 disables export
+static ExportMode GetExportMode() {
+    static const ExportMode mode = [] {
+        const char* value = getenv("MULTIVERSE32_FRAMEBUFFER");
+        if (!value || !*value || strcmp(value, "0") == 0) {
+            return kExportOff;
+        }
+#ifdef __linux__
+        if (strcmp(value, "memfd") == 0) {
+            return kExportMemfd;
+        }
+#endif
+        return kExportShm;
+    }();
+    return mode;
+}
+
+static uint64_t MonotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+SharedFramebuffer::SharedFramebuffer()
+    : header_(nullptr), pixels_(nullptr), mappingSize_(0), fd_(-1), drawDepth_(0), named_(false) {
+    name_[0] = '\0';
+}
+
+SharedFramebuffer::~SharedFramebuffer() {
+    Release();
+}
+
+bool SharedFramebuffer::Enabled() {
+    return GetExportMode() != kExportOff;
+}
+
+void SharedFramebuffer::Release() {
+    if (header_) {
+        munmap(header_, mappingSize_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+    if (named_) {
+        shm_unlink(name_);
+    }
+    header_ = nullptr;
+    pixels_ = nullptr;
+    mappingSize_ = 0;
+    fd_ = -1;
+    drawDepth_ = 0;
+    named_ = false;
+    name_[0] = '\0';
+}
+
+bool SharedFramebuffer::Resize(int width, int height, const char* title) {
+    if (width < 0 || height < 0) {
+        return false;
+    }
+    if (fd_ < 0) {
+        static std::atomic<unsigned> nextSegment(0);
+        unsigned segment = nextSegment.fetch_add(1);
+#ifdef __linux__
+        if (GetExportMode() == kExportMemfd) {
+            fd_ = memfd_create("multiverse32", MFD_CLOEXEC);
+            if (fd_ >= 0) {
+                snprintf(name_, sizeof(name_), "/proc/%d/fd/%d", (int)getpid(), fd_);
+            }
+        } else
+#endif
+        {
+            snprintf(name_, sizeof(name_), "/multiverse32.%d.%u", (int)getpid(), segment);
+            fd_ = shm_open(name_, O_RDWR | O_CREAT | O_TRUNC, 0600);
+            named_ = fd_ >= 0;
+        }
+        if (fd_ < 0) {
+            name_[0] = '\0';
+            return false;
+        }
+    }
+
+    // Rows padded to 64 bytes like every other window surface
+    int32_t stride = (int32_t)((((size_t)width + 15) & ~(size_t)15) * sizeof(uint32_t));
+    size_t size = kPixelOffset + (size_t)stride * (size_t)height;
+    size = (size + 4095) & ~(size_t)4095;
+
+    if (size > mappingSize_) {
+        // Grow only: shrinking the file would leave a reader still copying
+        // the old geometry past its end. Readers see an odd sequence while
+        // the geometry changes.
+        if (header_) {
+            header_->sequence.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            munmap(header_, mappingSize_);
+            header_ = nullptr;
+        }
+        if (ftruncate(fd_, (off_t)size) != 0) {
+            Release();
+            return false;
+        }
+        void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (mapping == MAP_FAILED) {
+            Release();
+            return false;
+        }
+        header_ = (FramebufferHeader*)mapping;
+        mappingSize_ = size;
+    }
+
+    FramebufferHeader* header = header_;
+    uint32_t sequence = header->sequence.load(std::memory_order_relaxed);
+    if (header->magic != kFramebufferMagic) {
+        // Fresh segment: ftruncate zero-filled it
+        sequence = 0;
+    }
+    if (!(sequence & 1)) {
+        header->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    header->magic = kFramebufferMagic;
+    header->version = kFramebufferVersion;
+    header->format = kFramebufferFormatBGRA8888;
+    header->pixelOffset = (uint32_t)kPixelOffset;
+    header->width = width;
+    header->height = height;
+    header->stride = stride;
+    header->mappingSize = mappingSize_;
+    header->processId = (uint32_t)getpid();
+    snprintf(header->title, sizeof(header->title), "%s", title ? title : "");
+    pixels_ = (uint32_t*)((unsigned char*)header + kPixelOffset);
+    for (int y = 0; y < height; ++y) {
+        uint32_t* row = pixels_ + (size_t)y * (stride / 4);
+        for (int x = 0; x < width; ++x) {
+            row[x] = 0xFFFFFFFFu;
+        }
+    }
+    header->dirtyLeft = 0;
+    header->dirtyTop = 0;
+    header->dirtyRight = width;
+    header->dirtyBottom = height;
+    header->frameCount++;
+    header->timestampNs = MonotonicNs();
+    header->sequence.store((sequence | 1) + 1, std::memory_order_release);
+    drawDepth_ = 0;
+    return true;
+}
+
+void SharedFramebuffer::BeginFrame(int left, int top, int right, int bottom) {
+    if (!header_) {
+        return;
+    }
+    FramebufferHeader* header = header_;
+    if (drawDepth_++ == 0) {
+        header->sequence.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        header->dirtyLeft = left;
+        header->dirtyTop = top;
+        header->dirtyRight = right;
+        header->dirtyBottom = bottom;
+    } else {
+        // Nested drawing (a GetDC inside WM_PAINT) widens the dirty area
+        if (left < header->dirtyLeft) header->dirtyLeft = left;
+        if (top < header->dirtyTop) header->dirtyTop = top;
+        if (right > header->dirtyRight) header->dirtyRight = right;
+        if (bottom > header->dirtyBottom) header->dirtyBottom = bottom;
+    }
+}
+
+void SharedFramebuffer::EndFrame() {
+    if (!header_ || drawDepth_ == 0 || --drawDepth_ > 0) {
+        return;
+    }
+    FramebufferHeader* header = header_;
+    header->frameCount++;
+    header->timestampNs = MonotonicNs();
+    header->sequence.fetch_add(1, std::memory_order_release);
+}
+
+#endif // !_WIN32
@@ -0,0 +1,150 @@
+// win32_framebuffer.h - Shared-memory framebuffer export for the Win32 API Compatibility Layer
+// Self-contained so external viewers and test harnesses can include it to
+// read the segments a headless application publishes.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+// Segment layout: a FramebufferHeader at offset 0, followed by the pixels
+// at pixelOffset. Pixels are 32bpp BGRA (0xAARRGGBB as a little-endian
+// uint32_t), top-down, stride bytes apart. The present thread copies the
+// changed area of each frame it presents into the segment (see
+// win32_present.h), so frames arrive at the present rate.
+//
+// Consistency uses a sequence lock: sequence is odd while a frame is copied
+// in or the geometry changes and even once a frame is complete. A reader
+// copies what it needs between two loads of an even sequence and retries if
+// the value changed (see ReadFramebuffer). The segment only ever grows, so
+// a reader copying with stale geometry stays inside the file; if
+// mappingSize grows past what a reader has mapped, the reader must remap.
+static const uint32_t kFramebufferMagic = 0x3233564Du; // "MV32"
+static const uint32_t kFramebufferVersion = 1;
+static const uint32_t kFramebufferFormatBGRA8888 = 0;
+
+struct FramebufferHeader {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> sequence;
+    uint32_t format;
+    uint32_t pixelOffset;     // Bytes from the segment start to the top row
+    int32_t width;
+    int32_t height;
+    int32_t stride;           // Bytes between rows
+    uint64_t mappingSize;     // Total segment size in bytes
+    uint64_t frameCount;      // Frames published so far
+    uint64_t timestampNs;     // CLOCK_MONOTONIC time of the last publish
+    int32_t dirtyLeft;        // Area changed by the last frame, in pixels
+    int32_t dirtyTop;
+    int32_t dirtyRight;
+    int32_t dirtyBottom;
+    uint32_t processId;
+    char title[60];           // Window title, NUL terminated
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free,
+              "the sequence counter must be usable across processes");
+
+// Snapshot of the header fields a reader needs alongside the pixels
+struct FramebufferFrame {
+    int32_t width;
+    int32_t height;
+    uint64_t frameCount;
+    int32_t dirtyLeft, dirtyTop, dirtyRight, dirtyBottom;
+};
+
+// Copy a consistent frame out of a mapped segment into dst (width * height
+// tightly packed pixels, at most maxPixels). Returns false if no complete
+// frame was available within the given number of attempts, or if the frame
+// does not fit in dst or the mapped size.
+inline bool ReadFramebuffer(const void* mapping, size_t mappedSize, uint32_t* dst, size_t maxPixels,
+                            FramebufferFrame* frame, int attempts = 1000) {
+    const FramebufferHeader* header = (const FramebufferHeader*)mapping;
+    if (mappedSize < sizeof(FramebufferHeader) || header->magic != kFramebufferMagic ||
+        header->version != kFramebufferVersion) {
+        return false;
+    }
+    for (int attempt = 0; attempt < attempts; ++attempt) {
+        uint32_t before = header->sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        FramebufferFrame snapshot;
+        snapshot.width = header->width;
+        snapshot.height = header->height;
+        snapshot.frameCount = header->frameCount;
+        snapshot.dirtyLeft = header->dirtyLeft;
+        snapshot.dirtyTop = header->dirtyTop;
+        snapshot.dirtyRight = header->dirtyRight;
+        snapshot.dirtyBottom = header->dirtyBottom;
+        uint32_t offset = header->pixelOffset;
+        int32_t stride = header->stride;
+        size_t rowBytes = (size_t)snapshot.width * sizeof(uint32_t);
+        if ((size_t)snapshot.width * snapshot.height > maxPixels ||
+            offset + (size_t)stride * snapshot.height > mappedSize) {
+            // Either the geometry is changing under us or dst is too small
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (header->sequence.load(std::memory_order_relaxed) != before) {
+                continue;
+            }
+            return false;
+        }
+        const unsigned char* pixels = (const unsigned char*)mapping + offset;
+        for (int32_t y = 0; y < snapshot.height; ++y) {
+            memcpy(dst + (size_t)y * snapshot.width, pixels + (size_t)y * stride, rowBytes);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->sequence.load(std::memory_order_relaxed) == before) {
+            if (frame) {
+                *frame = snapshot;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef MULTIVERSE32_FRAMEBUFFER_WRITER
+
+// Writer side, used by the emulation core for each exported window
+class SharedFramebuffer {
+public:
+    SharedFramebuffer();
+    ~SharedFramebuffer();
+
+    SharedFramebuffer(const SharedFramebuffer&) = delete;
+    SharedFramebuffer& operator=(const SharedFramebuffer&) = delete;
+
+    // Whether MULTIVERSE32_FRAMEBUFFER asks for export
+    static bool Enabled();
+
+    // Create the segment on first use, or resize it; contents are cleared to
+    // white. Returns false if the segment could not be created.
+    bool Resize(int width, int height, const char* title);
+
+    uint32_t* pixels() const { return pixels_; }
+    int width() const { return header_ ? header_->width : 0; }
+    int height() const { return header_ ? header_->height : 0; }
+    ptrdiff_t stridePixels() const { return header_ ? header_->stride / 4 : 0; }
+    const char* name() const { return name_; }
+
+    // Drawing into area is about to start; nested calls are counted
+    void BeginFrame(int left, int top, int right, int bottom);
+    // Drawing finished; the outermost call publishes the frame
+    void EndFrame();
+
+private:
+    void Release();
+
+    FramebufferHeader* header_;
+    uint32_t* pixels_;
+    size_t mappingSize_;
+    int fd_;
+    int drawDepth_;
+    bool named_;       // Created with shm_open, so the name must be unlinked
+    char name_[64];
+};
+
+#endif // MULTIVERSE32_FRAMEBUFFER_WRITER
@@ -0,0 +1,106 @@
+// win32_gdibatch.h - GDI command batching for the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+//
+// Between BeginPaint and EndPaint, drawing calls on the paint DC append
+// fixed-size commands to a batch the DC holds instead of drawing. The batch is
+// executed in one pass when the paint ends, on GdiFlush, when the thread's
+// batch limit (GdiSetBatchLimit) is reached, and before anything that reads
+// the pixels or changes the clip.
+//
+// Setters such as SetTextColor only change the DC's state, which queries
+// and return values use right away. A drawing command that depends on the
+// state first records the parts that differ from what the batch already
+// holds, so repeated or overridden settings never reach the stream and
+// unchanged ones are not repeated. Flushed batches go back to a
+// per-thread pool with their storage, so a warm paint does not allocate.
+#pragma once
+
+#include "win32_compat.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// Drawing state of a DC that batched commands depend on
+struct GdiState {
+    HFONT font;          // Selected font; NULL stands for the stock font
+    uint32_t penPixel;   // Drawing state of the selected pen and brush
+    int penWidth;
+    bool penNull;
+    uint32_t brushPixel;
+    bool brushHollow;
+    COLORREF textColor;
+    COLORREF bkColor;
+    int bkMode;
+};
+
+// Parts of GdiState a drawing command reads
+enum GdiStateParts {
+    kGdiStateText = 1,  // Font, text and background colors, background mode
+    kGdiStatePen = 2,
+    kGdiStateBrush = 4,
+};
+
+// One batched call or state change. Fields are used as MV32_GDI_COMMAND
+// describes for op, except that fills, pixels, pens and brushes hold a
+// surface pixel in value.
+struct GdiCommand {
+    uint32_t op;      // MV32_GDI_*
+    uint32_t value;
+    RECT rect;
+    uint32_t text;    // Offset in the batch's text storage
+    int32_t length;
+    HFONT font;
+};
+
+class GdiBatch {
+public:
+    GdiBatch() : calls_(0) {}
+
+    bool empty() const { return commands_.empty(); }
+    int calls() const { return calls_; }
+    const std::vector<GdiCommand>& commands() const { return commands_; }
+    const char* Text(const GdiCommand& command) const { return text_.data() + command.text; }
+
+    // State the batch starts from, and the state at its end
+    GdiState& initial() { return initial_; }
+    GdiState& recorded() { return recorded_; }
+    const GdiState& initial() const { return initial_; }
+
+    // Start recording from state
+    void Begin(const GdiState& state) {
+        initial_ = state;
+        recorded_ = state;
+    }
+
+    GdiCommand& Append(uint32_t op) {
+        commands_.push_back(GdiCommand());
+        GdiCommand& command = commands_.back();
+        memset(&command, 0, sizeof(command));
+        command.op = op;
+        return command;
+    }
+
+    // Count an API call whose commands were appended
+    void CountCall() { ++calls_; }
+
+    // Copy text the caller may change before the batch runs
+    uint32_t AddText(const char* text, int length) {
+        uint32_t offset = (uint32_t)text_.size();
+        text_.insert(text_.end(), text, text + length);
+        return offset;
+    }
+
+    void Clear() {
+        commands_.clear();
+        text_.clear();
+        calls_ = 0;
+    }
+
+private:
+    std::vector<GdiCommand> commands_;
+    std::vector<char> text_;
+    GdiState initial_;
+    GdiState recorded_;
+    int calls_;
+};
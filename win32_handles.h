@@ -0,0 +1,341 @@
+// win32_handles.h - Handle tables used by the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include "win32_queue.h"
+
+// Object type tags stored in handle values. A handle of one type never
+// resolves in the table of another.
+enum HandleType {
+    kHandleTypeWindow = 1,
+    kHandleTypeDC = 2,
+    kHandleTypeFont = 3,
+    kHandleTypeBitmap = 4,
+    kHandleTypeBrush = 5,
+    kHandleTypePen = 6,
+    kHandleTypeRegion = 7,
+};
+
+// Lock for the short critical sections of the tables below. Uncontended,
+// it costs one atomic exchange, about half a std::mutex round trip, which
+// matters on paths like BeginPaint that allocate and free a DC per frame.
+class SpinLock {
+public:
+    SpinLock() : locked_(false) {}
+
+    void lock() {
+        while (locked_.exchange(true, std::memory_order_acquire)) {
+            while (locked_.load(std::memory_order_relaxed)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void unlock() { locked_.store(false, std::memory_order_release); }
+
+private:
+    std::atomic<bool> locked_;
+};
+
+// Dense, generation-checked handle table. Handle values follow the layout
+// Windows uses for USER/GDI handles, keeping them within 32 bits:
+//
+//   bits  0-15  slot index
+//   bits 16-19  object type tag
+//   bits 20-31  generation (never 0, so a valid handle is never NULL)
+//
+// Lookup is an index plus a generation compare. Objects live in fixed-size
+// chunks, so their addresses are stable for their whole lifetime and
+// consecutive handles are adjacent in memory. Freed slots are recycled in
+// FIFO order with a bumped generation, which spreads reuse over all slots
+// and makes a stale handle fail lookup instead of aliasing a new object.
+//
+// The table may be used from any thread. Allocate and Free serialize on a
+// lock; Lookup and ForEach take no lock, since chunks are never released
+// and a slot's generation and live flag are published atomically. An
+// object looked up on one thread must not be freed by another while in use.
+template <typename T, unsigned TypeTag>
+class HandleTable {
+public:
+    static const unsigned kIndexBits = 16;
+    static const unsigned kTypeBits = 4;
+    static const unsigned kGenerationBits = 12;
+    static const uint32_t kMaxSlots = 1u << kIndexBits;
+
+    HandleTable() : used_(0), live_(0), freeHead_(kNoSlot), freeTail_(kNoSlot) {
+        for (uint32_t i = 0; i < kMaxSlots / kChunkSize; ++i) {
+            chunks_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~HandleTable() {
+        uint32_t used = used_.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < used; ++i) {
+            Slot& slot = SlotAt(i);
+            if (slot.state.load(std::memory_order_relaxed) & kLiveBit) {
+                slot.object()->~T();
+            }
+        }
+        for (uint32_t i = 0; i < kMaxSlots / kChunkSize; ++i) {
+            delete[] chunks_[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    HandleTable(const HandleTable&) = delete;
+    HandleTable& operator=(const HandleTable&) = delete;
+
+    // Construct a new object; returns NULL when all slots are in use
+    template <typename... Args>
+    void* Allocate(T** object, Args&&... args) {
+        std::lock_guard<SpinLock> lock(lock_);
+        uint32_t index;
+        uint32_t used = used_.load(std::memory_order_relaxed);
+        if (freeHead_ != kNoSlot) {
+            index = freeHead_;
+            freeHead_ = SlotAt(index).nextFree;
+            if (freeHead_ == kNoSlot) {
+                freeTail_ = kNoSlot;
+            }
+        } else if (used < kMaxSlots) {
+            index = used;
+            if ((index & kChunkMask) == 0) {
+                chunks_[index >> kChunkBits].store(new Slot[kChunkSize], std::memory_order_release);
+            }
+            used_.store(used + 1, std::memory_order_release);
+        } else {
+            return nullptr;
+        }
+
+        Slot& slot = SlotAt(index);
+        uint32_t generation = slot.state.load(std::memory_order_relaxed) >> 1;
+        new (slot.storage) T(std::forward<Args>(args)...);
+        slot.state.store((generation << 1) | kLiveBit, std::memory_order_release);
+        live_.store(live_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (object) {
+            *object = slot.object();
+        }
+        return MakeHandle(index, generation);
+    }
+
+    T* Lookup(const void* handle) const {
+        uintptr_t value = (uintptr_t)handle;
+        if (value > 0xFFFFFFFFu || ((value >> kIndexBits) & kTypeMask) != TypeTag) {
+            return nullptr;
+        }
+        uint32_t index = (uint32_t)(value & (kMaxSlots - 1));
+        if (index >= used_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        const Slot& slot = SlotAt(index);
+        uint32_t generation = (uint32_t)(value >> (kIndexBits + kTypeBits));
+        if (slot.state.load(std::memory_order_acquire) != ((generation << 1) | kLiveBit)) {
+            return nullptr;
+        }
+        return const_cast<Slot&>(slot).object();
+    }
+
+    bool Free(const void* handle) {
+        std::lock_guard<SpinLock> lock(lock_);
+        if (!Lookup(handle)) {
+            return false;
+        }
+        uint32_t index = (uint32_t)((uintptr_t)handle & (kMaxSlots - 1));
+        Slot& slot = SlotAt(index);
+        // Retire the handle before the object goes away
+        uint32_t generation = slot.state.load(std::memory_order_relaxed) >> 1;
+        generation = (generation == kMaxGeneration) ? 1 : generation + 1;
+        slot.state.store(generation << 1, std::memory_order_release);
+        slot.object()->~T();
+        slot.nextFree = kNoSlot;
+        if (freeTail_ != kNoSlot) {
+            SlotAt(freeTail_).nextFree = index;
+        } else {
+            freeHead_ = index;
+        }
+        freeTail_ = index;
+        live_.store(live_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    size_t Count() const { return live_.load(std::memory_order_relaxed); }
+
+    // Visit every live object as (handle, object). Objects allocated or
+    // freed by other threads during the walk may or may not be visited.
+    template <typename F>
+    void ForEach(F visit) {
+        uint32_t used = used_.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < used; ++i) {
+            Slot& slot = SlotAt(i);
+            uint32_t state = slot.state.load(std::memory_order_acquire);
+            if (state & kLiveBit) {
+                visit(MakeHandle(i, state >> 1), slot.object());
+            }
+        }
+    }
+
+private:
+    static const uint32_t kTypeMask = (1u << kTypeBits) - 1;
+    static const uint32_t kMaxGeneration = (1u << kGenerationBits) - 1;
+    static const uint32_t kLiveBit = 1;
+    static const uint32_t kNoSlot = 0xFFFFFFFFu;
+    static const unsigned kChunkBits = 8;
+    static const uint32_t kChunkSize = 1u << kChunkBits;
+    static const uint32_t kChunkMask = kChunkSize - 1;
+
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        std::atomic<uint32_t> state; // Generation << 1 | kLiveBit
+        uint32_t nextFree;
+
+        Slot() : state(1u << 1), nextFree(kNoSlot) {}
+        T* object() { return reinterpret_cast<T*>(storage); }
+    };
+
+    static void* MakeHandle(uint32_t index, uint32_t generation) {
+        return (void*)(uintptr_t)(index | (TypeTag << kIndexBits) | (generation << (kIndexBits + kTypeBits)));
+    }
+
+    Slot& SlotAt(uint32_t index) const {
+        return chunks_[index >> kChunkBits].load(std::memory_order_acquire)[index & kChunkMask];
+    }
+
+    std::atomic<Slot*> chunks_[kMaxSlots / kChunkSize];
+    std::atomic<uint32_t> used_;
+    std::atomic<uint32_t> live_;  // Written under lock_, so updates need no atomic add
+    uint32_t freeHead_;  // Free list, guarded by lock_
+    uint32_t freeTail_;
+    SpinLock lock_;
+};
+
+// Bookkeeping shared by the objects of an InternTable
+struct InternedObject {
+    uint64_t key;          // Creation parameters the object is interned under
+    std::atomic<uint32_t> refs; // Create calls not yet deleted, plus DC selections
+    uint32_t cacheStamp;   // Identifies the object's newest entry in the cache queue
+    bool stock;            // Permanent object: references are not counted
+
+    InternedObject() : key(0), refs(0), cacheStamp(0), stock(false) {}
+};
+
+// Handle table for GDI objects that are immutable once created. Identical
+// create requests share one object with a reference count, so applications
+// that create the same font or brush on every paint do not rebuild it.
+// Deleting the last reference keeps the object cached (its handle stops
+// resolving) until kMaxCached newer objects have been released, so a
+// create/delete pair per paint revives the same object and its caches.
+// Reference changes serialize on a lock; Lookup takes no lock.
+template <typename T, unsigned TypeTag>
+class InternTable {
+public:
+    static const size_t kMaxCached = 64;
+
+    InternTable() : nextStamp_(0) {}
+
+    InternTable(const InternTable&) = delete;
+    InternTable& operator=(const InternTable&) = delete;
+
+    // Take a reference to the object interned under key, constructing it
+    // with init(T*) if there is none. Returns NULL when the table is full.
+    template <typename Init>
+    void* Intern(uint64_t key, Init init) {
+        std::lock_guard<SpinLock> lock(lock_);
+        typename std::unordered_map<uint64_t, void*>::iterator it = interned_.find(key);
+        if (it != interned_.end()) {
+            objects_.Lookup(it->second)->refs++;
+            return it->second;
+        }
+        T* object = nullptr;
+        void* handle = objects_.Allocate(&object);
+        if (!handle) {
+            return nullptr;
+        }
+        init(object);
+        object->key = key;
+        object->refs = 1;
+        interned_[key] = handle;
+        return handle;
+    }
+
+    // Construct a permanent object that is never interned or freed
+    template <typename Init>
+    void* CreateStock(Init init) {
+        std::lock_guard<SpinLock> lock(lock_);
+        T* object = nullptr;
+        void* handle = objects_.Allocate(&object);
+        if (handle) {
+            init(object);
+            object->stock = true;
+        }
+        return handle;
+    }
+
+    // Live objects only: deleted objects waiting in the cache do not resolve
+    T* Lookup(const void* handle) const {
+        T* object = objects_.Lookup(handle);
+        return (object && (object->refs > 0 || object->stock)) ? object : nullptr;
+    }
+
+    bool AddRef(const void* handle) {
+        // NULL and stock handles, the usual case, are settled without the lock
+        T* object = Lookup(handle);
+        if (!object || object->stock) {
+            return object != nullptr;
+        }
+        std::lock_guard<SpinLock> lock(lock_);
+        object = Lookup(handle);
+        if (!object) {
+            return false;
+        }
+        object->refs++;
+        return true;
+    }
+
+    // Drop a reference; returns false if the handle is not a live object
+    bool Release(const void* handle) {
+        T* object = Lookup(handle);
+        if (!object || object->stock) {
+            return object != nullptr;
+        }
+        std::lock_guard<SpinLock> lock(lock_);
+        object = Lookup(handle);
+        if (!object) {
+            return false;
+        }
+        if (--object->refs > 0) {
+            return true;
+        }
+        object->cacheStamp = ++nextStamp_;
+        cached_.push_back(CacheEntry(const_cast<void*>(handle), object->cacheStamp));
+        while (cached_.size() > kMaxCached) {
+            // Entries of objects revived and released again are stale
+            CacheEntry oldest = cached_.front();
+            cached_.pop_front();
+            T* evicted = objects_.Lookup(oldest.first);
+            if (evicted && evicted->refs == 0 && evicted->cacheStamp == oldest.second) {
+                interned_.erase(evicted->key);
+                objects_.Free(oldest.first);
+            }
+        }
+        return true;
+    }
+
+    size_t Count() const { return objects_.Count(); }
+
+private:
+    typedef std::pair<void*, uint32_t> CacheEntry;
+
+    HandleTable<T, TypeTag> objects_;
+    std::unordered_map<uint64_t, void*> interned_;
+    RingBuffer<CacheEntry> cached_;
+    uint32_t nextStamp_;
+    SpinLock lock_;
+};
@@ -0,0 +1,164 @@
+// win32_hittest.h - Spatial index for hit testing in the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+#pragma once
+
+#include "win32_compat.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Point lookup over a set of rectangles added in priority order, as used
+// for the child windows of a parent (topmost first). The rectangles are
+// bucketed into a uniform grid of about one cell per rectangle, so a query
+// only tests the few rectangles overlapping its cell. Rectangles covering
+// a large share of the grid (group boxes, panels) would be copied into
+// most cells; they go to a separate list instead, which every query merges
+// with the cell in priority order.
+//
+// Cells are stored as one packed array with per-cell offsets, so a build is
+// two passes over the rectangles and reuses its storage across rebuilds.
+class HitTestGrid {
+public:
+    HitTestGrid() : cols_(0), rows_(0), cellWidth_(1), cellHeight_(1), bounds_() {}
+
+    HitTestGrid(const HitTestGrid&) = delete;
+    HitTestGrid& operator=(const HitTestGrid&) = delete;
+
+    void Clear() {
+        items_.clear();
+        large_.clear();
+        cellStart_.clear();
+        cellItems_.clear();
+        cols_ = rows_ = 0;
+    }
+
+    // Add a rectangle below all earlier ones; empty rectangles never match
+    void Add(const RECT& rect, void* value) {
+        if (rect.left < rect.right && rect.top < rect.bottom) {
+            Item item = { rect, value };
+            items_.push_back(item);
+        }
+    }
+
+    // Bucket the rectangles added since Clear
+    void Build() {
+        large_.clear();
+        cellItems_.clear();
+        if (items_.empty()) {
+            cols_ = rows_ = 0;
+            return;
+        }
+        bounds_ = items_[0].rect;
+        for (const Item& item : items_) {
+            UnionBounds(item.rect);
+        }
+        int64_t width = (int64_t)bounds_.right - bounds_.left;
+        int64_t height = (int64_t)bounds_.bottom - bounds_.top;
+        // About one cell per rectangle, shaped like the bounds
+        int64_t cells = (int64_t)items_.size();
+        int64_t cols = 1;
+        while (cols * cols * height < cells * width && cols < kMaxAxisCells) {
+            ++cols;
+        }
+        int64_t rows = (cells + cols - 1) / cols;
+        cols_ = (int)(cols < width ? cols : width);
+        rows_ = (int)(rows < height ? (rows < kMaxAxisCells ? rows : kMaxAxisCells) : height);
+        cellWidth_ = (int)((width + cols_ - 1) / cols_);
+        cellHeight_ = (int)((height + rows_ - 1) / rows_);
+
+        // Count, then place; large rectangles skip the cells
+        size_t cellCount = (size_t)cols_ * rows_;
+        size_t largeCells = cellCount / 4 > 4 ? cellCount / 4 : 4;
+        cellStart_.assign(cellCount + 1, 0);
+        for (uint32_t i = 0; i < items_.size(); ++i) {
+            int c0, r0, c1, r1;
+            CellRange(items_[i].rect, &c0, &r0, &c1, &r1);
+            if ((size_t)(c1 - c0 + 1) * (size_t)(r1 - r0 + 1) > largeCells) {
+                large_.push_back(i);
+                continue;
+            }
+            for (int r = r0; r <= r1; ++r) {
+                for (int c = c0; c <= c1; ++c) {
+                    ++cellStart_[(size_t)r * cols_ + c + 1];
+                }
+            }
+        }
+        for (size_t cell = 0; cell < cellCount; ++cell) {
+            cellStart_[cell + 1] += cellStart_[cell];
+        }
+        cellItems_.resize(cellStart_[cellCount]);
+        std::vector<uint32_t>& next = cursor_;
+        next.assign(cellStart_.begin(), cellStart_.end() - 1);
+        size_t largeIndex = 0;
+        for (uint32_t i = 0; i < items_.size(); ++i) {
+            if (largeIndex < large_.size() && large_[largeIndex] == i) {
+                ++largeIndex;
+                continue;
+            }
+            int c0, r0, c1, r1;
+            CellRange(items_[i].rect, &c0, &r0, &c1, &r1);
+            for (int r = r0; r <= r1; ++r) {
+                for (int c = c0; c <= c1; ++c) {
+                    cellItems_[next[(size_t)r * cols_ + c]++] = i;
+                }
+            }
+        }
+    }
+
+    // The first rectangle containing (x, y) whose value is accepted by
+    // accept(void*), or NULL
+    template <typename Accept>
+    void* Find(int x, int y, Accept accept) const {
+        if (cols_ == 0 || x < bounds_.left || x >= bounds_.right || y < bounds_.top || y >= bounds_.bottom) {
+            return nullptr;
+        }
+        size_t cell = (size_t)((y - bounds_.top) / cellHeight_) * cols_ + (size_t)((x - bounds_.left) / cellWidth_);
+        const uint32_t* a = cellItems_.data() + cellStart_[cell];
+        const uint32_t* aEnd = cellItems_.data() + cellStart_[cell + 1];
+        const uint32_t* b = large_.data();
+        const uint32_t* bEnd = b + large_.size();
+        // Both lists are in priority order, so merging them visits the
+        // candidates from the top down
+        while (a != aEnd || b != bEnd) {
+            uint32_t index = (b == bEnd || (a != aEnd && *a < *b)) ? *a++ : *b++;
+            const Item& item = items_[index];
+            if (x >= item.rect.left && x < item.rect.right && y >= item.rect.top && y < item.rect.bottom &&
+                accept(item.value)) {
+                return item.value;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    static const int kMaxAxisCells = 256;
+
+    struct Item {
+        RECT rect;
+        void* value;
+    };
+
+    void UnionBounds(const RECT& rect) {
+        if (rect.left < bounds_.left) bounds_.left = rect.left;
+        if (rect.top < bounds_.top) bounds_.top = rect.top;
+        if (rect.right > bounds_.right) bounds_.right = rect.right;
+        if (rect.bottom > bounds_.bottom) bounds_.bottom = rect.bottom;
+    }
+
+    void CellRange(const RECT& rect, int* c0, int* r0, int* c1, int* r1) const {
+        *c0 = (rect.left - bounds_.left) / cellWidth_;
+        *r0 = (rect.top - bounds_.top) / cellHeight_;
+        *c1 = (rect.right - 1 - bounds_.left) / cellWidth_;
+        *r1 = (rect.bottom - 1 - bounds_.top) / cellHeight_;
+    }
+
+    std::vector<Item> items_;          // In priority order
+    std::vector<uint32_t> large_;      // Items kept out of the cells, ascending
+    std::vector<uint32_t> cellStart_;  // Offsets into cellItems_, one per cell plus an end
+    std::vector<uint32_t> cellItems_;  // Item indices per cell, ascending
+    std::vector<uint32_t> cursor_;     // Scratch for Build
+    int cols_, rows_;
+    int cellWidth_, cellHeight_;
+    RECT bounds_;                      // Union of the items
+};
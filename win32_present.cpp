@@ -0,0 +1,482 @@
+// win32_present.cpp - Window presentation for the Win32 API Compatibility Layer
+// Frames are handed from the UI threads to a present thread through
+// lock-free triple buffers, and shown at a paced rate.
+
+#ifndef _WIN32
+
+#include "win32_present.h"
+
+#define MULTIVERSE32_FRAMEBUFFER_WRITER
+#include "win32_framebuffer.h"
+#include "win32_trace.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#ifdef __linux__
+    #include <sys/eventfd.h>
+#endif
+#include <algorithm>
+#include <thread>
+
+// Platform hook, called on the present thread with the newest frame of a
+// window and the area that changed since the previous present
+void PresentPlatformWindow(void* window, const Surface& frame, const RECT& dirty);
+
+static uint64_t PresentNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Sleep until an absolute time on the monotonic clock
+static void SleepUntil(uint64_t deadlineNs) {
+#ifdef __APPLE__
+    // No clock_nanosleep: sleep for the remaining time instead
+    for (uint64_t now = PresentNow(); now < deadlineNs; now = PresentNow()) {
+        struct timespec ts = { (time_t)((deadlineNs - now) / 1000000000), (long)((deadlineNs - now) % 1000000000) };
+        nanosleep(&ts, nullptr);
+    }
+#else
+    struct timespec ts = { (time_t)(deadlineNs / 1000000000), (long)(deadlineNs % 1000000000) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+#endif
+}
+
+static void UnionDamage(RECT* area, const RECT& rect) {
+    if (rect.left >= rect.right || rect.top >= rect.bottom) {
+        return;
+    }
+    if (area->left >= area->right || area->top >= area->bottom) {
+        *area = rect;
+        return;
+    }
+    area->left = std::min(area->left, rect.left);
+    area->top = std::min(area->top, rect.top);
+    area->right = std::max(area->right, rect.right);
+    area->bottom = std::max(area->bottom, rect.bottom);
+}
+
+// ==============================================================================
+// PRESENT THREAD
+// ==============================================================================
+
+// Chains with a new frame wait on a lock-free list. Scheduling a chain that
+// is already listed costs one atomic exchange; listing it pushes it and
+// signals an eventfd (a pipe elsewhere), neither of which blocks.
+class PresentThread {
+public:
+    static PresentThread& Get() {
+        static PresentThread* thread = new PresentThread(); // Outlives static destructors
+        return *thread;
+    }
+
+    void Schedule(SwapChain* chain) {
+        if (chain->queued_.load(std::memory_order_relaxed) || chain->queued_.exchange(true, std::memory_order_acq_rel)) {
+            return;
+        }
+        chain->references_.fetch_add(1, std::memory_order_relaxed);
+        SwapChain* head = pending_.load(std::memory_order_relaxed);
+        do {
+            chain->nextQueued_ = head;
+        } while (!pending_.compare_exchange_weak(head, chain, std::memory_order_release, std::memory_order_relaxed));
+        if (!head) {
+            Wake();
+        }
+    }
+
+private:
+    PresentThread() : pending_(nullptr), stopping_(false), readFd_(-1), writeFd_(-1), intervalNs_(0) {
+        // MULTIVERSE32_PRESENT_HZ=<rate> paces presents; 0 shows frames as
+        // soon as they are handed over
+        const char* rate = getenv("MULTIVERSE32_PRESENT_HZ");
+        double hz = (rate && *rate) ? atof(rate) : 60.0;
+        intervalNs_ = hz > 0 ? (uint64_t)(1e9 / hz) : 0;
+#ifdef __linux__
+        readFd_ = writeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+        int fds[2];
+        if (pipe(fds) == 0) {
+            fcntl(fds[0], F_SETFL, O_NONBLOCK);
+            fcntl(fds[1], F_SETFL, O_NONBLOCK);
+            readFd_ = fds[0];
+            writeFd_ = fds[1];
+        }
+#endif
+        thread_ = std::thread([this] { Run(); });
+        atexit(StopAtExit);
+    }
+
+    void Wake() {
+        uint64_t one = 1;
+        ssize_t written = write(writeFd_, &one, sizeof(one));
+        (void)written; // A full pipe/counter already guarantees a wakeup
+    }
+
+    void Run() {
+        uint64_t nextNs = 0;
+        for (;;) {
+            bool stopping = stopping_.load(std::memory_order_acquire);
+            if (!pending_.load(std::memory_order_acquire) && !stopping) {
+                struct pollfd pfd = { readFd_, POLLIN, 0 };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            // Frames handed over while this sleeps replace each other
+            if (!stopping && PresentNow() < nextNs) {
+                TraceScope trace("PresentWait");
+                SleepUntil(nextNs);
+            }
+            uint64_t value;
+            while (read(readFd_, &value, sizeof(value)) > 0) {
+                // Drain before taking the list, so a later push wakes us again
+            }
+            SwapChain* chain = pending_.exchange(nullptr, std::memory_order_acquire);
+            uint64_t nowNs = PresentNow();
+            bool presented = false;
+            while (chain) {
+                SwapChain* next = chain->nextQueued_;
+                chain->queued_.store(false, std::memory_order_release);
+                presented |= chain->Present();
+                chain->Release();
+                chain = next;
+            }
+            if (stopping && !pending_.load(std::memory_order_acquire)) {
+                return;
+            }
+            // The next present waits for the following interval boundary.
+            // If every frame was taken back to be drawn on, the next hand-over
+            // is still due now.
+            if (presented) {
+                nextNs = (intervalNs_ && nextNs + intervalNs_ > nowNs) ? nextNs + intervalNs_ : nowNs + intervalNs_;
+            }
+        }
+    }
+
+    // Show the frames still waiting, so exported windows end on their last one
+    static void StopAtExit() {
+        PresentThread& thread = Get();
+        thread.stopping_.store(true, std::memory_order_release);
+        thread.Wake();
+        thread.thread_.join();
+    }
+
+    std::atomic<SwapChain*> pending_;
+    std::atomic<bool> stopping_;
+    int readFd_;
+    int writeFd_;
+    uint64_t intervalNs_;
+    std::thread thread_;
+};
+
+// ==============================================================================
+// SWAP CHAINS
+// ==============================================================================
+
+SwapChain::SwapChain(void* platformWindow, const char* title)
+    : middle_(1), back_(0), published_(-1), drawDepth_(0), frameDamage_(), frame_(0), waitingSinceNs_(0), history_(),
+      front_(2), shownFrame_(0), shownNs_(0), tileColumns_(0), tileRows_(0), platformWindow_(platformWindow),
+      presenting_(false), references_(1), queued_(false), nextQueued_(nullptr), finishedFrame_(0),
+      presentedFrame_(0), framesPresented_(0), framesDropped_(0), lastFrameNs_(0), maxFrameNs_(0),
+      lastLatencyNs_(0), lastTilesCompared_(0), lastTilesChanged_(0), lastBytesPresented_(0), bytesPresented_(0) {
+    for (Buffer& buffer : buffers_) {
+        buffer.frame = 0;
+        buffer.waitingSinceNs = 0;
+        buffer.historyEnd = 1;
+        memset(buffer.history, 0, sizeof(buffer.history));
+    }
+    snprintf(title_, sizeof(title_), "%s", title ? title : "");
+}
+
+SwapChain::~SwapChain() {
+}
+
+SwapChain* SwapChain::Create(void* platformWindow, const char* title) {
+    PresentThread::Get();
+    return new SwapChain(platformWindow, title);
+}
+
+void SwapChain::Release() {
+    if (references_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+void SwapChain::Close() {
+    // Pairs with Present: either it sees no window, or this sees it presenting
+    platformWindow_.store(nullptr, std::memory_order_seq_cst);
+    while (presenting_.load(std::memory_order_seq_cst)) {
+        sched_yield();
+    }
+    Release();
+}
+
+// Union of the areas drawn after frame, up to the buffer's own frame.
+// Returns false if the buffer's history does not reach back that far.
+bool SwapChain::DamageSince(const Buffer& buffer, uint64_t frame, RECT* area) {
+    SetRectEmpty(area);
+    if (frame == 0 || buffer.frame - frame >= (uint64_t)kDamageHistory) {
+        return false;
+    }
+    for (uint64_t f = frame + 1; f <= buffer.frame; ++f) {
+        const Damage& damage = buffer.history[f % kDamageHistory];
+        if (damage.frame != f) {
+            return false;
+        }
+        UnionDamage(area, damage.rect);
+    }
+    return true;
+}
+
+// Bring a buffer the present thread gave back up to the newest frame
+void SwapChain::CatchUp(Buffer& stale, const Buffer& current) {
+    const Surface& src = current.pixels.surface();
+    const Surface& dst = stale.pixels.surface();
+    if (stale.frame == current.frame) {
+        return;
+    }
+    RECT area;
+    if (dst.width != src.width || dst.height != src.height || !DamageSince(current, stale.frame, &area)) {
+        if (dst.width != src.width || dst.height != src.height) {
+            stale.pixels.Resize(src.width, src.height);
+        }
+        area = src.Bounds();
+    }
+    TraceScope trace("CatchUpFrame", "pixels", (uint64_t)(area.right - area.left) * (area.bottom - area.top));
+    BlitPixels(stale.pixels.surface(), area.left, area.top, src, area.left, area.top, area.right - area.left,
+               area.bottom - area.top, kRopSrcCopy);
+    stale.frame = current.frame;
+}
+
+const Surface& SwapChain::BeginFrame(int width, int height) {
+    if (drawDepth_++ > 0) {
+        return buffers_[back_].pixels.surface();
+    }
+    SetRectEmpty(&frameDamage_);
+    if (published_ >= 0) {
+        uint32_t waiting = (uint32_t)published_ | kFresh;
+        if (middle_.compare_exchange_strong(waiting, (uint32_t)back_, std::memory_order_acq_rel)) {
+            // Not presented yet: take it back and draw over it
+            back_ = published_;
+            CountDroppedFrame();
+        } else {
+            CatchUp(buffers_[back_], buffers_[published_]);
+            waitingSinceNs_ = 0;
+        }
+        published_ = -1;
+    }
+    Buffer& buffer = buffers_[back_];
+    const Surface& surface = buffer.pixels.surface();
+    if (surface.width != width || surface.height != height) {
+        // Cleared to white like any new window surface, so all of it changed
+        buffer.pixels.Resize(width, height);
+        frameDamage_ = buffer.pixels.surface().Bounds();
+    }
+    return buffer.pixels.surface();
+}
+
+// Only the UI thread counts drops, so no read-modify-write is needed
+void SwapChain::CountDroppedFrame() {
+    framesDropped_.store(framesDropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void SwapChain::AddDamage(const RECT& area) {
+    UnionDamage(&frameDamage_, area);
+}
+
+void SwapChain::EndFrame() {
+    if (drawDepth_ == 0 || --drawDepth_ > 0) {
+        return;
+    }
+    Buffer& buffer = buffers_[back_];
+    buffer.frame = ++frame_;
+    // Reading the clock once per present rather than per frame keeps it off
+    // the paint path of a window that outpaces its display
+    if (!waitingSinceNs_) {
+        waitingSinceNs_ = PresentNow();
+    }
+    buffer.waitingSinceNs = waitingSinceNs_;
+    Damage& damage = history_[frame_ % kDamageHistory];
+    damage.frame = frame_;
+    RECT bounds = buffer.pixels.surface().Bounds();
+    if (!IntersectRect(&damage.rect, &frameDamage_, &bounds)) {
+        SetRectEmpty(&damage.rect);
+    }
+    // The buffer already remembers the frames up to the one it held before
+    uint64_t first = frame_ > (uint64_t)kDamageHistory ? frame_ - kDamageHistory + 1 : 1;
+    for (uint64_t f = std::max(first, buffer.historyEnd); f <= frame_; ++f) {
+        buffer.history[f % kDamageHistory] = history_[f % kDamageHistory];
+    }
+    buffer.historyEnd = frame_ + 1;
+    uint32_t previous = middle_.exchange((uint32_t)back_ | kFresh, std::memory_order_acq_rel);
+    if (previous & kFresh) {
+        CountDroppedFrame();
+    }
+    published_ = back_;
+    back_ = (int)(previous & ~kFresh);
+    finishedFrame_.store(frame_, std::memory_order_release);
+    PresentThread::Get().Schedule(this);
+}
+
+// Present thread: hash the tiles of frame inside damage and collect those
+// that differ from the frame shown before, or all of them, in changedTiles_.
+// Stores their bounds in dirty.
+void SwapChain::DiffTiles(const Surface& frame, RECT damage, bool all, RECT* dirty) {
+    int columns = (frame.width + kTileSize - 1) / kTileSize;
+    int rows = (frame.height + kTileSize - 1) / kTileSize;
+    if (columns != tileColumns_ || rows != tileRows_) {
+        tileHashes_.assign((size_t)columns * rows, 0);
+        tileColumns_ = columns;
+        tileRows_ = rows;
+        all = true;
+    }
+    if (all) {
+        damage = frame.Bounds();
+    }
+    changedTiles_.clear();
+    SetRectEmpty(dirty);
+    uint64_t compared = 0;
+    uint64_t changed = 0;
+    uint64_t bytes = 0;
+    RECT bounds = frame.Bounds();
+    if (IntersectRect(&damage, &damage, &bounds)) {
+        TraceScope trace("DiffTiles", "pixels", (uint64_t)(damage.right - damage.left) * (damage.bottom - damage.top));
+        for (int row = damage.top / kTileSize; row <= (damage.bottom - 1) / kTileSize; ++row) {
+            for (int column = damage.left / kTileSize; column <= (damage.right - 1) / kTileSize; ++column) {
+                RECT tile = { column * kTileSize, row * kTileSize, std::min((column + 1) * kTileSize, frame.width),
+                              std::min((row + 1) * kTileSize, frame.height) };
+                uint64_t hash = HashPixels(frame, tile);
+                uint64_t& shown = tileHashes_[(size_t)row * columns + column];
+                ++compared;
+                if (hash == shown && !all) {
+                    continue;
+                }
+                shown = hash;
+                ++changed;
+                bytes += (uint64_t)(tile.right - tile.left) * (tile.bottom - tile.top) * sizeof(uint32_t);
+                UnionDamage(dirty, tile);
+                if (!changedTiles_.empty() && changedTiles_.back().right == tile.left &&
+                    changedTiles_.back().top == tile.top) {
+                    changedTiles_.back().right = tile.right;
+                } else {
+                    changedTiles_.push_back(tile);
+                }
+            }
+        }
+    }
+    lastTilesCompared_.store(compared, std::memory_order_relaxed);
+    lastTilesChanged_.store(changed, std::memory_order_relaxed);
+    lastBytesPresented_.store(bytes, std::memory_order_relaxed);
+    bytesPresented_.store(bytesPresented_.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+}
+
+// Present thread: show the newest frame, if there is one
+bool SwapChain::Present() {
+    uint32_t middle = middle_.load(std::memory_order_acquire);
+    while (middle & kFresh) {
+        if (middle_.compare_exchange_weak(middle, (uint32_t)front_, std::memory_order_acq_rel)) {
+            break;
+        }
+    }
+    if (!(middle & kFresh)) {
+        return false; // Taken back by the UI thread, which will hand it over again
+    }
+    front_ = (int)(middle & ~kFresh);
+    const Buffer& buffer = buffers_[front_];
+    const Surface& frame = buffer.pixels.surface();
+    RECT damage;
+    if (!DamageSince(buffer, shownFrame_, &damage)) {
+        damage = frame.Bounds(); // Compared in full, still only changed tiles are shown
+    }
+    TraceScope trace("Present", "frame", buffer.frame);
+
+    SharedFramebuffer* exported = nullptr;
+    bool resized = false;
+    if (SharedFramebuffer::Enabled()) {
+        if (!framebuffer_) {
+            framebuffer_.reset(new SharedFramebuffer());
+        }
+        exported = framebuffer_.get();
+        resized = exported->width() != frame.width || exported->height() != frame.height || !exported->pixels();
+        if (resized && !exported->Resize(frame.width, frame.height, title_)) {
+            fprintf(stderr, "Failed to export framebuffer for window '%s'\n", title_);
+            exported = nullptr;
+        }
+    }
+    // A new segment is blank, so it takes every tile
+    RECT dirty;
+    DiffTiles(frame, damage, resized, &dirty);
+
+    if (exported) {
+        // Published even when nothing changed, so readers see the frame
+        Surface segment;
+        segment.pixels = exported->pixels();
+        segment.width = exported->width();
+        segment.height = exported->height();
+        segment.stride = exported->stridePixels();
+        exported->BeginFrame(dirty.left, dirty.top, dirty.right, dirty.bottom);
+        for (const RECT& tiles : changedTiles_) {
+            BlitPixels(segment, tiles.left, tiles.top, frame, tiles.left, tiles.top, tiles.right - tiles.left,
+                       tiles.bottom - tiles.top, kRopSrcCopy);
+        }
+        exported->EndFrame();
+    }
+
+    presenting_.store(true, std::memory_order_seq_cst);
+    void* window = platformWindow_.load(std::memory_order_seq_cst);
+    if (window && !changedTiles_.empty()) {
+        TraceScope platformTrace("PresentPlatformWindow");
+        PresentPlatformWindow(window, frame, dirty);
+    }
+    presenting_.store(false, std::memory_order_release);
+
+    uint64_t presentedNs = PresentNow();
+    if (shownNs_) {
+        uint64_t frameNs = presentedNs - shownNs_;
+        lastFrameNs_.store(frameNs, std::memory_order_relaxed);
+        if (frameNs > maxFrameNs_.load(std::memory_order_relaxed)) {
+            maxFrameNs_.store(frameNs, std::memory_order_relaxed);
+        }
+    }
+    lastLatencyNs_.store(presentedNs - std::min(buffer.waitingSinceNs, presentedNs), std::memory_order_relaxed);
+    framesPresented_.fetch_add(1, std::memory_order_relaxed);
+    shownNs_ = presentedNs;
+    shownFrame_ = buffer.frame;
+    presentedFrame_.store(buffer.frame, std::memory_order_release);
+    return true;
+}
+
+void SwapChain::WaitPresented() const {
+    uint64_t target = finishedFrame_.load(std::memory_order_acquire);
+    uint64_t deadlineNs = PresentNow() + 1000000000ull;
+    while (presentedFrame_.load(std::memory_order_acquire) < target && PresentNow() < deadlineNs) {
+        struct timespec ts = { 0, 100000 };
+        nanosleep(&ts, nullptr);
+    }
+}
+
+const char* SwapChain::FramebufferName() const {
+    return (framebuffer_ && framebuffer_->pixels()) ? framebuffer_->name() : nullptr;
+}
+
+void SwapChain::GetStats(MV32_PRESENT_STATS* stats) const {
+    stats->framesFinished = finishedFrame_.load(std::memory_order_relaxed);
+    stats->framesPresented = framesPresented_.load(std::memory_order_relaxed);
+    stats->framesDropped = framesDropped_.load(std::memory_order_relaxed);
+    stats->lastFrameNs = lastFrameNs_.load(std::memory_order_relaxed);
+    stats->maxFrameNs = maxFrameNs_.load(std::memory_order_relaxed);
+    stats->lastLatencyNs = lastLatencyNs_.load(std::memory_order_relaxed);
+    stats->lastTilesCompared = lastTilesCompared_.load(std::memory_order_relaxed);
+    stats->lastTilesChanged = lastTilesChanged_.load(std::memory_order_relaxed);
+    stats->lastBytesPresented = lastBytesPresented_.load(std::memory_order_relaxed);
+    stats->bytesPresented = bytesPresented_.load(std::memory_order_relaxed);
+}
+
+#endif // !_WIN32
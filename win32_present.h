@@ -0,0 +1,139 @@
+// win32_present.h - Window presentation for the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+//
+// Each top-level window draws into the back buffer of a triple-buffered
+// SwapChain. Finishing a frame (the last DC drawing into the window being
+// released) hands the back buffer over with one atomic exchange and, at
+// most, a nonblocking wakeup. A single present thread takes the newest
+// frame of every window that has one and shows it through the platform and
+// the exported framebuffer, at most MULTIVERSE32_PRESENT_HZ times a second
+// (60 by default), sleeping in between with clock_nanosleep. The UI thread
+// never waits for presentation:
+//
+// - A frame still waiting when the next one is finished is replaced, and
+//   counted as dropped.
+// - A frame still waiting when the next one starts is taken back and drawn
+//   over, so a window that paints faster than it is presented keeps drawing
+//   into one buffer without copying.
+// - Otherwise the back buffer is brought up to date by copying the areas
+//   drawn since it was last current from the newest frame, using the damage
+//   history each frame carries. The present thread uses the same history to
+//   export only what changed since the frame it showed before.
+//
+// Windows often repaint more than actually changes. Before showing a frame,
+// the present thread hashes each kTileSize square tile inside its damaged
+// area and compares it with the hash of the same tile in the frame shown
+// before. Only the tiles that differ are copied to the exported framebuffer
+// and reported to the platform, so repainting a window with the pixels it
+// already had presents nothing.
+#pragma once
+
+#include "win32_raster.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class SharedFramebuffer;
+
+class SwapChain {
+public:
+    // The present thread starts with the first chain
+    static SwapChain* Create(void* platformWindow, const char* title);
+
+    // Detach from the window. If the present thread is showing a frame of
+    // this chain, waits for it to finish so the platform window can be
+    // destroyed next; the chain itself is freed once the thread lets go.
+    void Close();
+
+    // Start drawing a width x height frame and return the back buffer.
+    // Calls nest: the frame is only finished by the outermost EndFrame.
+    const Surface& BeginFrame(int width, int height);
+    // Record an area (surface coordinates) the current frame may draw into
+    void AddDamage(const RECT& area);
+    // The outermost call hands the frame to the present thread
+    void EndFrame();
+
+    // Wait, up to a second, until the present thread has shown the last
+    // finished frame. Only for callers that need the output, never painting.
+    void WaitPresented() const;
+    // Shared memory segment of an exported window, or NULL before its first
+    // present; call WaitPresented first
+    const char* FramebufferName() const;
+
+    void GetStats(MV32_PRESENT_STATS* stats) const;
+
+private:
+    static const int kBufferCount = 3;
+    static const int kDamageHistory = 16; // Frames of damage a buffer remembers
+    static const uint32_t kFresh = 4;     // middle_ flag: holds a frame not yet taken
+    static const int kTileSize = 64;      // Pixels per side of a compared tile
+
+    // Area drawn by one frame
+    struct Damage {
+        uint64_t frame;
+        RECT rect;
+    };
+
+    struct Buffer {
+        SurfaceBuffer pixels;
+        uint64_t frame;        // Last frame drawn into the contents, 0 if none
+        uint64_t waitingSinceNs; // When the oldest change not yet presented was handed over
+        Damage history[kDamageHistory]; // Indexed by frame % kDamageHistory
+        uint64_t historyEnd;   // Frame after the newest one in history
+    };
+
+    SwapChain(void* platformWindow, const char* title);
+    ~SwapChain(); // Out of line, where SharedFramebuffer is complete
+
+    void Release();
+    void CatchUp(Buffer& stale, const Buffer& current);
+    void CountDroppedFrame();
+    static bool DamageSince(const Buffer& buffer, uint64_t frame, RECT* area);
+    void DiffTiles(const Surface& frame, RECT damage, bool all, RECT* dirty);
+    bool Present();
+
+    friend class PresentThread;
+
+    Buffer buffers_[kBufferCount];
+    std::atomic<uint32_t> middle_; // Buffer index between the threads, with kFresh
+
+    // UI thread
+    int back_;
+    int published_;         // Buffer of the newest frame, while the UI thread may still copy from it
+    int drawDepth_;
+    RECT frameDamage_;
+    uint64_t frame_;        // Frames finished
+    uint64_t waitingSinceNs_; // waitingSinceNs of the back buffer, 0 while nothing waits
+    Damage history_[kDamageHistory];
+
+    // Present thread
+    int front_;
+    uint64_t shownFrame_;   // Frame last presented
+    uint64_t shownNs_;
+    std::unique_ptr<SharedFramebuffer> framebuffer_;
+    char title_[60];
+    std::vector<uint64_t> tileHashes_; // Tiles of the frame shown last, row by row
+    int tileColumns_;
+    int tileRows_;
+    std::vector<RECT> changedTiles_;   // Of the frame being presented, adjacent ones in a row merged
+
+    // Shared
+    std::atomic<void*> platformWindow_;
+    std::atomic<bool> presenting_;
+    std::atomic<int> references_;
+    std::atomic<bool> queued_;    // On the present thread's list
+    SwapChain* nextQueued_;
+    std::atomic<uint64_t> finishedFrame_;
+    std::atomic<uint64_t> presentedFrame_;
+    std::atomic<uint64_t> framesPresented_;
+    std::atomic<uint64_t> framesDropped_;
+    std::atomic<uint64_t> lastFrameNs_;
+    std::atomic<uint64_t> maxFrameNs_;
+    std::atomic<uint64_t> lastLatencyNs_;
+    std::atomic<uint64_t> lastTilesCompared_;
+    std::atomic<uint64_t> lastTilesChanged_;
+    std::atomic<uint64_t> lastBytesPresented_;
+    std::atomic<uint64_t> bytesPresented_;
+};
@@ -0,0 +1,493 @@
+// win32_queue.h - Message queue used by the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+#pragma once
+
+#include "win32_compat.h"
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <utility>
+
+// Growable power-of-two ring buffer. Head and tail are free-running counters,
+// so push/pop are O(1) and never move existing elements.
+template <typename T>
+class RingBuffer {
+public:
+    RingBuffer() : mask_(0), head_(0), tail_(0) {}
+
+    size_t size() const { return tail_ - head_; }
+    bool empty() const { return head_ == tail_; }
+
+    T& operator[](size_t i) { return slots_[(head_ + i) & mask_]; }
+    const T& operator[](size_t i) const { return slots_[(head_ + i) & mask_]; }
+    T& front() { return slots_[head_ & mask_]; }
+    T& back() { return slots_[(tail_ - 1) & mask_]; }
+
+    void push_back(const T& value) {
+        if (size() == capacity()) {
+            grow();
+        }
+        slots_[tail_ & mask_] = value;
+        ++tail_;
+    }
+
+    void pop_front() { ++head_; }
+
+    void clear() { head_ = tail_ = 0; }
+
+    // Drop the elements pred selects, keeping the order of the others
+    template <typename Pred>
+    void remove_if(Pred pred) {
+        size_t count = size();
+        size_t kept = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (!pred((*this)[i])) {
+                if (kept != i) {
+                    (*this)[kept] = (*this)[i];
+                }
+                ++kept;
+            }
+        }
+        tail_ = head_ + kept;
+    }
+
+private:
+    size_t capacity() const { return slots_ ? mask_ + 1 : 0; }
+
+    void grow() {
+        size_t newCapacity = slots_ ? (mask_ + 1) * 2 : 64;
+        std::unique_ptr<T[]> newSlots(new T[newCapacity]);
+        size_t count = size();
+        for (size_t i = 0; i < count; ++i) {
+            newSlots[i] = (*this)[i];
+        }
+        slots_ = std::move(newSlots);
+        mask_ = newCapacity - 1;
+        head_ = 0;
+        tail_ = count;
+    }
+
+    std::unique_ptr<T[]> slots_;
+    size_t mask_;
+    size_t head_;
+    size_t tail_;
+};
+
+// Unbounded multi-producer, single-consumer queue (Vyukov's intrusive
+// design). Push from any thread is one atomic exchange plus one store and
+// never blocks; only the owning thread may Pop or test empty(). A producer
+// preempted between its two steps briefly hides the items behind it: Pop
+// returns false while empty() stays false, so the consumer retries rather
+// than going to sleep.
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head_(&stub_), tail_(&stub_) { stub_.next.store(nullptr, std::memory_order_relaxed); }
+
+    ~MpscQueue() {
+        T value;
+        while (Pop(&value)) {
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void Push(const T& value) {
+        Node* node = new Node;
+        node->value = value;
+        Link(node);
+    }
+
+    bool Pop(T* out) {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_) {
+            if (!next) {
+                return false;
+            }
+            tail_ = tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (!next) {
+            // tail is the newest node; queue the stub behind it so it can go
+            if (tail != head_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            Link(&stub_);
+            next = tail->next.load(std::memory_order_acquire);
+            if (!next) {
+                return false;
+            }
+        }
+        tail_ = next;
+        *out = tail->value;
+        delete tail;
+        return true;
+    }
+
+    bool empty() const {
+        return tail_ == &stub_ && head_.load(std::memory_order_seq_cst) == &stub_;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*> next;
+        T value;
+    };
+
+    void Link(Node* node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node* prev = head_.exchange(node, std::memory_order_seq_cst);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    Node stub_;
+    std::atomic<Node*> head_; // Newest node, shared with producers
+    Node* tail_;              // Oldest node, consumer only
+};
+
+// Thread message queue. Messages are split by class (keyboard, mouse, other)
+// into separate rings and stamped with a global sequence number, so the
+// unfiltered case and the usual WM_KEYFIRST/WM_MOUSEFIRST range filters are
+// O(1) while delivery still follows posting order. Messages removed from the
+// middle of a ring by a filtered retrieval are tombstoned; tombstones are
+// skipped once they reach the head, and the ring is compacted when they
+// outnumber the live messages.
+//
+// Window filters and ranges that cover part of a class use two indexes of
+// sequence numbers, by (window, message) and by message, built the first
+// time such a filter is used and dropped when the queue empties without one
+// having been used since it last did. A filtered retrieval compares the
+// oldest message of each key in the filter instead of walking the rings.
+// Index entries whose message went through another path are dropped once
+// they reach the front of their key, or compacted like tombstones.
+//
+// WM_PAINT is not stored here: the owner synthesizes it from per-window
+// state once the queue is empty, as Windows does.
+class MessageQueue {
+public:
+    MessageQueue()
+        : nextSeq_(0), lastInputSeq_(UINT64_MAX), indexed_(false), filtered_(false),
+          lastWindow_(nullptr), lastMessage_(nullptr) {
+        for (int c = 0; c < kClassCount; ++c) {
+            live_[c] = 0;
+        }
+    }
+
+    bool empty() const {
+        return live_[kKeyboard] == 0 && live_[kMouse] == 0 && live_[kOther] == 0;
+    }
+
+    void Post(const MSG& msg) {
+        Push(msg);
+    }
+
+    // Queue a hardware input message. A WM_MOUSEMOVE that directly follows
+    // another still-pending move for the same window and button state
+    // replaces it instead of growing the queue.
+    void PostInput(const MSG& msg) {
+        if (msg.message == WM_MOUSEMOVE && !rings_[kMouse].empty()) {
+            Entry& last = rings_[kMouse].back();
+            if (last.seq == lastInputSeq_ && !last.removed &&
+                last.msg.message == WM_MOUSEMOVE &&
+                last.msg.hwnd == msg.hwnd && last.msg.wParam == msg.wParam) {
+                last.msg = msg;
+                return;
+            }
+        }
+        lastInputSeq_ = Push(msg);
+    }
+
+    // Find the oldest message matching the GetMessage/PeekMessage filter.
+    // hWnd == NULL matches every message, hWnd == (HWND)-1 only thread
+    // messages; wMsgFilterMin == wMsgFilterMax == 0 matches every message.
+    bool Peek(MSG* out, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, bool remove) {
+        bool skip[kClassCount];
+        if (wMsgFilterMin == 0 && wMsgFilterMax == 0) {
+            if (hWnd != nullptr) {
+                return PeekIndexed(out, hWnd, 0, UINT_MAX, remove);
+            }
+            for (int c = 0; c < kClassCount; ++c) {
+                skip[c] = live_[c] == 0;
+            }
+        } else {
+            bool partial = hWnd != nullptr;
+            for (int c = 0; c < kClassCount; ++c) {
+                Coverage coverage = Covers(c, wMsgFilterMin, wMsgFilterMax);
+                skip[c] = coverage == kNone || live_[c] == 0;
+                partial |= !skip[c] && coverage == kPartial;
+            }
+            if (partial) {
+                return PeekIndexed(out, hWnd, wMsgFilterMin, wMsgFilterMax, remove);
+            }
+        }
+
+        // Every class is wanted whole or not at all: take the oldest head
+        Entry* best = nullptr;
+        int bestClass = 0;
+        for (int c = 0; c < kClassCount; ++c) {
+            if (skip[c]) {
+                continue;
+            }
+            // Tombstones never stay at the head, so it is the oldest message
+            Entry& entry = rings_[c].front();
+            if (!best || entry.seq < best->seq) {
+                best = &entry;
+                bestClass = c;
+            }
+        }
+        if (!best) {
+            return false;
+        }
+        *out = best->msg;
+        if (remove) {
+            Remove(bestClass, *best);
+        }
+        return true;
+    }
+
+private:
+    enum { kKeyboard, kMouse, kOther, kClassCount };
+    enum Coverage { kNone, kPartial, kWhole };
+
+    // Tombstones or stale index entries a ring tolerates beyond its live count
+    static const size_t kCompactSlack = 32;
+
+    // Empty index keys kept for reuse; past this many keys they are erased
+    static const size_t kMaxIndexKeys = 64;
+
+    struct Entry {
+        MSG msg;
+        uint64_t seq;
+        bool removed;
+    };
+
+    // Sequence numbers of the queued messages with one key, oldest first
+    struct IndexRing {
+        RingBuffer<uint64_t> seqs;
+        size_t live;
+
+        IndexRing() : live(0) {}
+    };
+
+    typedef std::map<std::pair<HWND, UINT>, IndexRing> WindowIndex;
+    typedef std::map<UINT, IndexRing> MessageIndex;
+
+    uint64_t Push(const MSG& msg) {
+        int c = ClassOf(msg.message);
+        Entry entry;
+        entry.msg = msg;
+        entry.seq = nextSeq_++;
+        entry.removed = false;
+        rings_[c].push_back(entry);
+        ++live_[c];
+        if (indexed_) {
+            Index(entry);
+        }
+        return entry.seq;
+    }
+
+    static int ClassOf(UINT message) {
+        if (message >= WM_KEYFIRST && message <= WM_KEYLAST) {
+            return kKeyboard;
+        }
+        if (message >= WM_MOUSEFIRST && message <= WM_MOUSELAST) {
+            return kMouse;
+        }
+        return kOther;
+    }
+
+    // How much of class c the range [first, last] takes in
+    static Coverage Covers(int c, UINT first, UINT last) {
+        if (c == kOther) {
+            if (first == 0 && last == UINT_MAX) {
+                return kWhole;
+            }
+            // A range inside the keyboard or mouse block never matches here
+            if (first > last || (ClassOf(first) != kOther && ClassOf(first) == ClassOf(last))) {
+                return kNone;
+            }
+            return kPartial;
+        }
+        UINT classFirst = (c == kKeyboard) ? WM_KEYFIRST : WM_MOUSEFIRST;
+        UINT classLast = (c == kKeyboard) ? WM_KEYLAST : WM_MOUSELAST;
+        if (last < classFirst || first > classLast) {
+            return kNone;
+        }
+        return (first <= classFirst && last >= classLast) ? kWhole : kPartial;
+    }
+
+    // The queued entry with sequence number seq in class c, or nullptr if it
+    // is gone. Rings are in sequence order, so this is a binary search.
+    Entry* Find(int c, uint64_t seq) {
+        RingBuffer<Entry>& ring = rings_[c];
+        size_t low = 0;
+        size_t high = ring.size();
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (ring[middle].seq < seq) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        if (low == ring.size() || ring[low].seq != seq || ring[low].removed) {
+            return nullptr;
+        }
+        return &ring[low];
+    }
+
+    // Posts usually repeat the previous key, so it skips the map lookups
+    void Index(const Entry& entry) {
+        std::pair<HWND, UINT> key(entry.msg.hwnd, entry.msg.message);
+        if (!lastWindow_ || lastWindow_->first != key) {
+            lastWindow_ = &*byWindow_.insert(std::make_pair(key, IndexRing())).first;
+            lastMessage_ = &*byMessage_.insert(std::make_pair(key.second, IndexRing())).first;
+        }
+        IndexRing& byWindow = lastWindow_->second;
+        byWindow.seqs.push_back(entry.seq);
+        ++byWindow.live;
+        IndexRing& byMessage = lastMessage_->second;
+        byMessage.seqs.push_back(entry.seq);
+        ++byMessage.live;
+    }
+
+    // Index every queued message, the first time a filter needs it
+    void BuildIndexes() {
+        indexed_ = true;
+        for (int c = 0; c < kClassCount; ++c) {
+            RingBuffer<Entry>& ring = rings_[c];
+            size_t count = ring.size();
+            for (size_t i = 0; i < count; ++i) {
+                if (!ring[i].removed) {
+                    Index(ring[i]);
+                }
+            }
+        }
+    }
+
+    // The oldest queued message of an index key, after dropping the stale
+    // entries in front of it
+    Entry* Front(IndexRing& index, int c) {
+        while (!index.seqs.empty()) {
+            Entry* entry = Find(c, index.seqs.front());
+            if (entry) {
+                return entry;
+            }
+            index.seqs.pop_front();
+        }
+        return nullptr;
+    }
+
+    // Account for the removal of one of an index key's messages; returns
+    // true if the key has none left
+    bool Unindex(IndexRing& index, int c) {
+        --index.live;
+        Front(index, c);
+        if (index.seqs.size() > 2 * index.live + kCompactSlack) {
+            index.seqs.remove_if([&](uint64_t seq) { return Find(c, seq) == nullptr; });
+        }
+        return index.seqs.empty();
+    }
+
+    void DropIndexes() {
+        indexed_ = false;
+        byWindow_.clear();
+        byMessage_.clear();
+        lastWindow_ = nullptr;
+        lastMessage_ = nullptr;
+    }
+
+    void Remove(int c, Entry& entry) {
+        entry.removed = true;
+        --live_[c];
+        if (indexed_) {
+            std::pair<HWND, UINT> key(entry.msg.hwnd, entry.msg.message);
+            bool cached = lastWindow_ && lastWindow_->first == key;
+            WindowIndex::iterator byWindow = cached ? byWindow_.end() : byWindow_.find(key);
+            MessageIndex::iterator byMessage = cached ? byMessage_.end() : byMessage_.find(key.second);
+            bool windowDone = Unindex(cached ? lastWindow_->second : byWindow->second, c);
+            bool messageDone = Unindex(cached ? lastMessage_->second : byMessage->second, c);
+            if ((windowDone && byWindow_.size() > kMaxIndexKeys) || (messageDone && byMessage_.size() > kMaxIndexKeys)) {
+                if (windowDone) {
+                    byWindow_.erase(key);
+                }
+                if (messageDone) {
+                    byMessage_.erase(key.second);
+                }
+                lastWindow_ = nullptr;
+                lastMessage_ = nullptr;
+            }
+        }
+        RingBuffer<Entry>& ring = rings_[c];
+        while (!ring.empty() && ring.front().removed) {
+            ring.pop_front();
+        }
+        if (ring.size() > 2 * live_[c] + kCompactSlack) {
+            ring.remove_if([](const Entry& queued) { return queued.removed; });
+        }
+        if (empty()) {
+            // Stop indexing once a whole queueful went by without a filter
+            if (indexed_ && !filtered_) {
+                DropIndexes();
+            }
+            filtered_ = false;
+        }
+    }
+
+    // Peek through the indexes: the oldest front among the keys in the filter
+    bool PeekIndexed(MSG* out, HWND hWnd, UINT first, UINT last, bool remove) {
+        if (!indexed_) {
+            BuildIndexes();
+        }
+        filtered_ = true;
+        Entry* best = nullptr;
+        int bestClass = 0;
+        auto consider = [&](IndexRing& index, UINT message) {
+            int c = ClassOf(message);
+            Entry* entry = Front(index, c);
+            if (entry && (!best || entry->seq < best->seq)) {
+                best = entry;
+                bestClass = c;
+            }
+        };
+        if (first <= last) {
+            if (hWnd != nullptr) {
+                HWND window = (hWnd == (HWND)-1) ? nullptr : hWnd; // Thread messages have no window
+                for (WindowIndex::iterator it = byWindow_.lower_bound(std::make_pair(window, first));
+                     it != byWindow_.end() && it->first.first == window && it->first.second <= last; ++it) {
+                    consider(it->second, it->first.second);
+                }
+            } else {
+                for (MessageIndex::iterator it = byMessage_.lower_bound(first);
+                     it != byMessage_.end() && it->first <= last; ++it) {
+                    consider(it->second, it->first);
+                }
+            }
+        }
+        if (!best) {
+            return false;
+        }
+        *out = best->msg;
+        if (remove) {
+            Remove(bestClass, *best);
+        }
+        return true;
+    }
+
+    RingBuffer<Entry> rings_[kClassCount];
+    size_t live_[kClassCount];
+    uint64_t nextSeq_;
+    uint64_t lastInputSeq_;
+    bool indexed_;
+    bool filtered_;          // A filter used the indexes since the queue was last empty
+    WindowIndex byWindow_;   // By (window, message), for window filters
+    MessageIndex byMessage_; // By message, for ranges that cover part of a class
+    WindowIndex::value_type* lastWindow_;   // Keys of the last message indexed
+    MessageIndex::value_type* lastMessage_;
+};
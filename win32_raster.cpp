@@ -0,0 +1,908 @@
+// win32_raster.cpp - Software rasterizer for the Win32 API Compatibility Layer
+// Span and rectangle kernels for the 32bpp surfaces that back windows.
+
+#ifndef _WIN32
+
+#include "win32_raster.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define RASTER_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define RASTER_NEON
+#endif
+
+// ==============================================================================
+// SURFACE STORAGE
+// ==============================================================================
+
+SurfaceBuffer::~SurfaceBuffer() {
+    free(storage_);
+}
+
+bool SurfaceBuffer::Resize(int width, int height, SurfaceLayout layout, uint32_t fill) {
+    if (width < 0 || height < 0) {
+        return false;
+    }
+    free(storage_);
+    storage_ = nullptr;
+    surface_ = Surface();
+
+    // Aligned rows are padded to a multiple of 16 pixels so every row starts
+    // 64-byte aligned; DIB rows of 32bpp pixels are already DWORD aligned
+    ptrdiff_t stride = (layout == kLayoutAligned) ? (((ptrdiff_t)width + 15) & ~(ptrdiff_t)15) : width;
+    size_t bytes = (size_t)stride * (size_t)height * sizeof(uint32_t);
+    if (bytes > 0) {
+        if (posix_memalign(&storage_, 64, bytes) != 0) {
+            storage_ = nullptr;
+            return false;
+        }
+    }
+    surface_.pixels = (uint32_t*)storage_;
+    surface_.width = width;
+    surface_.height = height;
+    surface_.stride = stride;
+    if (layout == kLayoutDIBBottomUp && height > 0) {
+        surface_.pixels += (ptrdiff_t)(height - 1) * stride;
+        surface_.stride = -stride;
+    }
+    FillRectPixels(surface_, surface_.Bounds(), fill);
+    return true;
+}
+
+// ==============================================================================
+// SPAN FILL KERNELS
+// ==============================================================================
+
+static void FillSpanScalar(uint32_t* dst, int count, uint32_t pixel) {
+    for (int i = 0; i < count; ++i) {
+        dst[i] = pixel;
+    }
+}
+
+#ifdef RASTER_X86
+
+__attribute__((target("sse2")))
+static void FillSpanSSE2(uint32_t* dst, int count, uint32_t pixel) {
+    int i = 0;
+    while (i < count && ((uintptr_t)(dst + i) & 15) != 0) {
+        dst[i++] = pixel;
+    }
+    __m128i v = _mm_set1_epi32((int)pixel);
+    for (; i + 16 <= count; i += 16) {
+        _mm_store_si128((__m128i*)(dst + i), v);
+        _mm_store_si128((__m128i*)(dst + i + 4), v);
+        _mm_store_si128((__m128i*)(dst + i + 8), v);
+        _mm_store_si128((__m128i*)(dst + i + 12), v);
+    }
+    for (; i + 4 <= count; i += 4) {
+        _mm_store_si128((__m128i*)(dst + i), v);
+    }
+    for (; i < count; ++i) {
+        dst[i] = pixel;
+    }
+}
+
+__attribute__((target("avx2")))
+static void FillSpanAVX2(uint32_t* dst, int count, uint32_t pixel) {
+    int i = 0;
+    while (i < count && ((uintptr_t)(dst + i) & 31) != 0) {
+        dst[i++] = pixel;
+    }
+    __m256i v = _mm256_set1_epi32((int)pixel);
+    for (; i + 32 <= count; i += 32) {
+        _mm256_store_si256((__m256i*)(dst + i), v);
+        _mm256_store_si256((__m256i*)(dst + i + 8), v);
+        _mm256_store_si256((__m256i*)(dst + i + 16), v);
+        _mm256_store_si256((__m256i*)(dst + i + 24), v);
+    }
+    for (; i + 8 <= count; i += 8) {
+        _mm256_store_si256((__m256i*)(dst + i), v);
+    }
+    for (; i < count; ++i) {
+        dst[i] = pixel;
+    }
+}
+
+#endif // RASTER_X86
+
+#ifdef RASTER_NEON
+
+static void FillSpanNEON(uint32_t* dst, int count, uint32_t pixel) {
+    uint32x4_t v = vdupq_n_u32(pixel);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        vst1q_u32(dst + i, v);
+        vst1q_u32(dst + i + 4, v);
+        vst1q_u32(dst + i + 8, v);
+        vst1q_u32(dst + i + 12, v);
+    }
+    for (; i + 4 <= count; i += 4) {
+        vst1q_u32(dst + i, v);
+    }
+    for (; i < count; ++i) {
+        dst[i] = pixel;
+    }
+}
+
+#endif // RASTER_NEON
+
+typedef void (*FillSpanFn)(uint32_t*, int, uint32_t);
+
+// Pick the widest kernel the CPU supports, once
+static FillSpanFn SelectFillSpan() {
+#if defined(RASTER_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return FillSpanAVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return FillSpanSSE2;
+    }
+#elif defined(RASTER_NEON)
+    return FillSpanNEON;
+#endif
+    return FillSpanScalar;
+}
+
+void FillSpan(uint32_t* dst, int count, uint32_t pixel) {
+    static const FillSpanFn fill = SelectFillSpan();
+    if (count < 8) {
+        FillSpanScalar(dst, count, pixel);
+    } else {
+        fill(dst, count, pixel);
+    }
+}
+
+// Per-channel lerp; a run of fully covered pixels (glyph stems, most of an
+// integer-scaled bitmap font) degenerates to plain stores
+void BlendCoverageSpan(uint32_t* dst, const uint8_t* coverage, int count, uint32_t pixel) {
+    uint32_t srcRB = pixel & 0x00FF00FFu;
+    uint32_t srcG = pixel & 0x0000FF00u;
+    for (int i = 0; i < count; ++i) {
+        uint32_t a = coverage[i];
+        if (a == 0) {
+            continue;
+        }
+        if (a == 255) {
+            dst[i] = pixel;
+            continue;
+        }
+        a += a >> 7; // 0..256
+        uint32_t d = dst[i];
+        uint32_t rb = ((srcRB * a + (d & 0x00FF00FFu) * (256 - a)) >> 8) & 0x00FF00FFu;
+        uint32_t g = ((srcG * a + (d & 0x0000FF00u) * (256 - a)) >> 8) & 0x0000FF00u;
+        dst[i] = 0xFF000000u | rb | g;
+    }
+}
+
+// ==============================================================================
+// RASTER OPERATION KERNELS
+// ==============================================================================
+
+static const uint32_t kColorMask = 0x00FFFFFFu;
+
+template <RasterOp Op>
+static inline uint32_t ApplyRop(uint32_t d, uint32_t s) {
+    switch (Op) {
+        case kRopSrcCopy:     return s;
+        case kRopSrcAnd:      return s & d;
+        case kRopSrcPaint:    return s | d;
+        case kRopSrcInvert:   return s ^ d;
+        case kRopSrcErase:    return s & (d ^ kColorMask);
+        case kRopNotSrcCopy:  return s ^ kColorMask;
+        case kRopNotSrcErase: return (s | d) ^ kColorMask;
+        case kRopMergePaint:  return (s ^ kColorMask) | d;
+    }
+    return s;
+}
+
+template <RasterOp Op>
+static void RopSpanScalar(uint32_t* dst, const uint32_t* src, int count) {
+    for (int i = 0; i < count; ++i) {
+        dst[i] = ApplyRop<Op>(dst[i], src[i]);
+    }
+}
+
+#ifdef RASTER_X86
+
+template <RasterOp Op>
+__attribute__((target("sse2")))
+static inline __m128i ApplyRopSSE2(__m128i d, __m128i s, __m128i mask) {
+    switch (Op) {
+        case kRopSrcCopy:     return s;
+        case kRopSrcAnd:      return _mm_and_si128(s, d);
+        case kRopSrcPaint:    return _mm_or_si128(s, d);
+        case kRopSrcInvert:   return _mm_xor_si128(s, d);
+        case kRopSrcErase:    return _mm_and_si128(s, _mm_xor_si128(d, mask));
+        case kRopNotSrcCopy:  return _mm_xor_si128(s, mask);
+        case kRopNotSrcErase: return _mm_xor_si128(_mm_or_si128(s, d), mask);
+        case kRopMergePaint:  return _mm_or_si128(_mm_xor_si128(s, mask), d);
+    }
+    return s;
+}
+
+template <RasterOp Op>
+__attribute__((target("sse2")))
+static void RopSpanSSE2(uint32_t* dst, const uint32_t* src, int count) {
+    __m128i mask = _mm_set1_epi32((int)kColorMask);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), ApplyRopSSE2<Op>(d, s, mask));
+    }
+    RopSpanScalar<Op>(dst + i, src + i, count - i);
+}
+
+template <RasterOp Op>
+__attribute__((target("avx2")))
+static inline __m256i ApplyRopAVX2(__m256i d, __m256i s, __m256i mask) {
+    switch (Op) {
+        case kRopSrcCopy:     return s;
+        case kRopSrcAnd:      return _mm256_and_si256(s, d);
+        case kRopSrcPaint:    return _mm256_or_si256(s, d);
+        case kRopSrcInvert:   return _mm256_xor_si256(s, d);
+        case kRopSrcErase:    return _mm256_and_si256(s, _mm256_xor_si256(d, mask));
+        case kRopNotSrcCopy:  return _mm256_xor_si256(s, mask);
+        case kRopNotSrcErase: return _mm256_xor_si256(_mm256_or_si256(s, d), mask);
+        case kRopMergePaint:  return _mm256_or_si256(_mm256_xor_si256(s, mask), d);
+    }
+    return s;
+}
+
+template <RasterOp Op>
+__attribute__((target("avx2")))
+static void RopSpanAVX2(uint32_t* dst, const uint32_t* src, int count) {
+    __m256i mask = _mm256_set1_epi32((int)kColorMask);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), ApplyRopAVX2<Op>(d, s, mask));
+    }
+    RopSpanScalar<Op>(dst + i, src + i, count - i);
+}
+
+#endif // RASTER_X86
+
+typedef void (*RopSpanFn)(uint32_t*, const uint32_t*, int);
+
+struct RopSpanTable {
+    RopSpanFn fn[8];
+};
+
+template <template <RasterOp> class Kernel>
+static RopSpanTable MakeRopTable() {
+    RopSpanTable table = {{
+        Kernel<kRopSrcCopy>::Run, Kernel<kRopSrcAnd>::Run, Kernel<kRopSrcPaint>::Run,
+        Kernel<kRopSrcInvert>::Run, Kernel<kRopSrcErase>::Run, Kernel<kRopNotSrcCopy>::Run,
+        Kernel<kRopNotSrcErase>::Run, Kernel<kRopMergePaint>::Run,
+    }};
+    return table;
+}
+
+template <RasterOp Op> struct RopScalarKernel { static void Run(uint32_t* d, const uint32_t* s, int n) { RopSpanScalar<Op>(d, s, n); } };
+#ifdef RASTER_X86
+template <RasterOp Op> struct RopSSE2Kernel { static void Run(uint32_t* d, const uint32_t* s, int n) { RopSpanSSE2<Op>(d, s, n); } };
+template <RasterOp Op> struct RopAVX2Kernel { static void Run(uint32_t* d, const uint32_t* s, int n) { RopSpanAVX2<Op>(d, s, n); } };
+#endif
+
+static RopSpanTable SelectRopSpans() {
+#if defined(RASTER_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return MakeRopTable<RopAVX2Kernel>();
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return MakeRopTable<RopSSE2Kernel>();
+    }
+#endif
+    // NEON builds rely on the compiler vectorizing the scalar loops
+    return MakeRopTable<RopScalarKernel>();
+}
+
+void RasterOpSpan(uint32_t* dst, const uint32_t* src, int count, RasterOp op) {
+    if (count <= 0) {
+        return;
+    }
+    if (op == kRopSrcCopy) {
+        if (dst != src) {
+            memmove(dst, src, (size_t)count * sizeof(uint32_t));
+        }
+        return;
+    }
+    static const RopSpanTable table = SelectRopSpans();
+    table.fn[op](dst, src, count);
+}
+
+// ==============================================================================
+// ALPHA BLEND KERNELS
+// ==============================================================================
+
+// x / 255 rounded, exact for x <= 255 * 255
+static inline uint32_t Div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static void AlphaBlendSpanScalar(uint32_t* dst, const uint32_t* src, int count, uint8_t constantAlpha, bool srcAlpha) {
+    for (int i = 0; i < count; ++i) {
+        uint32_t s = src[i];
+        if (constantAlpha != 255) {
+            s = Div255((s & 0xFF) * constantAlpha) |
+                (Div255(((s >> 8) & 0xFF) * constantAlpha) << 8) |
+                (Div255(((s >> 16) & 0xFF) * constantAlpha) << 16) |
+                (Div255((s >> 24) * constantAlpha) << 24);
+        }
+        uint32_t inverse = 255 - (srcAlpha ? (s >> 24) : constantAlpha);
+        if (inverse == 0) {
+            dst[i] = s;
+            continue;
+        }
+        uint32_t d = dst[i];
+        uint32_t out = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            // Saturate like the SIMD packs when the source is not validly premultiplied
+            uint32_t c = ((s >> shift) & 0xFF) + Div255(((d >> shift) & 0xFF) * inverse);
+            out |= (c > 255 ? 255 : c) << shift;
+        }
+        dst[i] = out;
+    }
+}
+
+#ifdef RASTER_X86
+
+// Blend eight 16-bit channels (two pixels) of source and destination
+__attribute__((target("sse2")))
+static inline __m128i BlendHalfSSE2(__m128i s, __m128i d, __m128i constantAlpha, bool scale, bool srcAlpha) {
+    const __m128i round = _mm_set1_epi16(128);
+    if (scale) {
+        s = _mm_mullo_epi16(s, constantAlpha);
+        s = _mm_add_epi16(s, round);
+        s = _mm_srli_epi16(_mm_add_epi16(s, _mm_srli_epi16(s, 8)), 8);
+    }
+    __m128i alpha = srcAlpha ? _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF) : constantAlpha;
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+    d = _mm_add_epi16(_mm_mullo_epi16(d, inverse), round);
+    d = _mm_srli_epi16(_mm_add_epi16(d, _mm_srli_epi16(d, 8)), 8);
+    return _mm_add_epi16(s, d);
+}
+
+__attribute__((target("sse2")))
+static void AlphaBlendSpanSSE2(uint32_t* dst, const uint32_t* src, int count, uint8_t constantAlpha, bool srcAlpha) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_set1_epi32((int)0xFF000000u);
+    const __m128i ca = _mm_set1_epi16(constantAlpha);
+    bool scale = constantAlpha != 255;
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        if (srcAlpha && !scale) {
+            // Fully opaque or fully transparent groups skip the arithmetic
+            __m128i a = _mm_and_si128(s, alphaMask);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, alphaMask)) == 0xFFFF) {
+                _mm_storeu_si128((__m128i*)(dst + i), s);
+                continue;
+            }
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xFFFF) {
+                continue;
+            }
+        }
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i lo = BlendHalfSSE2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), ca, scale, srcAlpha);
+        __m128i hi = BlendHalfSSE2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), ca, scale, srcAlpha);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    AlphaBlendSpanScalar(dst + i, src + i, count - i, constantAlpha, srcAlpha);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i BlendHalfAVX2(__m256i s, __m256i d, __m256i constantAlpha, bool scale, bool srcAlpha) {
+    const __m256i round = _mm256_set1_epi16(128);
+    if (scale) {
+        s = _mm256_mullo_epi16(s, constantAlpha);
+        s = _mm256_add_epi16(s, round);
+        s = _mm256_srli_epi16(_mm256_add_epi16(s, _mm256_srli_epi16(s, 8)), 8);
+    }
+    __m256i alpha = srcAlpha ? _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF) : constantAlpha;
+    __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+    d = _mm256_add_epi16(_mm256_mullo_epi16(d, inverse), round);
+    d = _mm256_srli_epi16(_mm256_add_epi16(d, _mm256_srli_epi16(d, 8)), 8);
+    return _mm256_add_epi16(s, d);
+}
+
+// Unpack and pack work within 128-bit lanes, so pixel order is preserved
+__attribute__((target("avx2")))
+static void AlphaBlendSpanAVX2(uint32_t* dst, const uint32_t* src, int count, uint8_t constantAlpha, bool srcAlpha) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alphaMask = _mm256_set1_epi32((int)0xFF000000u);
+    const __m256i ca = _mm256_set1_epi16(constantAlpha);
+    bool scale = constantAlpha != 255;
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        if (srcAlpha && !scale) {
+            __m256i a = _mm256_and_si256(s, alphaMask);
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, alphaMask)) == -1) {
+                _mm256_storeu_si256((__m256i*)(dst + i), s);
+                continue;
+            }
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s, zero)) == -1) {
+                continue;
+            }
+        }
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i lo = BlendHalfAVX2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), ca, scale, srcAlpha);
+        __m256i hi = BlendHalfAVX2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), ca, scale, srcAlpha);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    AlphaBlendSpanScalar(dst + i, src + i, count - i, constantAlpha, srcAlpha);
+}
+
+#endif // RASTER_X86
+
+typedef void (*AlphaBlendSpanFn)(uint32_t*, const uint32_t*, int, uint8_t, bool);
+
+static AlphaBlendSpanFn SelectAlphaBlendSpan() {
+#if defined(RASTER_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return AlphaBlendSpanAVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return AlphaBlendSpanSSE2;
+    }
+#endif
+    return AlphaBlendSpanScalar;
+}
+
+void AlphaBlendSpan(uint32_t* dst, const uint32_t* src, int count, uint8_t constantAlpha, bool srcAlpha) {
+    static const AlphaBlendSpanFn blend = SelectAlphaBlendSpan();
+    if (count > 0 && constantAlpha != 0) {
+        blend(dst, src, count, constantAlpha, srcAlpha);
+    }
+}
+
+// ==============================================================================
+// PIXEL HASH KERNELS
+// ==============================================================================
+
+// Spans are consumed in blocks of 8 pixels, as four 64-bit lanes. Each lane
+// accumulates the 32x32-bit product of its two halves, mixed with a key,
+// plus the neighbouring lane's data, which the product alone could lose.
+// Keys advance with every block, so moving a block changes the hash. The
+// vector kernels compute exactly what the scalar one does.
+static const uint64_t kHashKeys[4] = {
+    0x9E3779B185EBCA87ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0x85EBCA77C2B2AE63ull,
+};
+static const uint64_t kHashKeyStep = 0x9E3779B97F4A7C15ull;
+
+static inline uint64_t MixHash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// Accumulators and keys, carried from one span to the next
+struct HashState {
+    uint64_t acc[4];
+    uint64_t key[4];
+};
+
+static void HashBlocksScalar(HashState& state, const uint32_t* src, int blocks) {
+    for (int block = 0; block < blocks; ++block, src += 8) {
+        uint64_t data[4];
+        memcpy(data, src, sizeof(data));
+        for (int lane = 0; lane < 4; ++lane) {
+            uint64_t mixed = data[lane] ^ state.key[lane];
+            state.acc[lane] += data[lane ^ 1] + (mixed & 0xFFFFFFFFu) * (mixed >> 32);
+            state.key[lane] += kHashKeyStep;
+        }
+    }
+}
+
+#ifdef RASTER_X86
+
+__attribute__((target("sse2")))
+static inline void HashLanesSSE2(__m128i& acc, __m128i& key, __m128i data, __m128i step) {
+    __m128i mixed = _mm_xor_si128(data, key);
+    __m128i product = _mm_mul_epu32(mixed, _mm_srli_epi64(mixed, 32));
+    __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+    acc = _mm_add_epi64(acc, _mm_add_epi64(swapped, product));
+    key = _mm_add_epi64(key, step);
+}
+
+__attribute__((target("sse2")))
+static void HashBlocksSSE2(HashState& state, const uint32_t* src, int blocks) {
+    __m128i acc0 = _mm_loadu_si128((const __m128i*)state.acc);
+    __m128i acc1 = _mm_loadu_si128((const __m128i*)(state.acc + 2));
+    __m128i key0 = _mm_loadu_si128((const __m128i*)state.key);
+    __m128i key1 = _mm_loadu_si128((const __m128i*)(state.key + 2));
+    __m128i step = _mm_set1_epi64x((long long)kHashKeyStep);
+    for (int block = 0; block < blocks; ++block, src += 8) {
+        HashLanesSSE2(acc0, key0, _mm_loadu_si128((const __m128i*)src), step);
+        HashLanesSSE2(acc1, key1, _mm_loadu_si128((const __m128i*)(src + 4)), step);
+    }
+    _mm_storeu_si128((__m128i*)state.acc, acc0);
+    _mm_storeu_si128((__m128i*)(state.acc + 2), acc1);
+    _mm_storeu_si128((__m128i*)state.key, key0);
+    _mm_storeu_si128((__m128i*)(state.key + 2), key1);
+}
+
+__attribute__((target("avx2")))
+static void HashBlocksAVX2(HashState& state, const uint32_t* src, int blocks) {
+    __m256i acc = _mm256_loadu_si256((const __m256i*)state.acc);
+    __m256i key = _mm256_loadu_si256((const __m256i*)state.key);
+    __m256i step = _mm256_set1_epi64x((long long)kHashKeyStep);
+    for (int block = 0; block < blocks; ++block, src += 8) {
+        __m256i data = _mm256_loadu_si256((const __m256i*)src);
+        __m256i mixed = _mm256_xor_si256(data, key);
+        __m256i product = _mm256_mul_epu32(mixed, _mm256_srli_epi64(mixed, 32));
+        __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+        acc = _mm256_add_epi64(acc, _mm256_add_epi64(swapped, product));
+        key = _mm256_add_epi64(key, step);
+    }
+    _mm256_storeu_si256((__m256i*)state.acc, acc);
+    _mm256_storeu_si256((__m256i*)state.key, key);
+}
+
+#endif // RASTER_X86
+
+#ifdef RASTER_NEON
+
+static inline void HashLanesNEON(uint64x2_t& acc, uint64x2_t& key, uint64x2_t data, uint64x2_t step) {
+    uint64x2_t mixed = veorq_u64(data, key);
+    uint64x2_t product = vmull_u32(vmovn_u64(mixed), vshrn_n_u64(mixed, 32));
+    acc = vaddq_u64(acc, vaddq_u64(vextq_u64(data, data, 1), product));
+    key = vaddq_u64(key, step);
+}
+
+static void HashBlocksNEON(HashState& state, const uint32_t* src, int blocks) {
+    uint64x2_t acc0 = vld1q_u64(state.acc);
+    uint64x2_t acc1 = vld1q_u64(state.acc + 2);
+    uint64x2_t key0 = vld1q_u64(state.key);
+    uint64x2_t key1 = vld1q_u64(state.key + 2);
+    uint64x2_t step = vdupq_n_u64(kHashKeyStep);
+    for (int block = 0; block < blocks; ++block, src += 8) {
+        HashLanesNEON(acc0, key0, vreinterpretq_u64_u32(vld1q_u32(src)), step);
+        HashLanesNEON(acc1, key1, vreinterpretq_u64_u32(vld1q_u32(src + 4)), step);
+    }
+    vst1q_u64(state.acc, acc0);
+    vst1q_u64(state.acc + 2, acc1);
+    vst1q_u64(state.key, key0);
+    vst1q_u64(state.key + 2, key1);
+}
+
+#endif // RASTER_NEON
+
+typedef void (*HashBlocksFn)(HashState&, const uint32_t*, int);
+
+static HashBlocksFn SelectHashBlocks() {
+#if defined(RASTER_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return HashBlocksAVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return HashBlocksSSE2;
+    }
+#elif defined(RASTER_NEON)
+    return HashBlocksNEON;
+#endif
+    return HashBlocksScalar;
+}
+
+// The last block of each row is zero-padded
+uint64_t HashPixels(const Surface& surface, const RECT& rect) {
+    static const HashBlocksFn hashBlocks = SelectHashBlocks();
+    HashState state;
+    for (int lane = 0; lane < 4; ++lane) {
+        state.acc[lane] = 0;
+        state.key[lane] = kHashKeys[lane];
+    }
+    int width = rect.right - rect.left;
+    for (int y = rect.top; y < rect.bottom && width > 0; ++y) {
+        const uint32_t* row = surface.Row(y) + rect.left;
+        hashBlocks(state, row, width / 8);
+        if (width % 8) {
+            uint32_t tail[8] = {};
+            memcpy(tail, row + (width & ~7), (size_t)(width % 8) * sizeof(uint32_t));
+            hashBlocks(state, tail, 1);
+        }
+    }
+    uint64_t h = MixHash(((uint64_t)(uint32_t)width << 32) | (uint32_t)(rect.bottom - rect.top));
+    for (int lane = 0; lane < 4; ++lane) {
+        h = MixHash(h ^ state.acc[lane]);
+    }
+    return h;
+}
+
+// ==============================================================================
+// SHAPES
+// ==============================================================================
+
+void FillRectPixels(const Surface& surface, const RECT& rect, uint32_t pixel) {
+    int width = rect.right - rect.left;
+    if (width <= 0 || rect.bottom <= rect.top) {
+        return;
+    }
+    for (int y = rect.top; y < rect.bottom; ++y) {
+        FillSpan(surface.Row(y) + rect.left, width, pixel);
+    }
+}
+
+void InvertRectPixels(const Surface& surface, const RECT& rect) {
+    for (int y = rect.top; y < rect.bottom; ++y) {
+        uint32_t* row = surface.Row(y) + rect.left;
+        RasterOpSpan(row, row, rect.right - rect.left, kRopNotSrcCopy);
+    }
+}
+
+void DrawLinePixels(const Surface& surface, const RECT& clip, int x0, int y0, int x1, int y1, uint32_t pixel) {
+    // Horizontal and vertical lines are spans: clip analytically
+    if (y0 == y1) {
+        if (y0 < clip.top || y0 >= clip.bottom) {
+            return;
+        }
+        int left = (x0 < x1) ? x0 : x1 + 1;
+        int right = (x0 < x1) ? x1 : x0 + 1;
+        if (left < clip.left) left = clip.left;
+        if (right > clip.right) right = clip.right;
+        if (right > left) {
+            FillSpan(surface.Row(y0) + left, right - left, pixel);
+        }
+        return;
+    }
+    if (x0 == x1) {
+        if (x0 < clip.left || x0 >= clip.right) {
+            return;
+        }
+        int top = (y0 < y1) ? y0 : y1 + 1;
+        int bottom = (y0 < y1) ? y1 : y0 + 1;
+        if (top < clip.top) top = clip.top;
+        if (bottom > clip.bottom) bottom = clip.bottom;
+        for (int y = top; y < bottom; ++y) {
+            surface.Row(y)[x0] = pixel;
+        }
+        return;
+    }
+
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int sx = (x0 < x1) ? 1 : -1;
+    int sy = (y0 < y1) ? 1 : -1;
+    int err = dx + dy;
+    int x = x0;
+    int y = y0;
+    while (x != x1 || y != y1) {
+        if (x >= clip.left && x < clip.right && y >= clip.top && y < clip.bottom) {
+            surface.Row(y)[x] = pixel;
+        }
+        int e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            x += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            y += sy;
+        }
+    }
+}
+
+// ==============================================================================
+// BLITS
+// ==============================================================================
+
+// Per-thread row buffers, grown on demand so steady-state blits do not allocate
+static thread_local std::vector<uint32_t> t_rowScratch;
+static thread_local std::vector<uint32_t> t_columnScratch;
+static thread_local std::vector<uint32_t> t_filterScratch;
+
+static uint32_t* RowScratch(size_t count) {
+    if (t_rowScratch.size() < count) {
+        t_rowScratch.resize(count);
+    }
+    return t_rowScratch.data();
+}
+
+static uint32_t* ColumnScratch(size_t count) {
+    if (t_columnScratch.size() < count) {
+        t_columnScratch.resize(count);
+    }
+    return t_columnScratch.data();
+}
+
+void BlitPixels(const Surface& dst, int dstX, int dstY, const Surface& src, int srcX, int srcY,
+                int width, int height, RasterOp op) {
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    bool sameSurface = dst.pixels == src.pixels && dst.stride == src.stride;
+    // Walk bottom-up when copying downwards within one surface
+    bool reverse = sameSurface && dstY > srcY;
+    // Combining ops read the destination, so an overlapping source row has
+    // to be copied out before it is overwritten
+    uint32_t* scratch = (sameSurface && op != kRopSrcCopy) ? RowScratch(width) : nullptr;
+    for (int i = 0; i < height; ++i) {
+        int row = reverse ? height - 1 - i : i;
+        uint32_t* d = dst.Row(dstY + row) + dstX;
+        const uint32_t* s = src.Row(srcY + row) + srcX;
+        if (scratch) {
+            memcpy(scratch, s, (size_t)width * sizeof(uint32_t));
+            s = scratch;
+        }
+        RasterOpSpan(d, s, width, op);
+    }
+}
+
+// Linear interpolation of all four channels with an 8-bit weight
+static inline uint32_t LerpPixel(uint32_t a, uint32_t b, uint32_t weight) {
+    uint32_t rb = (((a & 0x00FF00FFu) * (256 - weight) + (b & 0x00FF00FFu) * weight) >> 8) & 0x00FF00FFu;
+    uint32_t ag = ((((a >> 8) & 0x00FF00FFu) * (256 - weight) + ((b >> 8) & 0x00FF00FFu) * weight)) & 0xFF00FF00u;
+    return rb | ag;
+}
+
+static inline int ClampInt(int v, int lo, int hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// Source position of destination pixel i of n covering count source pixels,
+// in 16.16 fixed point relative to the first source pixel. Nearest sampling
+// takes the pixel under the destination pixel's center; bilinear sampling
+// is offset by half a pixel so centers line up.
+static inline int64_t SamplePosition(int i, int n, int count, bool bilinear) {
+    int64_t pos = ((int64_t)(2 * i + 1) * count << 16) / (2 * (int64_t)n);
+    return bilinear ? pos - 32768 : pos;
+}
+
+void StretchPixels(const Surface& dst, const RECT& dstRect, const RECT& clip,
+                   const Surface& src, const RECT& srcRect, bool mirrorX, bool mirrorY,
+                   StretchFilter filter, RasterOp op) {
+    int dstWidth = dstRect.right - dstRect.left;
+    int dstHeight = dstRect.bottom - dstRect.top;
+    int srcWidth = srcRect.right - srcRect.left;
+    int srcHeight = srcRect.bottom - srcRect.top;
+    RECT area;
+    if (dstWidth <= 0 || dstHeight <= 0 || srcWidth <= 0 || srcHeight <= 0 ||
+        !IntersectRect(&area, &dstRect, &clip)) {
+        return;
+    }
+    // Samples stay inside the source rectangle and the surface
+    RECT bounds = src.Bounds();
+    RECT limit;
+    if (!IntersectRect(&limit, &srcRect, &bounds)) {
+        return;
+    }
+
+    if (dstWidth == srcWidth && dstHeight == srcHeight && !mirrorX && !mirrorY &&
+        srcRect.left == limit.left && srcRect.top == limit.top &&
+        srcRect.right == limit.right && srcRect.bottom == limit.bottom) {
+        BlitPixels(dst, area.left, area.top, src,
+                   srcRect.left + (area.left - dstRect.left), srcRect.top + (area.top - dstRect.top),
+                   area.right - area.left, area.bottom - area.top, op);
+        return;
+    }
+
+    bool bilinear = filter == kStretchBilinear;
+    int count = area.right - area.left;
+    // Column table: source x, and for bilinear the weight in bits 24-31
+    uint32_t* columns = ColumnScratch(count);
+    for (int i = 0; i < count; ++i) {
+        int column = area.left + i - dstRect.left;
+        if (mirrorX) {
+            column = dstWidth - 1 - column;
+        }
+        int64_t pos = SamplePosition(column, dstWidth, srcWidth, bilinear);
+        int x = srcRect.left + (int)(pos >> 16);
+        uint32_t weight = bilinear ? (uint32_t)((pos >> 8) & 0xFF) : 0;
+        if (x < limit.left) {
+            x = limit.left;
+            weight = 0;
+        }
+        columns[i] = (uint32_t)ClampInt(x, limit.left, limit.right - 1) | (weight << 24);
+    }
+
+    // Bilinear rows are filtered vertically over the source columns in use
+    // first, so each destination pixel needs a single horizontal lerp
+    int spanLeft = limit.right;
+    int spanRight = limit.left;
+    uint32_t* filtered = nullptr;
+    if (bilinear) {
+        for (int i = 0; i < count; ++i) {
+            int x = (int)(columns[i] & 0xFFFFFFu);
+            spanLeft = x < spanLeft ? x : spanLeft;
+            spanRight = x + 1 > spanRight ? x + 1 : spanRight;
+        }
+        spanRight = spanRight < limit.right ? spanRight + 1 : limit.right;
+        if (t_filterScratch.size() < (size_t)(spanRight - spanLeft)) {
+            t_filterScratch.resize(spanRight - spanLeft);
+        }
+        filtered = t_filterScratch.data();
+    }
+
+    uint32_t* scratch = RowScratch(count);
+    for (int y = area.top; y < area.bottom; ++y) {
+        int row = y - dstRect.top;
+        if (mirrorY) {
+            row = dstHeight - 1 - row;
+        }
+        int64_t pos = SamplePosition(row, dstHeight, srcHeight, bilinear);
+        int sy = srcRect.top + (int)(pos >> 16);
+        uint32_t wy = bilinear ? (uint32_t)((pos >> 8) & 0xFF) : 0;
+        if (sy < limit.top) {
+            sy = limit.top;
+            wy = 0;
+        }
+        sy = ClampInt(sy, limit.top, limit.bottom - 1);
+        const uint32_t* row0 = src.Row(sy);
+
+        if (!bilinear) {
+            for (int i = 0; i < count; ++i) {
+                scratch[i] = row0[columns[i]];
+            }
+        } else {
+            const uint32_t* row1 = src.Row(sy + 1 < limit.bottom ? sy + 1 : sy);
+            for (int x = spanLeft; x < spanRight; ++x) {
+                filtered[x - spanLeft] = wy ? LerpPixel(row0[x], row1[x], wy) : row0[x];
+            }
+            int lastColumn = limit.right - 1;
+            for (int i = 0; i < count; ++i) {
+                int x = (int)(columns[i] & 0xFFFFFFu);
+                uint32_t wx = columns[i] >> 24;
+                const uint32_t* p = filtered + (x - spanLeft);
+                scratch[i] = wx ? LerpPixel(p[0], p[x < lastColumn ? 1 : 0], wx) : p[0];
+            }
+        }
+        RasterOpSpan(dst.Row(y) + area.left, scratch, count, op);
+    }
+}
+
+void AlphaBlendPixels(const Surface& dst, const RECT& dstRect, const RECT& clip,
+                      const Surface& src, const RECT& srcRect, uint8_t constantAlpha, bool srcAlpha) {
+    int dstWidth = dstRect.right - dstRect.left;
+    int dstHeight = dstRect.bottom - dstRect.top;
+    int srcWidth = srcRect.right - srcRect.left;
+    int srcHeight = srcRect.bottom - srcRect.top;
+    RECT area;
+    if (dstWidth <= 0 || dstHeight <= 0 || srcWidth <= 0 || srcHeight <= 0 ||
+        !IntersectRect(&area, &dstRect, &clip)) {
+        return;
+    }
+    int count = area.right - area.left;
+    bool scaled = dstWidth != srcWidth || dstHeight != srcHeight;
+    uint32_t* scratch = nullptr;
+    uint32_t* columns = nullptr;
+    if (scaled) {
+        scratch = RowScratch(count);
+        columns = ColumnScratch(count);
+        for (int i = 0; i < count; ++i) {
+            columns[i] = (uint32_t)(srcRect.left + (int)(SamplePosition(area.left + i - dstRect.left, dstWidth, srcWidth, false) >> 16));
+        }
+    }
+    for (int y = area.top; y < area.bottom; ++y) {
+        const uint32_t* s;
+        if (!scaled) {
+            s = src.Row(srcRect.top + (y - dstRect.top)) + srcRect.left + (area.left - dstRect.left);
+        } else {
+            int sy = srcRect.top + (int)(SamplePosition(y - dstRect.top, dstHeight, srcHeight, false) >> 16);
+            const uint32_t* row = src.Row(sy);
+            for (int i = 0; i < count; ++i) {
+                scratch[i] = row[columns[i]];
+            }
+            s = scratch;
+        }
+        AlphaBlendSpan(dst.Row(y) + area.left, s, count, constantAlpha, srcAlpha);
+    }
+}
+
+#endif // !_WIN32
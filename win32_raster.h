@@ -0,0 +1,132 @@
+// win32_raster.h - Software rasterizer for the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+#pragma once
+
+#include "win32_compat.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// View of 32bpp BGRA pixels (0xAARRGGBB as a little-endian uint32_t).
+// Rows are top-down for a positive stride and bottom-up for a negative one,
+// which is how bottom-up DIBs are addressed without copying.
+struct Surface {
+    uint32_t* pixels;  // Top row
+    int width;
+    int height;
+    ptrdiff_t stride;  // Distance between rows, in pixels
+
+    Surface() : pixels(nullptr), width(0), height(0), stride(0) {}
+
+    uint32_t* Row(int y) const { return pixels + y * stride; }
+    RECT Bounds() const {
+        RECT r = { 0, 0, width, height };
+        return r;
+    }
+};
+
+// Row layout of a SurfaceBuffer. Window and compatible bitmaps pad rows for
+// aligned SIMD stores; DIB sections use the packed layout applications
+// address directly through their bits pointer.
+enum SurfaceLayout {
+    kLayoutAligned,      // Top-down, rows padded to 64 bytes
+    kLayoutDIBTopDown,   // Top-down, packed rows (negative biHeight)
+    kLayoutDIBBottomUp,  // Bottom-up, packed rows (positive biHeight)
+};
+
+// Owned, 64-byte aligned pixel storage backing a Surface
+class SurfaceBuffer {
+public:
+    SurfaceBuffer() : storage_(nullptr) {}
+    ~SurfaceBuffer();
+
+    SurfaceBuffer(const SurfaceBuffer&) = delete;
+    SurfaceBuffer& operator=(const SurfaceBuffer&) = delete;
+
+    // Reallocate for a new size; contents are cleared to fill
+    bool Resize(int width, int height, SurfaceLayout layout = kLayoutAligned, uint32_t fill = 0xFFFFFFFFu);
+    const Surface& surface() const { return surface_; }
+    void* storage() const { return storage_; } // Start of memory, the bottom row for bottom-up DIBs
+
+private:
+    void* storage_;
+    Surface surface_;
+};
+
+// Convert a COLORREF (0x00BBGGRR) to an opaque surface pixel and back
+inline uint32_t ColorRefToPixel(DWORD color) {
+    return 0xFF000000u | ((color & 0xFFu) << 16) | (color & 0xFF00u) | ((color >> 16) & 0xFFu);
+}
+
+inline DWORD PixelToColorRef(uint32_t pixel) {
+    return ((pixel >> 16) & 0xFFu) | (pixel & 0xFF00u) | ((pixel & 0xFFu) << 16);
+}
+
+// Fill count pixels with one value (SSE2/AVX2/NEON when available)
+void FillSpan(uint32_t* dst, int count, uint32_t pixel);
+
+// Blend pixel over count pixels, weighted by 8-bit coverage (0 keeps the
+// destination, 255 replaces it)
+void BlendCoverageSpan(uint32_t* dst, const uint8_t* coverage, int count, uint32_t pixel);
+
+// Fill a rectangle that is already clipped to the surface
+void FillRectPixels(const Surface& surface, const RECT& rect, uint32_t pixel);
+
+// Invert the color channels of a rectangle already clipped to the surface
+void InvertRectPixels(const Surface& surface, const RECT& rect);
+
+// 64-bit hash of the pixels of a rectangle already clipped to the surface
+// (SSE2/AVX2/NEON when available), for telling whether an area changed.
+// Every kernel returns the same value.
+uint64_t HashPixels(const Surface& surface, const RECT& rect);
+
+// Bresenham line from (x0, y0) towards (x1, y1), excluding the end point as
+// LineTo does. Pixels outside clip are skipped, so the set of pixels drawn
+// never depends on the clip rectangle.
+void DrawLinePixels(const Surface& surface, const RECT& clip, int x0, int y0, int x1, int y1, uint32_t pixel);
+
+// Raster operations that combine a source with the destination. They act on
+// whole pixels, so alpha passes through AND/OR/XOR like a color channel,
+// while the NOT forms invert only the color channels.
+enum RasterOp {
+    kRopSrcCopy,     // S
+    kRopSrcAnd,      // S & D
+    kRopSrcPaint,    // S | D
+    kRopSrcInvert,   // S ^ D
+    kRopSrcErase,    // S & ~D
+    kRopNotSrcCopy,  // ~S
+    kRopNotSrcErase, // ~(S | D)
+    kRopMergePaint,  // ~S | D
+};
+
+// Combine count source pixels into dst (SSE2/AVX2 when available). dst and
+// src may only overlap if they are the same pointer or op is kRopSrcCopy.
+void RasterOpSpan(uint32_t* dst, const uint32_t* src, int count, RasterOp op);
+
+// Source-over blend of count pixels, as AlphaBlend does. With srcAlpha the
+// source is premultiplied and its alpha weights the destination; either way
+// the source is first scaled by constantAlpha.
+void AlphaBlendSpan(uint32_t* dst, const uint32_t* src, int count, uint8_t constantAlpha, bool srcAlpha);
+
+// Copy or combine a rectangle between surfaces. Coordinates are already
+// clipped to both; overlapping copies within one surface are handled.
+void BlitPixels(const Surface& dst, int dstX, int dstY, const Surface& src, int srcX, int srcY,
+                int width, int height, RasterOp op);
+
+enum StretchFilter {
+    kStretchNearest,
+    kStretchBilinear,
+};
+
+// Scale srcRect onto dstRect, drawing only the part inside clip (which must
+// lie within dst). Both rectangles are normalized; mirrorX/mirrorY flip the
+// image as negative StretchBlt extents do. Samples are clamped to the source
+// surface.
+void StretchPixels(const Surface& dst, const RECT& dstRect, const RECT& clip,
+                   const Surface& src, const RECT& srcRect, bool mirrorX, bool mirrorY,
+                   StretchFilter filter, RasterOp op);
+
+// AlphaBlendSpan over a rectangle, scaling with nearest sampling when the
+// sizes differ. srcRect must lie within src.
+void AlphaBlendPixels(const Surface& dst, const RECT& dstRect, const RECT& clip,
+                      const Surface& src, const RECT& srcRect, uint8_t constantAlpha, bool srcAlpha);
@@ -0,0 +1,344 @@
+// win32_region.h - Regions for the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+#pragma once
+
+#include "win32_compat.h"
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+// Set of pixels kept as y-x banded rectangles, like GDI and X11 regions.
+// The rectangles are sorted by top, then left. Rectangles in one band share
+// their top and bottom and neither touch nor overlap, bands never overlap,
+// and vertically adjacent bands with the same spans are merged, so each
+// set has a single representation. A region of one rectangle keeps it in
+// its bounds alone and never allocates.
+//
+// Set operations sweep both operands from the top, one band boundary at a
+// time, and merge the two span lists of each band, which is linear in the
+// number of rectangles. Drawing walks the bands overlapping its area and
+// the spans within them, both found by binary search.
+class Region {
+public:
+    Region() : bounds_() {}
+    explicit Region(const RECT& rect) : bounds_() { SetRect(rect); }
+    Region(const Region& other) : rects_(other.rects_), bounds_(other.bounds_) {}
+
+    // Copies keep their storage, and rectangles skip the vector entirely
+    Region& operator=(const Region& other) {
+        if (!rects_.empty() || !other.rects_.empty()) {
+            rects_ = other.rects_;
+        }
+        bounds_ = other.bounds_;
+        return *this;
+    }
+
+    bool empty() const { return bounds_.left >= bounds_.right; }
+    size_t size() const { return !rects_.empty() ? rects_.size() : (empty() ? 0 : 1); }
+    const RECT* rects() const { return !rects_.empty() ? rects_.data() : &bounds_; }
+    const RECT& bounds() const { return bounds_; }
+
+    // NULLREGION, SIMPLEREGION or COMPLEXREGION, as GDI reports it
+    int Type() const { return empty() ? NULLREGION : (rects_.empty() ? SIMPLEREGION : COMPLEXREGION); }
+
+    void SetEmpty() {
+        rects_.clear();
+        SetRectEmpty(&bounds_);
+    }
+
+    void SetRect(const RECT& rect) {
+        rects_.clear();
+        if (rect.left < rect.right && rect.top < rect.bottom) {
+            bounds_ = rect;
+        } else {
+            SetRectEmpty(&bounds_);
+        }
+    }
+
+    void Swap(Region& other) {
+        rects_.swap(other.rects_);
+        std::swap(bounds_, other.bounds_);
+    }
+
+    void Offset(int dx, int dy) {
+        if (empty()) {
+            return;
+        }
+        OffsetRect(&bounds_, dx, dy);
+        for (RECT& rect : rects_) {
+            OffsetRect(&rect, dx, dy);
+        }
+    }
+
+    bool operator==(const Region& other) const {
+        if (!EqualRect(&bounds_, &other.bounds_) || rects_.size() != other.rects_.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < rects_.size(); ++i) {
+            if (!EqualRect(&rects_[i], &other.rects_[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Contains(int x, int y) const {
+        if (x < bounds_.left || x >= bounds_.right || y < bounds_.top || y >= bounds_.bottom) {
+            return false;
+        }
+        if (rects_.empty()) {
+            return true;
+        }
+        const RECT* end = rects_.data() + rects_.size();
+        const RECT* band = FirstBandBelow(rects_.data(), end, y);
+        if (band == end || band->top > y) {
+            return false;
+        }
+        const RECT* bandEnd = BandEnd(band, end);
+        const RECT* span = std::partition_point(band, bandEnd, [x](const RECT& r) { return r.right <= x; });
+        return span != bandEnd && span->left <= x;
+    }
+
+    // Set this region to a op b (RGN_AND, RGN_OR, RGN_XOR, RGN_DIFF or
+    // RGN_COPY). Neither operand may be this region.
+    void Combine(const Region& a, const Region& b, int op) {
+        if (op == RGN_COPY) {
+            rects_ = a.rects_;
+            bounds_ = a.bounds_;
+            return;
+        }
+        if (CombineTrivially(a, b, op)) {
+            return;
+        }
+        rects_.clear();
+        const RECT* aRect = a.rects();
+        const RECT* aEnd = aRect + a.size();
+        const RECT* bRect = b.rects();
+        const RECT* bEnd = bRect + b.size();
+        size_t previousBand = SIZE_MAX;
+        int y = INT_MIN;
+        for (;;) {
+            while (aRect != aEnd && aRect->bottom <= y) {
+                aRect = BandEnd(aRect, aEnd);
+            }
+            while (bRect != bEnd && bRect->bottom <= y) {
+                bRect = BandEnd(bRect, bEnd);
+            }
+            if (aRect == aEnd && bRect == bEnd) {
+                break;
+            }
+            bool aActive = aRect != aEnd && aRect->top <= y;
+            bool bActive = bRect != bEnd && bRect->top <= y;
+            if (!aActive && !bActive) {
+                y = std::min(aRect != aEnd ? aRect->top : INT_MAX, bRect != bEnd ? bRect->top : INT_MAX);
+                continue;
+            }
+            // The slice [y, next) crosses no band boundary of either operand
+            int next = INT_MAX;
+            if (aRect != aEnd) {
+                next = std::min(next, aActive ? aRect->bottom : aRect->top);
+            }
+            if (bRect != bEnd) {
+                next = std::min(next, bActive ? bRect->bottom : bRect->top);
+            }
+            const RECT* aSpans = aActive ? aRect : aEnd;
+            const RECT* bSpans = bActive ? bRect : bEnd;
+            size_t band = rects_.size();
+            MergeSpans(aSpans, aActive ? BandEnd(aRect, aEnd) : aEnd, bSpans,
+                       bActive ? BandEnd(bRect, bEnd) : bEnd, op, y, next);
+            if (rects_.size() > band) {
+                previousBand = CoalesceBand(previousBand, band);
+            }
+            y = next;
+        }
+        FinishCombine();
+    }
+
+    // Combine with other in place, through per-thread scratch storage that
+    // the two regions trade, so repeated updates stop allocating
+    void CombineWith(const Region& other, int op) {
+        if (op != RGN_COPY && CombineTrivially(*this, other, op)) {
+            return;
+        }
+        static thread_local Region scratch;
+        scratch.Combine(*this, other, op);
+        Swap(scratch);
+    }
+
+    // Visit the parts of area inside the region, band by band
+    template <typename Visit>
+    void ForEachRect(const RECT& area, Visit visit) const {
+        RECT part;
+        if (rects_.empty()) {
+            if (IntersectRect(&part, &area, &bounds_)) {
+                visit(part);
+            }
+            return;
+        }
+        if (area.left >= bounds_.right || area.right <= bounds_.left) {
+            return;
+        }
+        const RECT* end = rects_.data() + rects_.size();
+        for (const RECT* band = FirstBandBelow(rects_.data(), end, area.top); band != end && band->top < area.bottom;) {
+            const RECT* bandEnd = BandEnd(band, end);
+            const RECT* span = std::partition_point(band, bandEnd, [&](const RECT& r) { return r.right <= area.left; });
+            for (; span != bandEnd && span->left < area.right; ++span) {
+                if (IntersectRect(&part, &area, span)) {
+                    visit(part);
+                }
+            }
+            band = bandEnd;
+        }
+    }
+
+private:
+    // First rectangle of the first band ending below y
+    static const RECT* FirstBandBelow(const RECT* begin, const RECT* end, int y) {
+        return std::partition_point(begin, end, [y](const RECT& r) { return r.bottom <= y; });
+    }
+
+    static const RECT* BandEnd(const RECT* band, const RECT* end) {
+        const RECT* r = band + 1;
+        while (r != end && r->top == band->top) {
+            ++r;
+        }
+        return r;
+    }
+
+    static bool Keep(int op, bool inA, bool inB) {
+        switch (op) {
+            case RGN_AND: return inA && inB;
+            case RGN_OR:  return inA || inB;
+            case RGN_XOR: return inA != inB;
+            case RGN_DIFF: return inA && !inB;
+        }
+        return false;
+    }
+
+    // Append the spans of the band [top, bottom) that op keeps from the two
+    // sorted span lists, joining spans that touch
+    void MergeSpans(const RECT* a, const RECT* aEnd, const RECT* b, const RECT* bEnd, int op, int top, int bottom) {
+        if (a == aEnd && b == bEnd) {
+            return;
+        }
+        int x = std::min(a != aEnd ? a->left : INT_MAX, b != bEnd ? b->left : INT_MAX);
+        size_t band = rects_.size();
+        while (a != aEnd || b != bEnd) {
+            bool inA = a != aEnd && a->left <= x;
+            bool inB = b != bEnd && b->left <= x;
+            int next = INT_MAX;
+            if (a != aEnd) {
+                next = std::min(next, inA ? a->right : a->left);
+            }
+            if (b != bEnd) {
+                next = std::min(next, inB ? b->right : b->left);
+            }
+            if (Keep(op, inA, inB)) {
+                if (rects_.size() > band && rects_.back().right == x) {
+                    rects_.back().right = next;
+                } else {
+                    RECT span = { x, top, next, bottom };
+                    rects_.push_back(span);
+                }
+            }
+            x = next;
+            if (a != aEnd && a->right <= x) {
+                ++a;
+            }
+            if (b != bEnd && b->right <= x) {
+                ++b;
+            }
+        }
+    }
+
+    // Merge the band starting at index band into the previous one when it
+    // continues it with the same spans. Returns the start of the last band.
+    size_t CoalesceBand(size_t previous, size_t band) {
+        size_t count = rects_.size() - band;
+        if (previous == SIZE_MAX || band - previous != count || rects_[previous].bottom != rects_[band].top) {
+            return band;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (rects_[previous + i].left != rects_[band + i].left ||
+                rects_[previous + i].right != rects_[band + i].right) {
+                return band;
+            }
+        }
+        int bottom = rects_[band].bottom;
+        rects_.resize(band);
+        for (size_t i = previous; i < band; ++i) {
+            rects_[i].bottom = bottom;
+        }
+        return previous;
+    }
+
+    void FinishCombine() {
+        if (rects_.size() <= 1) {
+            SetRect(rects_.empty() ? RECT() : rects_[0]);
+            return;
+        }
+        bounds_.top = rects_.front().top;
+        bounds_.bottom = rects_.back().bottom;
+        bounds_.left = INT_MAX;
+        bounds_.right = INT_MIN;
+        for (const RECT& rect : rects_) {
+            bounds_.left = std::min(bounds_.left, rect.left);
+            bounds_.right = std::max(bounds_.right, rect.right);
+        }
+    }
+
+    // Results that need no sweep: an empty or disjoint operand, or a
+    // rectangle that covers the other operand
+    bool CombineTrivially(const Region& a, const Region& b, int op) {
+        RECT overlap = { std::max(a.bounds_.left, b.bounds_.left), std::max(a.bounds_.top, b.bounds_.top),
+                         std::min(a.bounds_.right, b.bounds_.right), std::min(a.bounds_.bottom, b.bounds_.bottom) };
+        bool disjoint = overlap.left >= overlap.right || overlap.top >= overlap.bottom;
+        switch (op) {
+            case RGN_AND:
+                if (disjoint) {
+                    SetEmpty();
+                } else if (a.rects_.empty() && b.rects_.empty()) {
+                    SetRect(overlap);
+                } else if (a.rects_.empty() && Covers(a.bounds_, b.bounds_)) {
+                    *this = b;
+                } else if (b.rects_.empty() && Covers(b.bounds_, a.bounds_)) {
+                    *this = a;
+                } else {
+                    return false;
+                }
+                return true;
+            case RGN_OR:
+            case RGN_XOR:
+                if (b.empty() || (op == RGN_OR && a.rects_.empty() && Covers(a.bounds_, b.bounds_))) {
+                    *this = a;
+                } else if (a.empty() || (op == RGN_OR && b.rects_.empty() && Covers(b.bounds_, a.bounds_))) {
+                    *this = b;
+                } else {
+                    return false;
+                }
+                return true;
+            case RGN_DIFF:
+                if (disjoint) {
+                    *this = a;
+                } else if (b.rects_.empty() && Covers(b.bounds_, a.bounds_)) {
+                    SetEmpty();
+                } else {
+                    return false;
+                }
+                return true;
+        }
+        SetEmpty();
+        return true;
+    }
+
+    static bool Covers(const RECT& outer, const RECT& inner) {
+        return outer.left <= inner.left && outer.top <= inner.top && outer.right >= inner.right &&
+               outer.bottom >= inner.bottom;
+    }
+
+    std::vector<RECT> rects_; // Banded rectangles; empty unless there are two or more
+    RECT bounds_;             // Empty for the empty region
+};
@@ -0,0 +1,254 @@
+// win32_replay.cpp - Message recording and replay for the Win32 API Compatibility Layer
+
+#ifndef _WIN32
+
+#include "win32_replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static const char kLogMagic[8] = { 'M', 'V', '3', '2', 'M', 'S', 'G', 1 };
+
+// Longest encoding of one record: seven varints of at most ten bytes
+static const size_t kMaxRecordSize = 70;
+
+static uint64_t ReplayNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t ZigZag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t UnZigZag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static uint8_t* PutVarint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+static bool GetVarint(const uint8_t** in, const uint8_t* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && *in < end; shift += 7) {
+        uint8_t byte = *(*in)++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Recording. Each record is encoded against the previous one under the
+// lock and appended to a buffer that is written out in large chunks and
+// once more at exit.
+
+static const size_t kRecordFlushSize = 64 * 1024;
+
+static std::mutex g_recordLock;
+static FILE* g_recordFile = nullptr;
+static std::vector<uint8_t> g_recordBuffer;
+static DWORD g_recordTime = 0;
+static POINT g_recordPt = { 0, 0 };
+
+static void FlushRecordLocked() {
+    if (!g_recordBuffer.empty()) {
+        fwrite(g_recordBuffer.data(), 1, g_recordBuffer.size(), g_recordFile);
+        g_recordBuffer.clear();
+    }
+}
+
+void RecordMessage(const MSG& msg) {
+    uint8_t record[kMaxRecordSize];
+    std::lock_guard<std::mutex> lock(g_recordLock);
+    uint8_t* out = record;
+    out = PutVarint(out, ZigZag((int32_t)(msg.time - g_recordTime)));
+    out = PutVarint(out, msg.message);
+    out = PutVarint(out, (uint64_t)(uintptr_t)msg.hwnd);
+    out = PutVarint(out, (uint64_t)msg.wParam);
+    out = PutVarint(out, ZigZag((int64_t)msg.lParam));
+    out = PutVarint(out, ZigZag((int64_t)msg.pt.x - g_recordPt.x));
+    out = PutVarint(out, ZigZag((int64_t)msg.pt.y - g_recordPt.y));
+    g_recordTime = msg.time;
+    g_recordPt = msg.pt;
+    g_recordBuffer.insert(g_recordBuffer.end(), record, out);
+    if (g_recordBuffer.size() >= kRecordFlushSize) {
+        FlushRecordLocked();
+    }
+}
+
+static void CloseRecordAtExit() {
+    std::lock_guard<std::mutex> lock(g_recordLock);
+    FlushRecordLocked();
+    if (fclose(g_recordFile) != 0) {
+        fprintf(stderr, "Failed to write message log %s\n", getenv("MULTIVERSE32_RECORD"));
+    }
+}
+
+static bool InitRecord() {
+    const char* path = getenv("MULTIVERSE32_RECORD");
+    if (!path || !*path) {
+        return false;
+    }
+    g_recordFile = fopen(path, "wb");
+    if (!g_recordFile) {
+        fprintf(stderr, "Failed to create message log %s\n", path);
+        return false;
+    }
+    fwrite(kLogMagic, 1, sizeof(kLogMagic), g_recordFile);
+    g_recordBuffer.reserve(kRecordFlushSize + kMaxRecordSize);
+    atexit(CloseRecordAtExit);
+    return true;
+}
+
+bool g_recordEnabled = InitRecord();
+
+// Replay. The whole log is read at startup and decoded one record ahead,
+// skipping everything but input and WM_QUIT: the rest is the
+// application's own doing and will happen again by itself.
+
+static std::vector<uint8_t> g_replayLog;
+static std::string g_replayPath;
+static size_t g_replayOffset = 0;
+static bool g_replayFast = false;
+static DWORD g_replayTime = 0;       // Decoding state
+static POINT g_replayPt = { 0, 0 };
+static bool g_replayPending = false; // pendingMsg holds the next record to feed
+static MSG g_replayPendingMsg;
+static bool g_replayStarted = false;
+static uint64_t g_replayOriginNs = 0;
+static DWORD g_replayOriginTime = 0; // Time of the first record, replayed at g_replayOriginNs
+static size_t g_replayFed = 0;
+
+static bool IsReplayedMessage(UINT message) {
+    return (message >= WM_KEYFIRST && message <= WM_KEYLAST) ||
+           (message >= WM_MOUSEFIRST && message <= WM_MOUSELAST) || message == WM_QUIT;
+}
+
+static bool DecodeRecord(MSG* msg) {
+    const uint8_t* in = g_replayLog.data() + g_replayOffset;
+    const uint8_t* end = g_replayLog.data() + g_replayLog.size();
+    uint64_t time, message, hwnd, wParam, lParam, dx, dy;
+    if (!GetVarint(&in, end, &time) || !GetVarint(&in, end, &message) || !GetVarint(&in, end, &hwnd) ||
+        !GetVarint(&in, end, &wParam) || !GetVarint(&in, end, &lParam) || !GetVarint(&in, end, &dx) ||
+        !GetVarint(&in, end, &dy)) {
+        return false;
+    }
+    if (g_replayOffset == sizeof(kLogMagic)) {
+        g_replayOriginTime = (DWORD)UnZigZag(time);
+    }
+    g_replayOffset = (size_t)(in - g_replayLog.data());
+    g_replayTime += (DWORD)UnZigZag(time);
+    g_replayPt.x += (int)UnZigZag(dx);
+    g_replayPt.y += (int)UnZigZag(dy);
+    msg->hwnd = (HWND)(uintptr_t)hwnd;
+    msg->message = (UINT)message;
+    msg->wParam = (WPARAM)wParam;
+    msg->lParam = (LPARAM)UnZigZag(lParam);
+    msg->time = g_replayTime;
+    msg->pt = g_replayPt;
+    return true;
+}
+
+// Decode up to the next replayed record; false once the log is exhausted
+static bool LoadPendingRecord() {
+    if (g_replayPending) {
+        return true;
+    }
+    while (g_replayOffset < g_replayLog.size()) {
+        if (!DecodeRecord(&g_replayPendingMsg)) {
+            fprintf(stderr, "Message log %s is truncated\n", g_replayPath.c_str());
+            g_replayOffset = g_replayLog.size();
+            break;
+        }
+        if (IsReplayedMessage(g_replayPendingMsg.message)) {
+            g_replayPending = true;
+            return true;
+        }
+    }
+    g_replayEnabled = false;
+    return false;
+}
+
+static uint64_t PendingDeadline() {
+    return g_replayOriginNs + (uint64_t)(DWORD)(g_replayPendingMsg.time - g_replayOriginTime) * 1000000ull;
+}
+
+bool NextReplayMessage(uint64_t nowNs, bool idle, MSG* msg) {
+    if (!LoadPendingRecord()) {
+        return false;
+    }
+    if (!g_replayStarted) {
+        g_replayStarted = true;
+        g_replayOriginNs = nowNs;
+    }
+    if (g_replayFast ? !idle : PendingDeadline() > nowNs) {
+        return false;
+    }
+    *msg = g_replayPendingMsg;
+    g_replayPending = false;
+    ++g_replayFed;
+    return true;
+}
+
+uint64_t NextReplayDeadline() {
+    if (g_replayFast || !g_replayStarted || !LoadPendingRecord()) {
+        return UINT64_MAX;
+    }
+    return PendingDeadline();
+}
+
+// The time from the first fed message to exit is the figure to compare
+// between builds
+static void ReportReplayAtExit() {
+    uint64_t elapsedNs = g_replayStarted ? ReplayNow() - g_replayOriginNs : 0;
+    fprintf(stderr, "Replayed %zu messages from %s in %.1f ms\n", g_replayFed, g_replayPath.c_str(),
+            (double)elapsedNs / 1e6);
+}
+
+static bool InitReplay() {
+    const char* path = getenv("MULTIVERSE32_REPLAY");
+    if (!path || !*path) {
+        return false;
+    }
+    FILE* in = fopen(path, "rb");
+    if (!in) {
+        fprintf(stderr, "Failed to open message log %s\n", path);
+        return false;
+    }
+    uint8_t chunk[64 * 1024];
+    size_t count;
+    while ((count = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        g_replayLog.insert(g_replayLog.end(), chunk, chunk + count);
+    }
+    fclose(in);
+    if (g_replayLog.size() < sizeof(kLogMagic) || memcmp(g_replayLog.data(), kLogMagic, sizeof(kLogMagic)) != 0) {
+        fprintf(stderr, "%s is not a message log\n", path);
+        g_replayLog.clear();
+        return false;
+    }
+    g_replayPath = path;
+    g_replayOffset = sizeof(kLogMagic);
+    const char* speed = getenv("MULTIVERSE32_REPLAY_SPEED");
+    g_replayFast = speed && strcmp(speed, "fast") == 0;
+    atexit(ReportReplayAtExit);
+    return true;
+}
+
+bool g_replayEnabled = InitReplay();
+
+#endif // !_WIN32
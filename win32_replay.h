@@ -0,0 +1,56 @@
+// win32_replay.h - Message recording and replay for the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+//
+// Setting MULTIVERSE32_RECORD=<file> appends every message the application
+// retrieves (GetMessage, or PeekMessage with PM_REMOVE) to <file>, time and
+// cursor position included. Setting MULTIVERSE32_REPLAY=<file> feeds the
+// keyboard and mouse input of such a log back through the platform
+// thread's queue, followed by the recorded WM_QUIT. By default each message
+// is fed at its recorded offset from the first one; with
+// MULTIVERSE32_REPLAY_SPEED=fast the next one is fed as soon as the
+// application has handled everything the previous one caused, painting
+// included. Recorded window handles are used as they are, which holds as
+// long as the replaying build creates its windows in the same order.
+//
+// The log is an 8-byte header ("MV32MSG" and a version byte) followed by
+// one record per message, each a run of LEB128 varints:
+//
+//   zigzag(time - previous time)    milliseconds, as in MSG::time
+//   message
+//   hwnd
+//   wParam
+//   zigzag(lParam)
+//   zigzag(pt.x - previous pt.x)
+//   zigzag(pt.y - previous pt.y)
+//
+// so a typical mouse move takes about a dozen bytes.
+#pragma once
+
+#include "win32_compat.h"
+
+#include <stdint.h>
+
+// Set once from the environment before main() runs
+extern bool g_recordEnabled;
+extern bool g_replayEnabled;
+
+inline bool RecordEnabled() {
+    return __builtin_expect(g_recordEnabled, 0);
+}
+
+inline bool ReplayEnabled() {
+    return __builtin_expect(g_replayEnabled, 0);
+}
+
+// Append a retrieved message to the log; safe to call from any thread
+void RecordMessage(const MSG& msg);
+
+// The next recorded message to feed at nowNs (monotonic nanoseconds), if
+// one is due. Timed replay starts its clock on the first call; fast replay
+// only hands out a message when idle is set. Only the platform thread may
+// call this.
+bool NextReplayMessage(uint64_t nowNs, bool idle, MSG* msg);
+
+// When the next timed message is due, or UINT64_MAX if none is pending or
+// the replay is fast
+uint64_t NextReplayDeadline();
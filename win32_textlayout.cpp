@@ -0,0 +1,253 @@
+// win32_textlayout.cpp - DrawText layout for the Win32 API Compatibility Layer
+// Line breaking, tab expansion and ellipses, and the per-thread layout cache.
+
+#ifndef _WIN32
+
+#include "win32_textlayout.h"
+#include "win32_unicode.h"
+
+#include <string.h>
+#include <memory>
+#include <string>
+
+// ==============================================================================
+// LINE BREAKING
+// ==============================================================================
+
+static bool IsSpace(uint32_t c) {
+    return c == ' ' || c == '\t';
+}
+
+// Pen position after c, starting from x
+static int Advance(const FontData& font, uint32_t c, int x, UINT format) {
+    if (c == '\t' && (format & DT_EXPANDTABS)) {
+        int tabWidth = kTabStopCells * font.advance;
+        return tabWidth > 0 ? (x / tabWidth + 1) * tabWidth : x;
+    }
+    return x + GlyphAdvance(font, c);
+}
+
+static int MeasureLine(const FontData& font, const char* text, int start, int end, UINT format) {
+    const unsigned char* p = (const unsigned char*)text + start;
+    const unsigned char* stop = (const unsigned char*)text + end;
+    int x = 0;
+    while (p < stop) {
+        x = Advance(font, NextCodepoint(p, stop), x, format);
+    }
+    return x;
+}
+
+static int SkipSpaces(const char* text, int p, int end) {
+    while (p < end && (text[p] == ' ' || text[p] == '\t')) {
+        ++p;
+    }
+    return p;
+}
+
+static void AddLine(TextLayout& layout, int start, int end, int width) {
+    TextLine line = { start, end - start, width, false };
+    layout.lines.push_back(line);
+}
+
+// Break the paragraph [start, end) between words so lines fit width. A
+// line breaks before the last space run that precedes the first character
+// crossing the edge, and the spaces are dropped; a word wider than the
+// rectangle is kept whole on a line of its own, as Windows does.
+static void BreakWords(TextLayout& layout, const FontData& font, const char* text, int start, int end,
+                       int width, UINT format) {
+    const unsigned char* base = (const unsigned char*)text;
+    int lineStart = start;
+    for (;;) {
+        int x = 0;
+        int breakAt = -1;     // End of the text before the last space run
+        int breakWidth = 0;
+        bool inSpaces = false;
+        bool wrapped = false;
+        const unsigned char* p = base + lineStart;
+        const unsigned char* stop = base + end;
+        while (p < stop) {
+            int offset = (int)(p - base);
+            uint32_t c = NextCodepoint(p, stop);
+            int next = Advance(font, c, x, format);
+            if (IsSpace(c)) {
+                if (!inSpaces && offset > lineStart) {
+                    breakAt = offset;
+                    breakWidth = x;
+                }
+                inSpaces = true;
+            } else {
+                inSpaces = false;
+                if (next > width && offset > lineStart) {
+                    if (breakAt < 0) {
+                        // One word wider than the rectangle: keep it whole
+                        breakAt = offset;
+                        while (breakAt < end && text[breakAt] != ' ' && text[breakAt] != '\t') {
+                            ++breakAt;
+                        }
+                        breakWidth = MeasureLine(font, text, lineStart, breakAt, format);
+                    }
+                    AddLine(layout, lineStart, breakAt, breakWidth);
+                    lineStart = SkipSpaces(text, breakAt, end);
+                    wrapped = true;
+                    break;
+                }
+            }
+            x = next;
+        }
+        if (!wrapped) {
+            AddLine(layout, lineStart, end, x);
+            return;
+        }
+        if (lineStart >= end) {
+            return;
+        }
+    }
+}
+
+// Cut a line that overflows width so it fits with the ellipsis after it
+static void AddEllipsis(TextLine& line, const FontData& font, const char* text, int width, UINT format) {
+    int ellipsisWidth = MeasureTextWidth(font, kEllipsis, kEllipsisLength);
+    const unsigned char* start = (const unsigned char*)text + line.start;
+    const unsigned char* p = start;
+    const unsigned char* stop = start + line.length;
+    int x = 0;
+    while (p < stop) {
+        const unsigned char* character = p;
+        int next = Advance(font, NextCodepoint(p, stop), x, format);
+        if (next + ellipsisWidth > width) {
+            p = character;
+            break;
+        }
+        x = next;
+    }
+    line.length = (int)(p - start);
+    line.width = x + ellipsisWidth;
+    line.ellipsis = true;
+}
+
+static void Layout(TextLayout& layout, const FontData& font, const char* text, int length, int width,
+                   UINT format) {
+    layout.lines.clear();
+    int start = 0;
+    for (;;) {
+        // Paragraphs end at CR, LF or CR LF, which single lines draw as text
+        int end = start;
+        if (!(format & DT_SINGLELINE)) {
+            while (end < length && text[end] != '\r' && text[end] != '\n') {
+                ++end;
+            }
+        } else {
+            end = length;
+        }
+        if (format & DT_WORDBREAK) {
+            BreakWords(layout, font, text, start, end, width, format);
+        } else {
+            AddLine(layout, start, end, MeasureLine(font, text, start, end, format));
+        }
+        if (end < length && text[end] == '\r' && end + 1 < length && text[end + 1] == '\n') {
+            ++end;
+        }
+        start = end + 1;
+        if (start >= length) {
+            break; // A final line break starts no line
+        }
+    }
+    layout.width = 0;
+    for (TextLine& line : layout.lines) {
+        if ((format & DT_END_ELLIPSIS) && line.width > width) {
+            AddEllipsis(line, font, text, width, format);
+        }
+        if (line.width > layout.width) {
+            layout.width = line.width;
+        }
+    }
+}
+
+// ==============================================================================
+// LAYOUT CACHE
+// ==============================================================================
+
+static uint64_t HashText(const char* text, int length) {
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ (uint64_t)length;
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, text + i, sizeof(word));
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+    if (i < length) {
+        uint64_t word = 0;
+        memcpy(&word, text + i, length - i);
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+// Layouts by (text hash, font, width, flags), four ways per set with
+// least-recently-used replacement. The text itself is kept to rule out
+// hash collisions.
+class LayoutCache {
+public:
+    LayoutCache() : clock_(0) {}
+
+    const TextLayout& Find(const FontData& font, const char* text, int length, int width, UINT format) {
+        uint64_t hash = HashText(text, length);
+        Entry* set = entries_[(hash ^ font.id ^ (uint32_t)width * 0x9E3779B1u) & (kSets - 1)];
+        Entry* victim = &set[0];
+        for (int way = 0; way < kWays; ++way) {
+            Entry& entry = set[way];
+            if (entry.hash == hash && entry.fontId == font.id && entry.width == width && entry.format == format &&
+                entry.text.size() == (size_t)length && memcmp(entry.text.data(), text, length) == 0) {
+                entry.lastUse = ++clock_;
+                return entry.layout;
+            }
+            if (entry.lastUse < victim->lastUse) {
+                victim = &entry;
+            }
+        }
+        victim->hash = hash;
+        victim->fontId = font.id;
+        victim->width = width;
+        victim->format = format;
+        victim->text.assign(text, length);
+        victim->lastUse = ++clock_;
+        Layout(victim->layout, font, text, length, width, format);
+        return victim->layout;
+    }
+
+private:
+    static const int kSets = 64;
+    static const int kWays = 4;
+
+    struct Entry {
+        uint64_t hash;
+        uint32_t fontId; // 0 while unused: font ids start at 1
+        int width;
+        UINT format;
+        uint64_t lastUse;
+        std::string text;
+        TextLayout layout;
+
+        Entry() : hash(0), fontId(0), width(0), format(0), lastUse(0) {}
+    };
+
+    Entry entries_[kSets][kWays];
+    uint64_t clock_;
+};
+
+static thread_local std::unique_ptr<LayoutCache> t_layoutCache;
+
+const TextLayout& LayoutText(const FontData& font, const char* text, int length, int width, UINT format) {
+    format &= kLayoutFlags;
+    if (!(format & (DT_WORDBREAK | DT_END_ELLIPSIS))) {
+        width = 0; // Lines do not depend on it
+    }
+    if (!t_layoutCache) {
+        t_layoutCache.reset(new LayoutCache());
+    }
+    return t_layoutCache->Find(font, text, length, width, format);
+}
+
+#endif // !_WIN32
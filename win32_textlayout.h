@@ -0,0 +1,74 @@
+// win32_textlayout.h - DrawText layout for the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+//
+// DrawText breaks its text into lines (at line breaks unless DT_SINGLELINE,
+// and between words with DT_WORDBREAK), expands tabs with DT_EXPANDTABS and
+// shortens lines that overflow with DT_END_ELLIPSIS. Widths are measured
+// with the font's glyph advances, so alignment uses each line's extent.
+//
+// List views and labels lay out the same strings on every paint, so each
+// thread keeps the layouts it computed in a small set-associative cache,
+// keyed by a hash of the text together with the font, the width and the
+// flags that affect breaking. Entries keep their storage when replaced, so
+// a warm cache neither lays out nor allocates.
+#pragma once
+
+#include "win32_font.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Tab stops with DT_EXPANDTABS, in character cells, as on Windows
+const int kTabStopCells = 8;
+
+// The text shown in place of what DT_END_ELLIPSIS cuts off
+const char kEllipsis[] = "...";
+const int kEllipsisLength = 3;
+
+struct TextLine {
+    int start;      // Byte offset of the line in the text
+    int length;     // Bytes drawn, without the line break or the spaces a word break consumed
+    int width;      // Extent in pixels, with expanded tabs and any ellipsis
+    bool ellipsis;  // The text was cut at length and the ellipsis follows it
+};
+
+struct TextLayout {
+    std::vector<TextLine> lines; // At least one, empty for empty text
+    int width;                   // Extent of the widest line
+};
+
+// Flags of a DrawText format that change the layout
+const UINT kLayoutFlags = DT_SINGLELINE | DT_WORDBREAK | DT_EXPANDTABS | DT_END_ELLIPSIS;
+
+// Lay out length bytes of UTF-8 text for a rectangle width pixels wide.
+// The result lives in this thread's cache: it stays valid until the next
+// call on the same thread.
+const TextLayout& LayoutText(const FontData& font, const char* text, int length, int width, UINT format);
+
+// Visit the runs of a line between tabs as (text, length, x), x relative to
+// the start of the line, followed by the ellipsis of a shortened line
+template <typename Visit>
+void ForEachTextRun(const FontData& font, const char* text, const TextLine& line, UINT format, Visit visit) {
+    const char* run = text + line.start;
+    const char* end = run + line.length;
+    int x = 0;
+    if (format & DT_EXPANDTABS) {
+        int tabWidth = kTabStopCells * font.advance;
+        for (const char* p = run; p < end; ++p) {
+            if (*p == '\t') {
+                if (p > run) {
+                    visit(run, (int)(p - run), x);
+                    x += MeasureTextWidth(font, run, (int)(p - run));
+                }
+                x = tabWidth > 0 ? (x / tabWidth + 1) * tabWidth : x;
+                run = p + 1;
+            }
+        }
+    }
+    if (end > run) {
+        visit(run, (int)(end - run), x);
+    }
+    if (line.ellipsis) {
+        visit(kEllipsis, kEllipsisLength, line.width - MeasureTextWidth(font, kEllipsis, kEllipsisLength));
+    }
+}
@@ -0,0 +1,137 @@
+// win32_threadpool.cpp - Work-stealing thread pool for the Win32 API Compatibility Layer
+// Range-splitting work stealing over task indices.
+
+#ifndef _WIN32
+
+#include "win32_threadpool.h"
+
+const int WorkStealingPool::kMaxThreads;
+
+WorkStealingPool& WorkStealingPool::Get() {
+    static WorkStealingPool* pool = new WorkStealingPool(); // Outlives static destructors
+    return *pool;
+}
+
+WorkStealingPool::WorkStealingPool()
+    : generation_(0), task_(nullptr), context_(nullptr), participants_(0), active_(0), remaining_(0) {
+    for (Share& share : shares_) {
+        share.begin = share.end = 0;
+    }
+}
+
+// Called with lock_ held
+void WorkStealingPool::StartWorkers(int count) {
+    while ((int)workers_.size() < count) {
+        int participant = (int)workers_.size() + 1; // The caller of Run is participant 0
+        workers_.emplace_back([this, participant] { WorkerMain(participant); });
+        workers_.back().detach(); // Idle workers simply stay blocked at exit
+    }
+}
+
+void WorkStealingPool::WorkerMain(int participant) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(lock_);
+    for (;;) {
+        wake_.wait(lock, [&] { return generation_ != seen; });
+        seen = generation_;
+        // A worker that wakes after its run finished sits it out
+        if (participant >= participants_ || remaining_.load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        Task task = task_;
+        void* context = context_;
+        ++active_;
+        lock.unlock();
+        Work(participant, task, context);
+        lock.lock();
+        if (--active_ == 0) {
+            idle_.notify_all();
+        }
+    }
+}
+
+void WorkStealingPool::Run(int count, int threads, Task task, void* context) {
+    if (count <= 0) {
+        return;
+    }
+    threads = threads < 1 ? 1 : (threads > kMaxThreads ? kMaxThreads : threads);
+    if (threads > count) {
+        threads = count;
+    }
+    if (threads == 1) {
+        for (int index = 0; index < count; ++index) {
+            task(context, index);
+        }
+        return;
+    }
+    std::lock_guard<std::mutex> run(runLock_);
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        StartWorkers(threads - 1);
+        for (int participant = 0; participant < threads; ++participant) {
+            Share& share = shares_[participant];
+            std::lock_guard<SpinLock> shareLock(share.lock);
+            share.begin = (int)((int64_t)count * participant / threads);
+            share.end = (int)((int64_t)count * (participant + 1) / threads);
+        }
+        task_ = task;
+        context_ = context;
+        participants_ = threads;
+        remaining_.store(count, std::memory_order_relaxed);
+        ++generation_;
+    }
+    wake_.notify_all();
+    Work(0, task, context);
+    std::unique_lock<std::mutex> lock(lock_);
+    idle_.wait(lock, [&] { return remaining_.load(std::memory_order_acquire) == 0 && active_ == 0; });
+}
+
+void WorkStealingPool::Work(int participant, Task task, void* context) {
+    int index;
+    while (Take(participant, &index) || Steal(participant, &index)) {
+        task(context, index);
+        if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(lock_);
+            idle_.notify_all();
+        }
+    }
+}
+
+bool WorkStealingPool::Take(int participant, int* index) {
+    Share& share = shares_[participant];
+    std::lock_guard<SpinLock> lock(share.lock);
+    if (share.begin >= share.end) {
+        return false;
+    }
+    *index = share.begin++;
+    return true;
+}
+
+// Move the back half of the first nonempty share after this participant's
+// own into it, and take the first stolen index
+bool WorkStealingPool::Steal(int participant, int* index) {
+    int participants = participants_;
+    for (int i = 1; i < participants; ++i) {
+        Share& victim = shares_[(participant + i) % participants];
+        int begin, end;
+        {
+            std::lock_guard<SpinLock> lock(victim.lock);
+            int left = victim.end - victim.begin;
+            if (left <= 0) {
+                continue;
+            }
+            end = victim.end;
+            begin = end - (left + 1) / 2;
+            victim.end = begin;
+        }
+        Share& own = shares_[participant];
+        std::lock_guard<SpinLock> lock(own.lock);
+        own.begin = begin + 1;
+        own.end = end;
+        *index = begin;
+        return true;
+    }
+    return false;
+}
+
+#endif // !_WIN32
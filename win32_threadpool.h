@@ -0,0 +1,63 @@
+// win32_threadpool.h - Work-stealing thread pool for the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+//
+// Parallel rasterization splits a batch of drawing into independent tasks,
+// the tiles of a surface, and runs them on worker threads together with the
+// calling thread. Each participant starts on an equal, contiguous share of
+// the task indices and takes them from the front. One that runs out steals
+// the back half of another's share, so uneven tiles (text next to empty
+// space) still keep every thread busy. Workers are started the first time
+// a run asks for them and kept; after that a run does not allocate.
+#pragma once
+
+#include "win32_handles.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+public:
+    typedef void (*Task)(void* context, int index);
+
+    static const int kMaxThreads = 64;
+
+    // The process's pool
+    static WorkStealingPool& Get();
+
+    // Run task for every index in [0, count) on up to threads threads, the
+    // caller included, and return once all have finished. Runs from several
+    // threads take turns.
+    void Run(int count, int threads, Task task, void* context);
+
+private:
+    // Task indices a participant has left, [begin, end)
+    struct alignas(64) Share {
+        SpinLock lock;
+        int begin;
+        int end;
+    };
+
+    WorkStealingPool();
+
+    void StartWorkers(int count);
+    void WorkerMain(int participant);
+    void Work(int participant, Task task, void* context);
+    bool Take(int participant, int* index);
+    bool Steal(int participant, int* index);
+
+    std::mutex runLock_;           // Held for a whole run
+    std::mutex lock_;              // Guards the fields below and the shares' setup
+    std::condition_variable wake_; // Workers wait for a new generation
+    std::condition_variable idle_; // Run waits for the workers to finish
+    uint64_t generation_;
+    Task task_;
+    void* context_;
+    int participants_;
+    int active_;                   // Workers inside the current run
+    std::atomic<int> remaining_;   // Tasks not yet finished
+    std::vector<std::thread> workers_;
+    Share shares_[kMaxThreads];
+};
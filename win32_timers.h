@@ -0,0 +1,212 @@
+// win32_timers.h - Timer queue used by the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+#pragma once
+
+#include "win32_compat.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// SetTimer timers of one thread, ordered by deadline in an indexed binary
+// min-heap. Every timer records its heap position, so resetting or killing
+// a timer re-sifts or removes it in O(log n) and the heap never holds stale
+// entries. Nothing runs when a deadline passes: the message pump asks for
+// an expired timer once its queue is otherwise empty and re-arms it from
+// the current time, so a timer that falls behind yields a single WM_TIMER
+// rather than one per missed period, as on Windows.
+class TimerQueue {
+public:
+    static const uint64_t kNoDeadline = UINT64_MAX;
+    static const size_t kNone = (size_t)-1;
+
+    struct Timer {
+        HWND hwnd;           // NULL for thread timers
+        UINT_PTR id;
+        TIMERPROC proc;      // Called by DispatchMessage instead of the window procedure
+        uint64_t intervalNs;
+        uint64_t deadlineNs;
+        size_t heapIndex;
+    };
+
+    TimerQueue() {}
+
+    TimerQueue(const TimerQueue&) = delete;
+    TimerQueue& operator=(const TimerQueue&) = delete;
+
+    bool empty() const { return heap_.empty(); }
+    size_t size() const { return heap_.size(); }
+
+    // Start the timer (hwnd, id), or restart it with new settings
+    void Set(HWND hwnd, UINT_PTR id, TIMERPROC proc, uint64_t intervalNs, uint64_t nowNs) {
+        size_t slot = Find(hwnd, id);
+        if (slot == kNone) {
+            if (!freeSlots_.empty()) {
+                slot = freeSlots_.back();
+                freeSlots_.pop_back();
+            } else {
+                slot = timers_.size();
+                timers_.push_back(Timer());
+            }
+            timers_[slot].hwnd = hwnd;
+            timers_[slot].id = id;
+            timers_[slot].heapIndex = heap_.size();
+            heap_.push_back(slot);
+            index_[Key(hwnd, id)] = slot;
+        }
+        Timer& timer = timers_[slot];
+        timer.proc = proc;
+        timer.intervalNs = intervalNs;
+        timer.deadlineNs = nowNs + intervalNs;
+        SiftUp(timer.heapIndex);
+        SiftDown(timer.heapIndex);
+    }
+
+    bool Kill(HWND hwnd, UINT_PTR id) {
+        size_t slot = Find(hwnd, id);
+        if (slot == kNone) {
+            return false;
+        }
+        Remove(slot);
+        return true;
+    }
+
+    size_t Find(HWND hwnd, UINT_PTR id) const {
+        std::unordered_map<Key, size_t, KeyHash>::const_iterator it = index_.find(Key(hwnd, id));
+        return it != index_.end() ? it->second : kNone;
+    }
+
+    const Timer& operator[](size_t slot) const { return timers_[slot]; }
+
+    // Earliest deadline of the timers accepted by match(const Timer&).
+    // Only the unfiltered query is O(1); a filtered one scans every timer.
+    template <typename Match>
+    uint64_t NextDeadline(Match match) const {
+        if (heap_.empty()) {
+            return kNoDeadline;
+        }
+        const Timer& top = timers_[heap_[0]];
+        if (match(top)) {
+            return top.deadlineNs;
+        }
+        uint64_t deadline = kNoDeadline;
+        for (size_t slot : heap_) {
+            const Timer& timer = timers_[slot];
+            if (timer.deadlineNs < deadline && match(timer)) {
+                deadline = timer.deadlineNs;
+            }
+        }
+        return deadline;
+    }
+
+    // The expired timer with the earliest deadline accepted by match, or
+    // kNone. Expired timers form a subtree at the top of the heap, so the
+    // search only visits those.
+    template <typename Match>
+    size_t FindExpired(uint64_t nowNs, Match match) const {
+        if (heap_.empty() || timers_[heap_[0]].deadlineNs > nowNs) {
+            return kNone;
+        }
+        if (match(timers_[heap_[0]])) {
+            return heap_[0];
+        }
+        size_t best = kNone;
+        size_t stack[64];
+        size_t depth = 0;
+        stack[depth++] = 0;
+        while (depth > 0) {
+            size_t i = stack[--depth];
+            const Timer& timer = timers_[heap_[i]];
+            if (timer.deadlineNs > nowNs) {
+                continue;
+            }
+            if ((best == kNone || timer.deadlineNs < timers_[best].deadlineNs) && match(timer)) {
+                best = heap_[i];
+            }
+            // A binary heap of n nodes is log2(n) deep, so 64 entries suffice
+            for (size_t child = 2 * i + 1; child <= 2 * i + 2 && child < heap_.size(); ++child) {
+                stack[depth++] = child;
+            }
+        }
+        return best;
+    }
+
+    // The timer fired: its next period starts now
+    void Rearm(size_t slot, uint64_t nowNs) {
+        Timer& timer = timers_[slot];
+        timer.deadlineNs = nowNs + timer.intervalNs;
+        SiftDown(timer.heapIndex);
+    }
+
+    void Remove(size_t slot) {
+        Timer& timer = timers_[slot];
+        size_t i = timer.heapIndex;
+        index_.erase(Key(timer.hwnd, timer.id));
+        size_t last = heap_.back();
+        heap_.pop_back();
+        if (last != slot) {
+            heap_[i] = last;
+            timers_[last].heapIndex = i;
+            SiftUp(i);
+            SiftDown(timers_[last].heapIndex);
+        }
+        freeSlots_.push_back(slot);
+    }
+
+private:
+    struct Key {
+        HWND hwnd;
+        UINT_PTR id;
+
+        Key(HWND h, UINT_PTR i) : hwnd(h), id(i) {}
+        bool operator==(const Key& other) const { return hwnd == other.hwnd && id == other.id; }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            uint64_t value = ((uint64_t)(uintptr_t)key.hwnd << 32) ^ (uint64_t)key.id;
+            return (size_t)(value * 0x9E3779B97F4A7C15ull >> 16);
+        }
+    };
+
+    bool Earlier(size_t a, size_t b) const { return timers_[heap_[a]].deadlineNs < timers_[heap_[b]].deadlineNs; }
+
+    void Swap(size_t a, size_t b) {
+        size_t slot = heap_[a];
+        heap_[a] = heap_[b];
+        heap_[b] = slot;
+        timers_[heap_[a]].heapIndex = a;
+        timers_[heap_[b]].heapIndex = b;
+    }
+
+    void SiftUp(size_t i) {
+        while (i > 0 && Earlier(i, (i - 1) / 2)) {
+            Swap(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    void SiftDown(size_t i) {
+        for (;;) {
+            size_t smallest = i;
+            size_t left = 2 * i + 1;
+            if (left < heap_.size() && Earlier(left, smallest)) {
+                smallest = left;
+            }
+            if (left + 1 < heap_.size() && Earlier(left + 1, smallest)) {
+                smallest = left + 1;
+            }
+            if (smallest == i) {
+                return;
+            }
+            Swap(i, smallest);
+            i = smallest;
+        }
+    }
+
+    std::vector<Timer> timers_;    // Indexed by slot
+    std::vector<size_t> freeSlots_;
+    std::vector<size_t> heap_;     // Slots in heap order
+    std::unordered_map<Key, size_t, KeyHash> index_;
+};
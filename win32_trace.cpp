@@ -0,0 +1,131 @@
+// win32_trace.cpp - Event tracing for the Win32 API Compatibility Layer
+
+#ifndef _WIN32
+
+#include "win32_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct TraceEvent {
+    const char* name;
+    const char* argName;
+    uint64_t argValue;
+    uint64_t startNs;
+    uint64_t durationNs;
+};
+
+// Ring of the most recent events of one thread. Only the owning thread
+// writes; head is published with release semantics so a dump from another
+// thread sees complete events. Buffers are never freed, so the events of
+// threads that have exited are still written out.
+struct TraceBuffer {
+    static const size_t kCapacity = 1u << 16;
+
+    TraceEvent events[kCapacity];
+    std::atomic<uint64_t> head;
+    uint32_t threadId;
+
+    TraceBuffer() : head(0), threadId(0) {}
+};
+
+static std::mutex g_traceBuffersLock;
+static std::vector<TraceBuffer*> g_traceBuffers;
+static std::string g_tracePath;
+static uint64_t g_traceOriginNs = 0;
+
+static thread_local TraceBuffer* t_traceBuffer = nullptr;
+
+uint64_t TraceNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static TraceBuffer* ThreadTraceBuffer() {
+    if (!t_traceBuffer) {
+        TraceBuffer* buffer = new TraceBuffer();
+        std::lock_guard<std::mutex> lock(g_traceBuffersLock);
+        buffer->threadId = (uint32_t)g_traceBuffers.size() + 1;
+        g_traceBuffers.push_back(buffer);
+        t_traceBuffer = buffer;
+    }
+    return t_traceBuffer;
+}
+
+void TraceComplete(const char* name, uint64_t startNs, uint64_t endNs, const char* argName, uint64_t argValue) {
+    TraceBuffer* buffer = ThreadTraceBuffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    TraceEvent& event = buffer->events[head & (TraceBuffer::kCapacity - 1)];
+    event.name = name;
+    event.argName = argName;
+    event.argValue = argValue;
+    event.startNs = startNs;
+    event.durationNs = endNs - startNs;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+static void WriteMicroseconds(FILE* out, uint64_t ns) {
+    fprintf(out, "%llu.%03u", (unsigned long long)(ns / 1000), (unsigned)(ns % 1000));
+}
+
+bool WriteTrace(const char* path) {
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        return false;
+    }
+    int pid = (int)getpid();
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"multiverse32\"}}", pid);
+
+    std::lock_guard<std::mutex> lock(g_traceBuffersLock);
+    for (TraceBuffer* buffer : g_traceBuffers) {
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+                     "\"args\":{\"name\":\"thread %u\"}}", pid, buffer->threadId, buffer->threadId);
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t first = head > TraceBuffer::kCapacity ? head - TraceBuffer::kCapacity : 0;
+        for (uint64_t i = first; i < head; ++i) {
+            const TraceEvent& event = buffer->events[i & (TraceBuffer::kCapacity - 1)];
+            uint64_t start = event.startNs > g_traceOriginNs ? event.startNs - g_traceOriginNs : 0;
+            fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"multiverse32\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":",
+                    event.name, pid, buffer->threadId);
+            WriteMicroseconds(out, start);
+            fprintf(out, ",\"dur\":");
+            WriteMicroseconds(out, event.durationNs);
+            if (event.argName) {
+                fprintf(out, ",\"args\":{\"%s\":\"0x%llx\"}", event.argName, (unsigned long long)event.argValue);
+            }
+            fputc('}', out);
+        }
+    }
+    fprintf(out, "\n]}\n");
+    return fclose(out) == 0;
+}
+
+static void WriteTraceAtExit() {
+    if (!WriteTrace(g_tracePath.c_str())) {
+        fprintf(stderr, "Failed to write trace to %s\n", g_tracePath.c_str());
+    }
+}
+
+static bool InitTrace() {
+    const char* path = getenv("MULTIVERSE32_TRACE");
+    if (!path || !*path) {
+        return false;
+    }
+    g_tracePath = path;
+    g_traceOriginNs = TraceNow();
+    atexit(WriteTraceAtExit);
+    return true;
+}
+
+bool g_traceEnabled = InitTrace();
+
+#endif // !_WIN32
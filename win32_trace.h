@@ -0,0 +1,51 @@
+// win32_trace.h - Event tracing for the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+//
+// Setting MULTIVERSE32_TRACE=<file> records message dispatch, painting and
+// platform hook calls into per-thread ring buffers and writes them to
+// <file> at exit in Chrome trace_event JSON, for chrome://tracing or
+// Perfetto. When the variable is unset every trace point is a single
+// predictable branch.
+#pragma once
+
+#include <stdint.h>
+
+// Set once from the environment before main() runs
+extern bool g_traceEnabled;
+
+inline bool TraceEnabled() {
+    return __builtin_expect(g_traceEnabled, 0);
+}
+
+uint64_t TraceNow(); // Nanoseconds on the monotonic clock
+
+// Record a complete event. name and argName must be string literals (or
+// otherwise outlive the process), since only the pointers are stored.
+// argName may be NULL for events without an argument.
+void TraceComplete(const char* name, uint64_t startNs, uint64_t endNs,
+                   const char* argName = nullptr, uint64_t argValue = 0);
+
+// Write every thread's buffered events to path; returns false on I/O errors
+bool WriteTrace(const char* path);
+
+// Times the enclosing block as one event
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, const char* argName = nullptr, uint64_t argValue = 0)
+        : name_(name), argName_(argName), argValue_(argValue), start_(TraceEnabled() ? TraceNow() : 0) {}
+
+    ~TraceScope() {
+        if (start_) {
+            TraceComplete(name_, start_, TraceNow(), argName_, argValue_);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    const char* argName_;
+    uint64_t argValue_;
+    uint64_t start_;
+};
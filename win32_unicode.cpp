@@ -0,0 +1,214 @@
+// win32_unicode.cpp - UTF-8/UTF-16 text for the Win32 API Compatibility Layer
+// Transcoding kernels and the per-thread scratch buffers of the W entry points.
+
+#ifndef _WIN32
+
+#include "win32_unicode.h"
+
+#include <memory>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define UNICODE_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define UNICODE_NEON
+#endif
+
+// ==============================================================================
+// TRANSCODING
+// ==============================================================================
+
+// Copy 8 UTF-16 code units to dst as bytes if they are all ASCII
+static inline bool NarrowAscii8(const WCHAR* src, char* dst) {
+#if defined(UNICODE_X86)
+    __m128i units = _mm_loadu_si128((const __m128i*)src);
+    __m128i high = _mm_and_si128(units, _mm_set1_epi16((short)0xFF80));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xFFFF) {
+        return false;
+    }
+    _mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(units, units));
+    return true;
+#elif defined(UNICODE_NEON)
+    uint16x8_t units = vld1q_u16((const uint16_t*)src);
+    if (vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(units, 7)), 0) != 0) {
+        return false;
+    }
+    vst1_u8((uint8_t*)dst, vmovn_u16(units));
+    return true;
+#else
+    uint16_t any = 0;
+    for (int i = 0; i < 8; ++i) {
+        any |= (uint16_t)src[i];
+    }
+    if (any >= 0x80) {
+        return false;
+    }
+    for (int i = 0; i < 8; ++i) {
+        dst[i] = (char)src[i];
+    }
+    return true;
+#endif
+}
+
+// Widen 16 bytes to UTF-16 code units if they are all ASCII
+static inline bool WidenAscii16(const char* src, WCHAR* dst) {
+#if defined(UNICODE_X86)
+    __m128i bytes = _mm_loadu_si128((const __m128i*)src);
+    if (_mm_movemask_epi8(bytes) != 0) {
+        return false;
+    }
+    __m128i zero = _mm_setzero_si128();
+    _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi8(bytes, zero));
+    _mm_storeu_si128((__m128i*)(dst + 8), _mm_unpackhi_epi8(bytes, zero));
+    return true;
+#elif defined(UNICODE_NEON)
+    uint8x16_t bytes = vld1q_u8((const uint8_t*)src);
+    uint8x8_t any = vorr_u8(vget_low_u8(bytes), vget_high_u8(bytes));
+    if ((vget_lane_u64(vreinterpret_u64_u8(any), 0) & 0x8080808080808080ull) != 0) {
+        return false;
+    }
+    vst1q_u16((uint16_t*)dst, vmovl_u8(vget_low_u8(bytes)));
+    vst1q_u16((uint16_t*)(dst + 8), vmovl_u8(vget_high_u8(bytes)));
+    return true;
+#else
+    unsigned char any = 0;
+    for (int i = 0; i < 16; ++i) {
+        any |= (unsigned char)src[i];
+    }
+    if (any >= 0x80) {
+        return false;
+    }
+    for (int i = 0; i < 16; ++i) {
+        dst[i] = (WCHAR)(unsigned char)src[i];
+    }
+    return true;
+#endif
+}
+
+size_t Utf16Length(const WCHAR* text) {
+    const WCHAR* end = text;
+    while (*end) {
+        ++end;
+    }
+    return (size_t)(end - text);
+}
+
+size_t Utf16ToUtf8(const WCHAR* text, size_t length, char* dst) {
+    char* out = dst;
+    size_t i = 0;
+    while (i < length) {
+        if (i + 8 <= length && NarrowAscii8(text + i, out)) {
+            i += 8;
+            out += 8;
+            continue;
+        }
+        // Convert up to the next block boundary one code point at a time; a
+        // surrogate pair may end one unit past it
+        size_t blockEnd = i + 8 < length ? i + 8 : length;
+        while (i < blockEnd) {
+            uint32_t c = text[i++];
+            if (c < 0x80) {
+                *out++ = (char)c;
+                continue;
+            }
+            if (c < 0x800) {
+                *out++ = (char)(0xC0 | (c >> 6));
+                *out++ = (char)(0x80 | (c & 0x3F));
+                continue;
+            }
+            if (c >= 0xD800 && c <= 0xDFFF) {
+                if (c <= 0xDBFF && i < length && text[i] >= 0xDC00 && text[i] <= 0xDFFF) {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (text[i++] - 0xDC00);
+                    *out++ = (char)(0xF0 | (c >> 18));
+                    *out++ = (char)(0x80 | ((c >> 12) & 0x3F));
+                    *out++ = (char)(0x80 | ((c >> 6) & 0x3F));
+                    *out++ = (char)(0x80 | (c & 0x3F));
+                    continue;
+                }
+                c = kReplacementChar;
+            }
+            *out++ = (char)(0xE0 | (c >> 12));
+            *out++ = (char)(0x80 | ((c >> 6) & 0x3F));
+            *out++ = (char)(0x80 | (c & 0x3F));
+        }
+    }
+    return (size_t)(out - dst);
+}
+
+size_t Utf8ToUtf16(const char* text, size_t length, WCHAR* dst) {
+    const unsigned char* p = (const unsigned char*)text;
+    const unsigned char* end = p + length;
+    WCHAR* out = dst;
+    while (p < end) {
+        if (end - p >= 16 && WidenAscii16((const char*)p, out)) {
+            p += 16;
+            out += 16;
+            continue;
+        }
+        // A sequence never needs more code units than it has bytes
+        const unsigned char* blockEnd = end - p > 16 ? p + 16 : end;
+        while (p < blockEnd) {
+            uint32_t c = NextCodepoint(p, end);
+            if (c < 0x10000) {
+                *out++ = (WCHAR)c;
+            } else {
+                c -= 0x10000;
+                *out++ = (WCHAR)(0xD800 + (c >> 10));
+                *out++ = (WCHAR)(0xDC00 + (c & 0x3FF));
+            }
+        }
+    }
+    return (size_t)(out - dst);
+}
+
+// ==============================================================================
+// SCRATCH BUFFERS
+// ==============================================================================
+
+// Storage that grows geometrically and is never shrunk or cleared
+template <typename T>
+class ScratchBuffer {
+public:
+    ScratchBuffer() : capacity_(0) {}
+
+    T* Reserve(size_t count) {
+        if (count > capacity_) {
+            size_t capacity = capacity_ ? capacity_ : 256;
+            while (capacity < count) {
+                capacity *= 2;
+            }
+            data_.reset(new T[capacity]);
+            capacity_ = capacity;
+        }
+        return data_.get();
+    }
+
+private:
+    std::unique_ptr<T[]> data_;
+    size_t capacity_;
+};
+
+static thread_local ScratchBuffer<char> t_utf8Scratch[kScratchSlotCount];
+static thread_local ScratchBuffer<WCHAR> t_utf16Scratch[kScratchSlotCount];
+
+const char* Utf16ToUtf8Scratch(const WCHAR* text, int length, ScratchSlot slot, int* utf8Length) {
+    size_t units = length < 0 ? Utf16Length(text) : (size_t)length;
+    char* buffer = t_utf8Scratch[slot].Reserve(units * 3 + 1);
+    size_t bytes = Utf16ToUtf8(text, units, buffer);
+    buffer[bytes] = '\0';
+    if (utf8Length) {
+        *utf8Length = (int)bytes;
+    }
+    return buffer;
+}
+
+const WCHAR* Utf8ToUtf16Scratch(const char* text, size_t length, ScratchSlot slot, size_t* utf16Length) {
+    WCHAR* buffer = t_utf16Scratch[slot].Reserve(length + 1);
+    size_t units = Utf8ToUtf16(text, length, buffer);
+    buffer[units] = 0;
+    *utf16Length = units;
+    return buffer;
+}
+
+#endif // !_WIN32
@@ -0,0 +1,80 @@
+// win32_unicode.h - UTF-8/UTF-16 text for the Win32 API Compatibility Layer
+// Internal header: only included by the emulation sources.
+//
+// Text is UTF-8 inside the layer. The W-suffixed entry points transcode
+// their UTF-16 arguments into per-thread scratch buffers that keep their
+// storage, so a text call only allocates while its thread's buffer grows
+// to the longest text seen. Runs of ASCII, by far the common case, are
+// converted 8 or 16 code units at a time with SSE2 or NEON.
+#pragma once
+
+#include "win32_compat.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+const uint32_t kReplacementChar = 0xFFFD;
+
+// Decode one UTF-8 sequence; malformed input yields U+FFFD and skips a byte
+inline uint32_t NextCodepoint(const unsigned char*& p, const unsigned char* end) {
+    uint32_t c = *p++;
+    if (c < 0x80) {
+        return c;
+    }
+    int extra;
+    uint32_t min;
+    if ((c & 0xE0) == 0xC0) {
+        extra = 1; min = 0x80; c &= 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+        extra = 2; min = 0x800; c &= 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+        extra = 3; min = 0x10000; c &= 0x07;
+    } else {
+        return kReplacementChar;
+    }
+    if (end - p < extra) {
+        p = end;
+        return kReplacementChar;
+    }
+    for (int i = 0; i < extra; ++i) {
+        if ((p[i] & 0xC0) != 0x80) {
+            return kReplacementChar;
+        }
+        c = (c << 6) | (p[i] & 0x3F);
+    }
+    p += extra;
+    if (c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+        return kReplacementChar;
+    }
+    return c;
+}
+
+// Length of a NUL-terminated UTF-16 string, in code units
+size_t Utf16Length(const WCHAR* text);
+
+// Convert length UTF-16 code units into dst, which must have room for
+// 3 * length bytes. Unpaired surrogates become U+FFFD. Returns the bytes
+// written; dst is not terminated.
+size_t Utf16ToUtf8(const WCHAR* text, size_t length, char* dst);
+
+// Convert length UTF-8 bytes into dst, which must have room for length
+// code units. Malformed sequences become U+FFFD. Returns the code units
+// written; dst is not terminated.
+size_t Utf8ToUtf16(const char* text, size_t length, WCHAR* dst);
+
+// Per-thread scratch buffers. Each slot holds one converted string until
+// the next conversion into the same slot on the same thread, so a call that
+// needs two strings at once converts them into different slots.
+enum ScratchSlot {
+    kScratchText,
+    kScratchClassName,
+    kScratchSlotCount,
+};
+
+// UTF-8 copy of text, NUL-terminated. A length of -1 converts up to the
+// terminator. Stores the byte count in utf8Length when it is not NULL.
+const char* Utf16ToUtf8Scratch(const WCHAR* text, int length, ScratchSlot slot, int* utf8Length);
+
+// UTF-16 copy of length bytes of UTF-8 text, NUL-terminated. Stores the
+// code unit count in utf16Length.
+const WCHAR* Utf8ToUtf16Scratch(const char* text, size_t length, ScratchSlot slot, size_t* utf16Length);